@@ -0,0 +1,568 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Aggregation of the selected records for auditreduce(1).  With -G, records
+ * are grouped by the values of some of their fields, and each group counts
+ * its records; with -D, it also estimates the number of distinct values of
+ * one field with a HyperLogLog sketch, of fixed size whatever the number of
+ * values.  Groups are kept in an open-addressed hash table and printed as a
+ * table once every record has been read.
+ */
+
+#include <config/config.h>
+
+#ifdef HAVE_FULL_QUEUE_H
+#include <sys/queue.h>
+#else
+#include <compat/queue.h>
+#endif
+
+#include <sys/types.h>
+
+#include <bsm/libbsm.h>
+
+#include <err.h>
+#include <math.h>
+#include <regex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "auditreduce.h"
+
+/* Fields records are grouped by, or whose values are counted. */
+#define	AF_EVENT	0
+#define	AF_CLASS	1
+#define	AF_AUID		2
+#define	AF_EUID		3
+#define	AF_EGID		4
+#define	AF_RUID		5
+#define	AF_RGID		6
+#define	AF_PID		7
+#define	AF_RETURN	8
+#define	AF_ZONE		9
+#define	AF_PATH		10
+#define	AF_MINUTE	11
+#define	AF_HOUR		12
+#define	AF_DAY		13
+
+#define	AF_KEY		0x01		/* Records can be grouped by it. */
+#define	AF_DISTINCT	0x02		/* Its values can be counted. */
+
+static const struct agg_field {
+	const char	*af_name;
+	int		 af_field;
+	int		 af_flags;
+} agg_fields[] = {
+	{ "event",	AF_EVENT,	AF_KEY | AF_DISTINCT },
+	{ "class",	AF_CLASS,	AF_KEY | AF_DISTINCT },
+	{ "auid",	AF_AUID,	AF_KEY | AF_DISTINCT },
+	{ "euid",	AF_EUID,	AF_KEY | AF_DISTINCT },
+	{ "egid",	AF_EGID,	AF_KEY | AF_DISTINCT },
+	{ "ruid",	AF_RUID,	AF_KEY | AF_DISTINCT },
+	{ "rgid",	AF_RGID,	AF_KEY | AF_DISTINCT },
+	{ "pid",	AF_PID,		AF_KEY | AF_DISTINCT },
+	{ "return",	AF_RETURN,	AF_KEY | AF_DISTINCT },
+	{ "zone",	AF_ZONE,	AF_KEY | AF_DISTINCT },
+	{ "path",	AF_PATH,	AF_DISTINCT },
+	{ "minute",	AF_MINUTE,	AF_KEY },
+	{ "hour",	AF_HOUR,	AF_KEY },
+	{ "day",	AF_DAY,		AF_KEY },
+};
+#define	AGG_NFIELDS	(sizeof(agg_fields) / sizeof(agg_fields[0]))
+
+/* A field a record does not have, which is printed as "-". */
+#define	AGG_NONE	UINT64_MAX
+
+/*
+ * HyperLogLog sketches have 2^AGG_HLLBITS registers of one byte, for a
+ * standard error of about 3%.
+ */
+#define	AGG_HLLBITS	10
+#define	AGG_HLLREGS	(1 << AGG_HLLBITS)
+
+struct agg_group {
+	u_int64_t	 ag_hash;
+	u_int64_t	 ag_count;
+	u_int64_t	 ag_key[AGG_NFIELDS];
+	u_char		*ag_hll;	/* Registers, with -D. */
+};
+
+static const struct agg_field	*agg_keys[AGG_NFIELDS];
+static int			 agg_nkeys;
+static const struct agg_field	*agg_dist;
+static int			 agg_needzone;
+
+static struct agg_group	**agg_tab;	/* Size a power of two. */
+static size_t		  agg_size;
+static size_t		  agg_ngroups;
+
+/* Zone names, referred to by their index in the keys. */
+static char		**agg_zones;
+static u_int64_t	  agg_nzones;
+
+/* Last bucket of local time computed for each of minute, hour and day. */
+static struct agg_bucket {
+	u_int64_t	ab_lo;
+	u_int64_t	ab_hi;
+} agg_buckets[3];
+
+static const struct agg_field *
+agg_lookup(const char *name, size_t len, int flag)
+{
+	size_t i;
+
+	for (i = 0; i < AGG_NFIELDS; i++)
+		if (strlen(agg_fields[i].af_name) == len &&
+		    strncmp(agg_fields[i].af_name, name, len) == 0)
+			return ((agg_fields[i].af_flags & flag) ?
+			    &agg_fields[i] : NULL);
+	return (NULL);
+}
+
+/*
+ * Group records by the comma separated fields of spec.  Returns -1 if one
+ * is unknown or given twice.
+ */
+int
+agg_groupby(const char *spec)
+{
+	const struct agg_field *af;
+	size_t len;
+	int i;
+
+	for (;;) {
+		len = strcspn(spec, ",");
+		if ((af = agg_lookup(spec, len, AF_KEY)) == NULL)
+			return (-1);
+		for (i = 0; i < agg_nkeys; i++)
+			if (agg_keys[i] == af)
+				return (-1);
+		agg_keys[agg_nkeys++] = af;
+		if (af->af_field == AF_ZONE)
+			agg_needzone = 1;
+		if (spec[len] == '\0')
+			return (0);
+		spec += len + 1;
+	}
+}
+
+/*
+ * Estimate the number of distinct values of field in each group.
+ */
+int
+agg_distinct(const char *field)
+{
+
+	if ((agg_dist = agg_lookup(field, strlen(field), AF_DISTINCT)) ==
+	    NULL)
+		return (-1);
+	if (agg_dist->af_field == AF_ZONE)
+		agg_needzone = 1;
+	return (0);
+}
+
+static u_int64_t
+agg_mix(u_int64_t h)
+{
+
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return (h);
+}
+
+static u_int64_t
+agg_hashstr(const char *s, size_t len)
+{
+	u_int64_t h;
+
+	h = 0xcbf29ce484222325ULL;
+	for (; len > 0 && *s != '\0'; len--, s++) {
+		h ^= (u_char)*s;
+		h *= 0x100000001b3ULL;
+	}
+	return (agg_mix(h));
+}
+
+/*
+ * Return the start of the minute, hour or day of local time holding sec.
+ * Consecutive records mostly fall in the same one, which is kept.
+ */
+static u_int64_t
+agg_bucket(int field, u_int64_t sec)
+{
+	struct agg_bucket *ab;
+	struct tm tm;
+	time_t t;
+
+	ab = &agg_buckets[field - AF_MINUTE];
+	if (sec >= ab->ab_lo && sec < ab->ab_hi)
+		return (ab->ab_lo);
+	t = sec;
+	if (localtime_r(&t, &tm) == NULL)
+		return (AGG_NONE);
+	tm.tm_sec = 0;
+	if (field != AF_MINUTE)
+		tm.tm_min = 0;
+	if (field == AF_DAY) {
+		tm.tm_hour = 0;
+		tm.tm_isdst = -1;
+	}
+	if ((t = mktime(&tm)) == -1)
+		return (AGG_NONE);
+	ab->ab_lo = t;
+	switch (field) {
+	case AF_MINUTE:
+		ab->ab_hi = ab->ab_lo + 60;
+		break;
+	case AF_HOUR:
+		ab->ab_hi = ab->ab_lo + 3600;
+		break;
+	default:
+		tm.tm_mday++;
+		tm.tm_isdst = -1;
+		ab->ab_hi = mktime(&tm);
+		break;
+	}
+	return (ab->ab_lo);
+}
+
+static const char *
+agg_zone(u_char *buf, int len)
+{
+	tokenstr_t tok;
+	int bytesread;
+
+	for (bytesread = 0; bytesread < len; bytesread += tok.len) {
+		if (au_fetch_tok(&tok, buf + bytesread, len - bytesread) ==
+		    -1)
+			return (NULL);
+		if (tok.id == AUT_ZONENAME)
+			return (tok.tt.zonename.zonename);
+	}
+	return (NULL);
+}
+
+static u_int64_t
+agg_zoneindex(const char *zone)
+{
+	u_int64_t i;
+
+	for (i = 0; i < agg_nzones; i++)
+		if (strcmp(agg_zones[i], zone) == 0)
+			return (i);
+	agg_zones = realloc(agg_zones, (agg_nzones + 1) * sizeof(*agg_zones));
+	if (agg_zones == NULL || (agg_zones[i] = strdup(zone)) == NULL)
+		err(EXIT_FAILURE, "malloc");
+	return (agg_nzones++);
+}
+
+/*
+ * Return the value of field in a record, AGG_NONE if it has none.  Zones
+ * are returned by index, and paths hashed.
+ */
+static u_int64_t
+agg_value(int field, const au_rec_summary_t *ars, const char *zone)
+{
+	struct au_event_ent e;
+	char name[AU_EVENT_NAME_MAX], desc[AU_EVENT_DESC_MAX];
+	int ids;
+
+	ids = ars->ars_flags & (AU_RECSUM_SUBJECT | AU_RECSUM_PROCESS);
+	switch (field) {
+	case AF_EVENT:
+		if (!(ars->ars_flags & AU_RECSUM_HEADER))
+			return (AGG_NONE);
+		return (ars->ars_event);
+	case AF_CLASS:
+		if (!(ars->ars_flags & AU_RECSUM_HEADER))
+			return (AGG_NONE);
+		e.ae_name = name;
+		e.ae_desc = desc;
+		if (getauevnum_r(&e, ars->ars_event) == NULL)
+			return (AGG_NONE);
+		return (e.ae_class);
+	case AF_AUID:
+		return (ids ? ars->ars_auid : AGG_NONE);
+	case AF_EUID:
+		return (ids ? ars->ars_euid : AGG_NONE);
+	case AF_EGID:
+		return (ids ? ars->ars_egid : AGG_NONE);
+	case AF_RUID:
+		return (ids ? ars->ars_ruid : AGG_NONE);
+	case AF_RGID:
+		return (ids ? ars->ars_rgid : AGG_NONE);
+	case AF_PID:
+		return (ids ? (u_int32_t)ars->ars_pid : AGG_NONE);
+	case AF_RETURN:
+		if (!(ars->ars_flags & AU_RECSUM_RETURN))
+			return (AGG_NONE);
+		return (ars->ars_status);
+	case AF_ZONE:
+		return (zone != NULL ? agg_zoneindex(zone) : AGG_NONE);
+	case AF_PATH:
+		if (!(ars->ars_flags & AU_RECSUM_PATH))
+			return (AGG_NONE);
+		return (agg_hashstr(ars->ars_path, ars->ars_pathlen));
+	default:
+		if (!(ars->ars_flags & AU_RECSUM_HEADER))
+			return (AGG_NONE);
+		return (agg_bucket(field, ars->ars_sec));
+	}
+}
+
+static void
+agg_grow(void)
+{
+	struct agg_group **tab, *ag;
+	size_t i, j, size;
+
+	size = agg_size != 0 ? agg_size * 2 : 256;
+	if ((tab = calloc(size, sizeof(*tab))) == NULL)
+		err(EXIT_FAILURE, "malloc");
+	for (i = 0; i < agg_size; i++) {
+		if ((ag = agg_tab[i]) == NULL)
+			continue;
+		for (j = ag->ag_hash & (size - 1); tab[j] != NULL;
+		    j = (j + 1) & (size - 1))
+			continue;
+		tab[j] = ag;
+	}
+	free(agg_tab);
+	agg_tab = tab;
+	agg_size = size;
+}
+
+/*
+ * Count a selected record in its group.
+ */
+void
+agg_record(u_char *buf, int len)
+{
+	au_rec_summary_t ars;
+	struct agg_group *ag;
+	u_int64_t key[AGG_NFIELDS], h, v;
+	const char *zone;
+	size_t i;
+	int k, rank;
+
+	/* What could be read of an incomplete record is counted. */
+	(void) au_rec_summary(buf, len, &ars);
+	zone = agg_needzone ? agg_zone(buf, len) : NULL;
+
+	h = 0;
+	for (k = 0; k < agg_nkeys; k++) {
+		key[k] = agg_value(agg_keys[k]->af_field, &ars, zone);
+		h = agg_mix(h ^ key[k]);
+	}
+	if (agg_ngroups * 4 >= agg_size * 3)
+		agg_grow();
+	for (i = h & (agg_size - 1); (ag = agg_tab[i]) != NULL;
+	    i = (i + 1) & (agg_size - 1))
+		if (ag->ag_hash == h &&
+		    memcmp(ag->ag_key, key, agg_nkeys * sizeof(key[0])) == 0)
+			break;
+	if (ag == NULL) {
+		ag = calloc(1, sizeof(*ag) +
+		    (agg_dist != NULL ? AGG_HLLREGS : 0));
+		if (ag == NULL)
+			err(EXIT_FAILURE, "malloc");
+		ag->ag_hash = h;
+		memcpy(ag->ag_key, key, agg_nkeys * sizeof(key[0]));
+		if (agg_dist != NULL)
+			ag->ag_hll = (u_char *)(ag + 1);
+		agg_tab[i] = ag;
+		agg_ngroups++;
+	}
+	ag->ag_count++;
+
+	if (agg_dist == NULL ||
+	    (v = agg_value(agg_dist->af_field, &ars, zone)) == AGG_NONE)
+		return;
+	if (agg_dist->af_field == AF_ZONE)
+		v = agg_hashstr(zone, strlen(zone));
+	else if (agg_dist->af_field != AF_PATH)
+		v = agg_mix(v);
+
+	/*
+	 * The first bits of the hash pick a register, which keeps the
+	 * largest position of the first set bit among the others.
+	 */
+	i = v >> (64 - AGG_HLLBITS);
+	v <<= AGG_HLLBITS;
+	for (rank = 1; rank <= 64 - AGG_HLLBITS && !(v & (1ULL << 63));
+	    rank++)
+		v <<= 1;
+	if (ag->ag_hll[i] < rank)
+		ag->ag_hll[i] = rank;
+}
+
+static u_int64_t
+agg_estimate(const u_char *hll)
+{
+	double e, sum;
+	int i, zeros;
+
+	sum = 0;
+	zeros = 0;
+	for (i = 0; i < AGG_HLLREGS; i++) {
+		sum += 1.0 / ((u_int64_t)1 << hll[i]);
+		if (hll[i] == 0)
+			zeros++;
+	}
+	e = 0.7213 / (1 + 1.079 / AGG_HLLREGS) * AGG_HLLREGS * AGG_HLLREGS /
+	    sum;
+
+	/* Small counts are better estimated from the registers left. */
+	if (e <= 2.5 * AGG_HLLREGS && zeros != 0)
+		e = AGG_HLLREGS * log((double)AGG_HLLREGS / zeros);
+	return ((u_int64_t)(e + 0.5));
+}
+
+static int
+agg_cmp(const void *a, const void *b)
+{
+	const struct agg_group *ga = *(struct agg_group * const *)a;
+	const struct agg_group *gb = *(struct agg_group * const *)b;
+	u_int64_t ka, kb;
+	int k, r;
+
+	for (k = 0; k < agg_nkeys; k++) {
+		ka = ga->ag_key[k];
+		kb = gb->ag_key[k];
+		if (ka == kb)
+			continue;
+		if (agg_keys[k]->af_field == AF_ZONE && ka != AGG_NONE &&
+		    kb != AGG_NONE) {
+			if ((r = strcmp(agg_zones[ka], agg_zones[kb])) != 0)
+				return (r);
+			continue;
+		}
+		return (ka < kb ? -1 : 1);
+	}
+	return (0);
+}
+
+static void
+agg_printkey(int field, u_int64_t v)
+{
+	struct au_event_ent e;
+	char name[AU_EVENT_NAME_MAX], desc[AU_EVENT_DESC_MAX];
+	char buf[sizeof("YYYYMMDDHHMM")];
+	struct tm tm;
+	time_t t;
+
+	if (v == AGG_NONE) {
+		printf("-");
+		return;
+	}
+	switch (field) {
+	case AF_EVENT:
+		e.ae_name = name;
+		e.ae_desc = desc;
+		if (getauevnum_r(&e, v) != NULL)
+			printf("%s", e.ae_name);
+		else
+			printf("%ju", (uintmax_t)v);
+		break;
+	case AF_CLASS:
+		printf("0x%08jx", (uintmax_t)v);
+		break;
+	case AF_AUID:
+	case AF_EUID:
+	case AF_EGID:
+	case AF_RUID:
+	case AF_RGID:
+		printf("%d", (int)v);
+		break;
+	case AF_RETURN:
+		if (v == 0)
+			printf("success");
+		else
+			printf("%ju", (uintmax_t)v);
+		break;
+	case AF_ZONE:
+		printf("%s", agg_zones[v]);
+		break;
+	case AF_MINUTE:
+	case AF_HOUR:
+	case AF_DAY:
+		t = v;
+		localtime_r(&t, &tm);
+		strftime(buf, sizeof(buf), field == AF_MINUTE ? "%Y%m%d%H%M" :
+		    field == AF_HOUR ? "%Y%m%d%H" : "%Y%m%d", &tm);
+		printf("%s", buf);
+		break;
+	default:
+		printf("%ju", (uintmax_t)v);
+		break;
+	}
+}
+
+/*
+ * Print a line for each group, in the order of its keys, with the fields
+ * separated by tabs, after a line naming them.
+ */
+void
+agg_print(void)
+{
+	struct agg_group **groups;
+	size_t i, n;
+	int k;
+
+	for (k = 0; k < agg_nkeys; k++)
+		printf("%s\t", agg_keys[k]->af_name);
+	printf("count");
+	if (agg_dist != NULL)
+		printf("\tdistinct_%s", agg_dist->af_name);
+	printf("\n");
+
+	if ((groups = calloc(agg_ngroups + 1, sizeof(*groups))) == NULL)
+		err(EXIT_FAILURE, "malloc");
+	for (i = n = 0; i < agg_size; i++)
+		if (agg_tab[i] != NULL)
+			groups[n++] = agg_tab[i];
+	qsort(groups, n, sizeof(*groups), agg_cmp);
+	for (i = 0; i < n; i++) {
+		for (k = 0; k < agg_nkeys; k++) {
+			agg_printkey(agg_keys[k]->af_field,
+			    groups[i]->ag_key[k]);
+			printf("\t");
+		}
+		printf("%ju", (uintmax_t)groups[i]->ag_count);
+		if (agg_dist != NULL)
+			printf("\t%ju",
+			    (uintmax_t)agg_estimate(groups[i]->ag_hll));
+		printf("\n");
+	}
+	free(groups);
+}
@@ -38,7 +38,7 @@
  */
 
 /*
- * XXX Currently we do not support merging of records from multiple
+ * XXX Unless -M is given, we do not merge records from multiple
  * XXX audit trail files
  * XXX We assume that records are sorted chronologically - both wrt to 
  * XXX the records present within the file and between the files themselves
@@ -56,14 +56,25 @@
 
 #ifdef HAVE_CAP_ENTER
 #include <sys/capsicum.h>
-#include <sys/wait.h>
 #endif
+#include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
 
 #include <bsm/libbsm.h>
 
+#include <ctype.h>
+#include <dirent.h>
 #include <err.h>
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <grp.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -80,9 +91,6 @@
 
 #include "auditreduce.h"
 
-static TAILQ_HEAD(tailhead, re_entry) re_head =
-    TAILQ_HEAD_INITIALIZER(re_head);
-
 extern char		*optarg;
 extern int		 optind, optopt, opterr,optreset;
 
@@ -113,13 +121,68 @@ static char	*p_pidobj = NULL;
 static char	*p_semobj = NULL;
 static char	*p_shmobj = NULL;
 static char	*p_sockobj = NULL; 
+static char	*p_portobj = NULL;
+static struct net_trie	*p_netobj = NULL;	/* Of -o ip and -o net. */
 
 static uint32_t opttochk = 0;
 
-static int	select_zone(const char *zone, uint32_t *optchkd);
+/* Program selecting the records, from the options and filter (-F). */
+static struct sel_prog	prog;
+
+/*
+ * Records after w_hi, or trails ending before w_lo, cannot be selected when
+ * the corresponding flag is set.
+ */
+static int	w_haslo, w_hashi;
+static time_t	w_lo, w_hi;
+
+static int	merge;		/* Merge files in record time order (-M). */
+static int	p_workers;	/* Files selected from at once (-P). */
+static int	unordered;	/* Print files as they finish (-U). */
+static int	aggregate;	/* Print aggregates, not records (-G, -D). */
+static int	summarize;	/* Only update trail summaries (-S). */
+
+/*
+ * With -P, each file is selected from by a child process, which writes the
+ * selected records to a pipe.  The output of one job at a time is copied
+ * to the standard output as it arrives; that of the others is kept in a
+ * temporary file until their turn comes, so that no child waits for the
+ * parent.  Turns go to the files in the order they were given or, with -U,
+ * preferably to those already finished.
+ */
+struct job {
+	const char	*j_fname;
+	pid_t		 j_pid;		/* Zero once reaped. */
+	int		 j_fd;		/* Pipe from child, -1 at EOF. */
+	FILE		*j_spill;	/* Output awaiting its turn. */
+};
+
+/*
+ * Records of a regular file are selected in place from a mapping of it, and
+ * runs of consecutive selected records are written out whole: gathered into
+ * batches with writev(), or, when long, copied by the kernel from the file
+ * to the standard output if it is a file or a pipe.
+ */
+#ifdef IOV_MAX
+#define	OUT_IOVMAX	(IOV_MAX < 256 ? IOV_MAX : 256)
+#else
+#define	OUT_IOVMAX	16
+#endif
+#define	OUT_BATCH	(256 * 1024)	/* Bytes gathered before writing. */
+#define	OUT_RUNMIN	(64 * 1024)	/* Shortest run copied by the kernel. */
+
+#define	OUT_UNKNOWN	0
+#define	OUT_WRITE	1		/* Standard output is written to. */
+#define	OUT_COPY	2		/* ... copy_file_range() to it. */
+#define	OUT_SPLICE	3		/* ... splice() to it. */
+
+static struct iovec	out_iov[OUT_IOVMAX];
+static int		out_niov;
+static size_t		out_len;
+static int		out_kind = OUT_UNKNOWN;
 
 static void
-parse_regexp(char *re_string)
+parse_regexp(struct re_list *head, char *re_string)
 {
 	char *orig, *copy, re_error[64];
 	struct re_entry *rep;
@@ -138,7 +201,6 @@ parse_regexp(char *re_string)
 			}
 		}
 	}
-	TAILQ_INIT(&re_head);
 	for (i = 0; i < nstrs + 1; i++) {
 		rep = calloc(1, sizeof(*rep));
 		if (rep == NULL) {
@@ -158,7 +220,8 @@ parse_regexp(char *re_string)
 			(void) fprintf(stderr, "regcomp: %s\n", re_error);
 			exit(1);
 		}
-		TAILQ_INSERT_TAIL(&re_head, rep, re_glue);
+		selprog_literal(rep);
+		TAILQ_INSERT_TAIL(head, rep, re_glue);
 		len = strlen(copy);
 		copy += len + 1;
 	}
@@ -175,19 +238,29 @@ usage(const char *msg)
 	fprintf(stderr, "\t-a YYYYMMDD[HH[[MM[SS]]] : after date\n");
 	fprintf(stderr, "\t-b YYYYMMDD[HH[[MM[SS]]] : before date\n");
 	fprintf(stderr, "\t-c <flags> : matching class\n");
+	fprintf(stderr, "\t-D <field> : count distinct values of field\n");
 	fprintf(stderr, "\t-d YYYYMMDD : on date\n");
 	fprintf(stderr, "\t-e <uid|name>  : effective user\n");
+	fprintf(stderr, "\t-F <expression> : matching filter expression\n");
 	fprintf(stderr, "\t-f <gid|group> : effective group\n");
+	fprintf(stderr, "\t-G <field,...> : count records grouped by fields\n");
 	fprintf(stderr, "\t-g <gid|group> : real group\n");
 	fprintf(stderr, "\t-j <pid> : subject id \n");
+	fprintf(stderr, "\t-M : merge files in time order\n");
 	fprintf(stderr, "\t-m <evno|evname> : matching event\n");
 	fprintf(stderr, "\t-o objecttype=objectvalue\n");
 	fprintf(stderr, "\t\t file=<pathname>\n");
+	fprintf(stderr, "\t\t ip=<address[/len],...>\n");
 	fprintf(stderr, "\t\t msgqid=<ID>\n");
+	fprintf(stderr, "\t\t net=@<file>\n");
 	fprintf(stderr, "\t\t pid=<ID>\n");
+	fprintf(stderr, "\t\t port=<port|service,...>\n");
 	fprintf(stderr, "\t\t semid=<ID>\n");
 	fprintf(stderr, "\t\t shmid=<ID>\n");
+	fprintf(stderr, "\t-P <n> : select from n files at once\n");
 	fprintf(stderr, "\t-r <uid|name> : real user\n");
+	fprintf(stderr, "\t-S : update trail summaries\n");
+	fprintf(stderr, "\t-U : with -P, print files as they finish\n");
 	fprintf(stderr, "\t-u <uid|name> : audit user\n");
 	fprintf(stderr, "\t-v : select non-matching records\n");
 	fprintf(stderr, "\t-z <zone> : zone name\n");
@@ -195,407 +268,380 @@ usage(const char *msg)
 }
 
 /*
- * Check if the given auid matches the selection criteria.
+ * Return the time of the header of a record, or -1 if it has none.
  */
-static int
-select_auid(int au)
+static int64_t
+record_time(u_char *buf, int len)
 {
+	tokenstr_t tok;
 
-	/* Check if we want to select on auid. */
-	if (ISOPTSET(opttochk, OPT_u)) {
-		if (au != p_auid)
-			return (0);
+	if (au_fetch_tok(&tok, buf, len) == -1)
+		return (-1);
+	switch (tok.id) {
+	case AUT_HEADER32:
+		return (tok.tt.hdr32.s);
+	case AUT_HEADER32_EX:
+		return (tok.tt.hdr32_ex.s);
+	case AUT_HEADER64:
+		return (tok.tt.hdr64.s);
+	case AUT_HEADER64_EX:
+		return (tok.tt.hdr64_ex.s);
 	}
-	return (1);
+	return (-1);
 }
 
 /*
- * Check if the given euid matches the selection criteria.
+ * Convert a YYYYMMDDhhmmss time stamp of a trail name, in UTC.
  */
 static int
-select_euid(int euser)
+parse_stamp(const char *s, time_t *t)
 {
+	struct tm tm;
+	int i;
 
-	/* Check if we want to select on euid. */
-	if (ISOPTSET(opttochk, OPT_e)) {
-		if (euser != p_euid)
-			return (0);
-	}
-	return (1);
+	for (i = 0; i < 14; i++)
+		if (!isdigit((u_char)s[i]))
+			return (-1);
+	bzero(&tm, sizeof(tm));
+	if (sscanf(s, "%4d%2d%2d%2d%2d%2d", &tm.tm_year, &tm.tm_mon,
+	    &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+		return (-1);
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	*t = timegm(&tm);
+	return (0);
 }
 
 /*
- * Check if the given egid matches the selection criteria.
+ * Return whether a file may hold records within the time window.  Trails
+ * are named after the times they were started and terminated, START.END;
+ * one still open, or of another name, always may.
  */
 static int
-select_egid(int egrp)
+file_in_window(const char *fname)
 {
+	const char *name;
+	time_t end, start;
 
-	/* Check if we want to select on egid. */
-	if (ISOPTSET(opttochk, OPT_f)) {
-		if (egrp != p_egid)
-			return (0);
-	}
+	if ((name = strrchr(fname, '/')) != NULL)
+		name++;
+	else
+		name = fname;
+	if (parse_stamp(name, &start) != 0 || name[14] != '.')
+		return (1);
+	if (w_hashi && start > w_hi)
+		return (0);
+	if (w_haslo && parse_stamp(name + 15, &end) == 0 &&
+	    name[29] == '\0' && end < w_lo)
+		return (0);
 	return (1);
 }
 
-/*
- * Check if the given rgid matches the selection criteria.
- */
 static int
-select_rgid(int grp)
+namecmp(const void *a, const void *b)
 {
 
-	/* Check if we want to select on rgid. */
-	if (ISOPTSET(opttochk, OPT_g)) {
-		if (grp != p_rgid)
-			return (0);
-	}
-	return (1);
+	return (strcmp(*(char * const *)a, *(char * const *)b));
 }
 
 /*
- * Check if the given ruid matches the selection criteria.
+ * Add a file to the list of those to read, if it may hold records within
+ * the time window.
  */
-static int
-select_ruid(int user)
-{
-
-	/* Check if we want to select on rgid. */
-	if (ISOPTSET(opttochk, OPT_r)) {
-		if (user != p_ruid)
-			return (0);
-	}
-	return (1);
-}
-
-/*
- * Check if the given subject id (pid) matches the selection criteria.
- */
-static int
-select_subid(int subid)
-{
-
-	/* Check if we want to select on subject uid. */
-	if (ISOPTSET(opttochk, OPT_j)) {
-		if (subid != p_subid)
-			return (0);
-	}
-	return (1);
-}
-
-
-/*
- * Check if object's pid maches the given pid.
- */ 
-static int
-select_pidobj(uint32_t pid) 
+static void
+add_file(char ***files, int *nfiles, const char *fname)
 {
 
-	if (ISOPTSET(opttochk, OPT_op)) {
-		if (pid != (uint32_t)strtol(p_pidobj, (char **)NULL, 10))
-			return (0);
-	} 
-	return (1);
+	if (!file_in_window(fname))
+		return;
+	*files = realloc(*files, (*nfiles + 1) * sizeof(**files));
+	if (*files == NULL)
+		err(EXIT_FAILURE, "realloc");
+	if (((*files)[(*nfiles)++] = strdup(fname)) == NULL)
+		err(EXIT_FAILURE, "strdup");
 }
 
 /*
- * Check if the given ipc object with the given type matches the selection
- * criteria.
+ * Replace each directory argument with the trails it holds, in the order
+ * of their names and so of time, and leave out trails entirely outside of
+ * the time window.
  */
-static int
-select_ipcobj(u_char type, uint32_t id, uint32_t *optchkd)
+static char **
+expand_files(char **argv, int argc, int *nfiles)
 {
-
-	if (type == AT_IPC_MSG) {
-		SETOPT((*optchkd), OPT_om);
-		if (ISOPTSET(opttochk, OPT_om)) {
-			if (id != (uint32_t)strtol(p_msgqobj, (char **)NULL,
-			    10))
-				return (0);
+	char path[MAXPATHLEN];
+	struct dirent *dp;
+	struct stat sb;
+	char **files, **names;
+	time_t start;
+	DIR *dirp;
+	int i, j, n;
+
+	files = NULL;
+	*nfiles = 0;
+	for (i = 0; i < argc; i++) {
+		if (stat(argv[i], &sb) != 0 || !S_ISDIR(sb.st_mode)) {
+			add_file(&files, nfiles, argv[i]);
+			continue;
 		}
-		return (1);
-	} else if (type == AT_IPC_SEM) {
-		SETOPT((*optchkd), OPT_ose);
-		if (ISOPTSET(opttochk, OPT_ose)) {
-			if (id != (uint32_t)strtol(p_semobj, (char **)NULL, 10))
-				return (0);
+		if ((dirp = opendir(argv[i])) == NULL)
+			err(EXIT_FAILURE, "%s", argv[i]);
+		names = NULL;
+		n = 0;
+		while ((dp = readdir(dirp)) != NULL) {
+			if (parse_stamp(dp->d_name, &start) != 0 ||
+			    dp->d_name[14] != '.')
+				continue;
+			names = realloc(names, (n + 1) * sizeof(*names));
+			if (names == NULL)
+				err(EXIT_FAILURE, "realloc");
+			if ((names[n++] = strdup(dp->d_name)) == NULL)
+				err(EXIT_FAILURE, "strdup");
 		}
-		return (1);
-	} else if (type == AT_IPC_SHM) {
-		SETOPT((*optchkd), OPT_osh);
-		if (ISOPTSET(opttochk, OPT_osh)) {
-			if (id != (uint32_t)strtol(p_shmobj, (char **)NULL, 10))
-				return (0);
+		closedir(dirp);
+		qsort(names, n, sizeof(*names), namecmp);
+		for (j = 0; j < n; j++) {
+			snprintf(path, sizeof(path), "%s/%s", argv[i],
+			    names[j]);
+			add_file(&files, nfiles, path);
+			free(names[j]);
 		}
-		return (1);
+		free(names);
 	}
-
-	/* Unknown type -- filter if *any* ipc filtering is required. */
-	if (ISOPTSET(opttochk, OPT_om) || ISOPTSET(opttochk, OPT_ose)
-	    || ISOPTSET(opttochk, OPT_osh))
-		return (0);
-
-	return (1);
+	return (files);
 }
 
-
 /*
- * Check if the file name matches selection criteria.
+ * Read each record from the audit trail, or from the trail set if one is
+ * given.  Check if it is selected after passing through each of the options 
  */
 static int
-select_filepath(char *path, uint32_t *optchkd)
+select_records(FILE *fp, au_trailset_t *ts)
 {
-	struct re_entry *rep;
-	int match;
+	u_char *buf;
+	int reclen;
+	int print;
 
-	SETOPT((*optchkd), OPT_of);
-	match = 1;
-	if (ISOPTSET(opttochk, OPT_of)) {
-		match = 0;
-		TAILQ_FOREACH(rep, &re_head, re_glue) {
-			if (regexec(&rep->re_regexp, path, 0, NULL,
-			    0) != REG_NOMATCH)
-				return (!rep->re_negate);
+	while ((reclen = (ts != NULL ? au_trailset_read(ts, &buf) :
+	    au_read_rec(fp, &buf))) != -1) {
+		/* Records are in time order, so none after this is selected. */
+		if (w_hashi && record_time(buf, reclen) > w_hi) {
+			free(buf);
+			return (0);
 		}
+
+		/* An incomplete record is not selected. */
+		print = (selprog_run(&prog, buf, reclen) == 1);
+		if (ISOPTSET(opttochk, OPT_v))
+			print = !print;
+		if (print && aggregate)
+			agg_record(buf, reclen);
+		else if (print)
+			(void) fwrite(buf, 1, reclen, stdout);
+		free(buf);
 	}
-	return (match);
+
+	/* A trail set reports trails it could not read to the end. */
+	if (ts != NULL && errno != 0)
+		return (-1);
+	return (0);
 }
 
 /*
- * Returns 1 if the following pass the selection rules:
- *
- * before-time, 
- * after time, 
- * date, 
- * class, 
- * event 
+ * Return the length of the record at buf, as au_read_rec(3) reads it, or 0
+ * if there is no complete record in the len bytes there.
  */
-static int
-select_hdr32(tokenstr_t tok, uint32_t *optchkd)
+size_t
+record_length(const u_char *buf, size_t len)
 {
-	uint16_t *ev;
-	int match;
-
-	SETOPT((*optchkd), (OPT_A | OPT_a | OPT_b | OPT_c | OPT_m | OPT_v));
-
-	/* The A option overrides a, b and d. */
-	if (!ISOPTSET(opttochk, OPT_A)) {
-		if (ISOPTSET(opttochk, OPT_a)) {
-			if (difftime((time_t)tok.tt.hdr32.s, p_atime) < 0) {
-				/* Record was created before p_atime. */
-				return (0);
-			}
-		}
+	size_t reclen;
 
-		if (ISOPTSET(opttochk, OPT_b)) {
-			if (difftime(p_btime, (time_t)tok.tt.hdr32.s) < 0) {
-				/* Record was created after p_btime. */
-				return (0);
-			}
-		}
-	}
-
-	if (ISOPTSET(opttochk, OPT_c)) {
-		/*
-		 * Check if the classes represented by the event matches
-		 * given class.
-		 */
-		if (au_preselect(tok.tt.hdr32.e_type, &maskp, AU_PRS_BOTH,
-		    AU_PRS_USECACHE) != 1)
+	if (len == 0)
+		return (0);
+	switch (buf[0]) {
+	case AUT_HEADER32:
+	case AUT_HEADER32_EX:
+	case AUT_HEADER64:
+	case AUT_HEADER64_EX:
+		if (len < 5)
 			return (0);
-	}
-
-	/* Check if event matches. */
-	if (ISOPTSET(opttochk, OPT_m)) {
-		match = 0;
-		for (ev = p_evec; ev < &p_evec[p_evec_used]; ev++)
-			if (tok.tt.hdr32.e_type == *ev)
-				match = 1;
-		if (match == 0)
+		reclen = (size_t)buf[1] << 24 | (size_t)buf[2] << 16 |
+		    (size_t)buf[3] << 8 | buf[4];
+		if (reclen < 5)
 			return (0);
-	}
-		
-	return (1);
-}
+		break;
 
-static int
-select_return32(tokenstr_t tok_ret32, tokenstr_t tok_hdr32, uint32_t *optchkd)
-{
-	int sorf;
-
-	SETOPT((*optchkd), (OPT_c));
-	if (tok_ret32.tt.ret32.status == 0)
-		sorf = AU_PRS_SUCCESS;
-	else
-		sorf = AU_PRS_FAILURE;
-	if (ISOPTSET(opttochk, OPT_c)) {
-		if (au_preselect(tok_hdr32.tt.hdr32.e_type, &maskp, sorf,
-		    AU_PRS_USECACHE) != 1)
+	case AUT_OTHER_FILE32:
+		if (len < 11)
 			return (0);
+		reclen = 11 + ((size_t)buf[9] << 8 | buf[10]);
+		break;
+
+	default:
+		return (0);
 	}
-	return (1);
+	return (reclen <= len ? reclen : 0);
 }
 
 /*
- * Return 1 if checks for the the following succeed
- * auid, 
- * euid, 
- * egid, 
- * rgid, 
- * ruid, 
- * process id
+ * Write out the runs gathered so far.
  */
-static int
-select_proc32(tokenstr_t tok, uint32_t *optchkd)
+static void
+out_flush(void)
 {
-
-	SETOPT((*optchkd), (OPT_u | OPT_e | OPT_f | OPT_g | OPT_r | OPT_op));
-
-	if (!select_auid(tok.tt.proc32.auid))
-		return (0);
-	if (!select_euid(tok.tt.proc32.euid))
-		return (0);
-	if (!select_egid(tok.tt.proc32.egid))
-		return (0);
-	if (!select_rgid(tok.tt.proc32.rgid))
-		return (0);
-	if (!select_ruid(tok.tt.proc32.ruid))
-		return (0);
-	if (!select_pidobj(tok.tt.proc32.pid))
-		return (0);
-	return (1);
+	struct iovec *iov;
+	ssize_t n;
+	int niov;
+
+	iov = out_iov;
+	niov = out_niov;
+	while (niov > 0) {
+		n = writev(STDOUT_FILENO, iov, niov);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "stdout");
+		}
+		for (; niov > 0 && (size_t)n >= iov->iov_len; iov++, niov--)
+			n -= iov->iov_len;
+		if (niov > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	out_niov = 0;
+	out_len = 0;
 }
 
 /*
- * Return 1 if checks for the the following succeed
- * auid, 
- * euid, 
- * egid, 
- * rgid, 
- * ruid, 
- * subject id
+ * Have the kernel copy len bytes at off in fd to the standard output, and
+ * return how many it did.  Once it cannot, runs are only written.
  */
-static int
-select_subj32(tokenstr_t tok, uint32_t *optchkd)
+static size_t
+out_copy(int fd, off_t off, size_t len)
 {
-
-	SETOPT((*optchkd), (OPT_u | OPT_e | OPT_f | OPT_g | OPT_r | OPT_j));
-
-	if (!select_auid(tok.tt.subj32.auid))
-		return (0);
-	if (!select_euid(tok.tt.subj32.euid))
-		return (0);
-	if (!select_egid(tok.tt.subj32.egid))
-		return (0);
-	if (!select_rgid(tok.tt.subj32.rgid))
-		return (0);
-	if (!select_ruid(tok.tt.subj32.ruid))
-		return (0);
-	if (!select_subid(tok.tt.subj32.pid))
-		return (0);
-	return (1);
+	struct stat sb;
+	size_t done;
+	ssize_t n;
+
+	if (out_kind == OUT_UNKNOWN) {
+		out_kind = OUT_WRITE;
+		if (fstat(STDOUT_FILENO, &sb) == 0) {
+#ifdef HAVE_COPY_FILE_RANGE
+			if (S_ISREG(sb.st_mode))
+				out_kind = OUT_COPY;
+#endif
+#ifdef HAVE_SPLICE
+			if (S_ISFIFO(sb.st_mode))
+				out_kind = OUT_SPLICE;
+#endif
+		}
+	}
+	for (done = 0; done < len; done += n) {
+		switch (out_kind) {
+#ifdef HAVE_COPY_FILE_RANGE
+		case OUT_COPY:
+			n = copy_file_range(fd, &off, STDOUT_FILENO, NULL,
+			    len - done, 0);
+			break;
+#endif
+#ifdef HAVE_SPLICE
+		case OUT_SPLICE:
+			n = splice(fd, &off, STDOUT_FILENO, NULL, len - done,
+			    SPLICE_F_MORE);
+			break;
+#endif
+		default:
+			return (done);
+		}
+		if (n == -1 && errno == EINTR)
+			n = 0;
+		else if (n <= 0) {
+			/* Not between these files; errors recur on write. */
+			out_kind = OUT_WRITE;
+			break;
+		}
+	}
+	return (done);
 }
 
 /*
- * Check if the given zone matches the selection criteria.
-  */
-static int
-select_zone(const char *zone, uint32_t *optchkd)
+ * Output the run of selected records from start to end in the mapping of
+ * fd at base.
+ */
+static void
+out_run(int fd, u_char *base, u_char *start, u_char *end)
 {
-
-	SETOPT((*optchkd), OPT_z);
-	if (ISOPTSET(opttochk, OPT_z) && p_zone != NULL) {
-		if (fnmatch(p_zone, zone, FNM_PATHNAME) != 0)
-			return (0);
+	size_t len, n;
+
+	len = end - start;
+	if (len >= OUT_RUNMIN && out_kind != OUT_WRITE) {
+		out_flush();
+		n = out_copy(fd, start - base, len);
+		start += n;
+		len -= n;
+		if (len == 0)
+			return;
 	}
-	return (1);
+	if (out_niov == OUT_IOVMAX)
+		out_flush();
+	out_iov[out_niov].iov_base = start;
+	out_iov[out_niov].iov_len = len;
+	out_niov++;
+	out_len += len;
+	if (out_len >= OUT_BATCH)
+		out_flush();
 }
 
 /*
- * Read each record from the audit trail.  Check if it is selected after
- * passing through each of the options 
+ * Select records from a trail file as select_records() does, but in place
+ * from a mapping of it when it is a regular file.
  */
 static int
-select_records(FILE *fp)
+select_file(FILE *fp)
 {
-	tokenstr_t tok_hdr32_copy;
-	u_char *buf;
-	tokenstr_t tok;
-	int reclen;
-	int bytesread;
-	int selected;
-	uint32_t optchkd;
-	int print;
-
-	int err = 0;
-	while ((reclen = au_read_rec(fp, &buf)) != -1) {
-		optchkd = 0;
-		bytesread = 0;
-		selected = 1;
-		while ((selected == 1) && (bytesread < reclen)) {
-			if (-1 == au_fetch_tok(&tok, buf + bytesread,
-			    reclen - bytesread)) {
-				/* Is this an incomplete record? */
-				err = 1;
-				break;
-			}
-
-			/*
-			 * For each token type we have have different
-			 * selection criteria.
-			 */
-			switch(tok.id) {
-			case AUT_HEADER32:
-					selected = select_hdr32(tok,
-					    &optchkd);
-					bcopy(&tok, &tok_hdr32_copy,
-					    sizeof(tok));
-					break;
-
-			case AUT_PROCESS32:
-					selected = select_proc32(tok,
-					    &optchkd);
-					break;
-
-			case AUT_SUBJECT32:
-					selected = select_subj32(tok,
-					    &optchkd);
-					break;
-
-			case AUT_IPC:
-					selected = select_ipcobj(
-					    tok.tt.ipc.type, tok.tt.ipc.id,
-					    &optchkd); 
-					break;
-
-			case AUT_PATH:
-					selected = select_filepath(
-					    tok.tt.path.path, &optchkd);
-					break;	
-
-			case AUT_RETURN32:
-				selected = select_return32(tok,
-				    tok_hdr32_copy, &optchkd);
-				break;
-
-			case AUT_ZONENAME:
-				selected = select_zone(tok.tt.zonename.zonename, &optchkd);
-				break;
+	struct stat sb;
+	u_char *base, *end, *p, *run;
+	size_t reclen;
+	int fd, print;
+
+	fd = fileno(fp);
+	if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0 ||
+	    (uintmax_t)sb.st_size > SIZE_MAX)
+		return (select_records(fp, NULL));
+	base = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+		return (select_records(fp, NULL));
+	(void) posix_madvise(base, sb.st_size, POSIX_MADV_SEQUENTIAL);
+
+	/* Whatever stdio holds was selected before. */
+	if (fflush(stdout) != 0)
+		err(EXIT_FAILURE, "stdout");
+	end = base + sb.st_size;
+	run = NULL;
+	for (p = base; (reclen = record_length(p, end - p)) != 0;
+	    p += reclen) {
+		/* Records are in time order, so none after this is selected. */
+		if (w_hashi && record_time(p, reclen) > w_hi)
+			break;
 
-			default:
-				break;
-			}
-			bytesread += tok.len;
-		}
-		/* Check if all the options were matched. */
-		print = ((selected == 1) && (!err) && (!(opttochk & ~optchkd)));
+		print = (selprog_run(&prog, p, reclen) == 1);
 		if (ISOPTSET(opttochk, OPT_v))
 			print = !print;
-		if (print)
-			(void) fwrite(buf, 1, reclen, stdout);
-		free(buf);
+		if (print && aggregate)
+			agg_record(p, reclen);
+		else if (print) {
+			if (run == NULL)
+				run = p;
+		} else if (run != NULL) {
+			out_run(fd, base, run, p);
+			run = NULL;
+		}
 	}
+	if (run != NULL)
+		out_run(fd, base, run, p);
+	out_flush();
+	munmap(base, sb.st_size);
 	return (0);
 }
 
@@ -606,12 +652,13 @@ select_records(FILE *fp)
 static void
 parse_object_type(char *name, char *val)
 {
+	const char *errstr;
+
 	if (val == NULL)
 		return;
 
 	if (!strcmp(name, FILEOBJ)) {
 		p_fileobj = val;
-		parse_regexp(val);
 		SETOPT(opttochk, OPT_of);
 	} else if (!strcmp(name, MSGQIDOBJ)) {
 		p_msgqobj = val;
@@ -628,10 +675,391 @@ parse_object_type(char *name, char *val)
 	} else if (!strcmp(name, SOCKOBJ)) {
 		p_sockobj = val;
 		SETOPT(opttochk, OPT_oso);
+	} else if (!strcmp(name, IPOBJ) || !strcmp(name, NETOBJ)) {
+		/* Each use adds to the networks selected. */
+		if (p_netobj == NULL)
+			p_netobj = nettrie_alloc();
+		if (nettrie_addlist(p_netobj, val, &errstr) != 0)
+			errx(EXIT_FAILURE, "-o %s=%s: %s", name, val, errstr);
+		SETOPT(opttochk, OPT_on);
+	} else if (!strcmp(name, PORTOBJ)) {
+		p_portobj = val;
+		SETOPT(opttochk, OPT_opo);
 	} else
 		usage("unknown value for -o");
 }
 
+/*
+ * Translate the selection options into tests of the program, followed by
+ * the filter expression if any.  A test holds of a record if every token of
+ * the types it examines passes, and all but the test of IPC object types
+ * also require one such token to be present.
+ */
+static void
+compile_options(struct sel_node *filter)
+{
+	static const u_char hdr[] = { SEL_HDR_TYPES };
+	static const u_char ret[] = { SEL_RET_TYPES };
+	static const u_char subj[] = { SEL_SUBJ_TYPES };
+	static const u_char proc[] = { SEL_PROC_TYPES };
+	static const u_char ids[] = { SEL_PROC_TYPES, SEL_SUBJ_TYPES };
+	static const u_char ipc[] = { AUT_IPC };
+	static const u_char path[] = { AUT_PATH };
+	static const u_char zone[] = { AUT_ZONENAME };
+	static const u_char ip[] = { SEL_IP_TYPES };
+	static const u_char port[] = { SEL_PORT_TYPES };
+	static const struct {
+		uint32_t	 opt;
+		int		 field;
+		const int	*id;
+		int		 kind;	/* Of the value in trail summaries. */
+	} idopts[] = {
+		{ OPT_u, SF_AUID, &p_auid, BK_AUID },
+		{ OPT_e, SF_EUID, &p_euid, BK_EUID },
+		{ OPT_f, SF_EGID, &p_egid, 0 },
+		{ OPT_g, SF_RGID, &p_rgid, 0 },
+		{ OPT_r, SF_RUID, &p_ruid, 0 },
+	};
+	static const struct {
+		uint32_t	  opt;
+		u_char		  type;
+		char *const	 *obj;
+	} ipcids[] = {
+		{ OPT_om, AT_IPC_MSG, &p_msgqobj },
+		{ OPT_ose, AT_IPC_SEM, &p_semobj },
+		{ OPT_osh, AT_IPC_SHM, &p_shmobj },
+	};
+	struct sel_node *sn;
+	struct servent *se;
+	uint32_t *evs, id;
+	uint16_t *ev;
+	char *last, *s, *end;
+	u_long n;
+	u_int i;
+
+	/* Alone, -v selects the records without a header token. */
+	if (ISOPTSET(opttochk, (OPT_A | OPT_a | OPT_b | OPT_c | OPT_m)) ||
+	    (ISOPTSET(opttochk, OPT_v) && filter == NULL))
+		selprog_and(&prog, selprog_test(SF_PRESENT, SO_EQ, SQ_ALL,
+		    hdr, SEL_NTYPES(hdr)));
+
+	/* The A option overrides a, b and d. */
+	if (!ISOPTSET(opttochk, OPT_A)) {
+		if (ISOPTSET(opttochk, OPT_a)) {
+			sn = selprog_test(SF_TIME, SO_GE, SQ_ALL, hdr,
+			    SEL_NTYPES(hdr));
+			selprog_value(sn->sn_test, p_atime);
+			selprog_and(&prog, sn);
+		}
+		if (ISOPTSET(opttochk, OPT_b)) {
+			sn = selprog_test(SF_TIME, SO_LE, SQ_ALL, hdr,
+			    SEL_NTYPES(hdr));
+			selprog_value(sn->sn_test, p_btime);
+			selprog_and(&prog, sn);
+		}
+	}
+
+	if (ISOPTSET(opttochk, OPT_m)) {
+		sn = selprog_test(SF_EVENT, SO_EQ, SQ_ALL, hdr,
+		    SEL_NTYPES(hdr));
+		if ((evs = calloc(p_evec_used, sizeof(*evs))) == NULL)
+			err(EXIT_FAILURE, "calloc");
+		for (ev = p_evec; ev < &p_evec[p_evec_used]; ev++) {
+			selprog_value(sn->sn_test, *ev);
+			evs[ev - p_evec] = *ev;
+		}
+		selprog_and(&prog, sn);
+		bloom_ids(BK_EVENT, evs, p_evec_used);
+		free(evs);
+	}
+
+	/*
+	 * The classes of the event are checked in the header, and those for
+	 * its outcome in any return token.
+	 */
+	if (ISOPTSET(opttochk, OPT_c)) {
+		sn = selprog_test(SF_CLASS, SO_EQ, SQ_ALL, hdr,
+		    SEL_NTYPES(hdr));
+		sn->sn_test->st_mask = maskp;
+		selprog_and(&prog, sn);
+		sn = selprog_test(SF_CLASSRET, SO_EQ, SQ_EACH, ret,
+		    SEL_NTYPES(ret));
+		sn->sn_test->st_mask = maskp;
+		selprog_and(&prog, sn);
+	}
+
+	for (i = 0; i < sizeof(idopts) / sizeof(idopts[0]); i++) {
+		if (!ISOPTSET(opttochk, idopts[i].opt))
+			continue;
+		sn = selprog_test(idopts[i].field, SO_EQ, SQ_ALL, ids,
+		    SEL_NTYPES(ids));
+		selprog_value(sn->sn_test, (uint32_t)*idopts[i].id);
+		selprog_and(&prog, sn);
+		if (idopts[i].kind != 0) {
+			id = *idopts[i].id;
+			bloom_ids(idopts[i].kind, &id, 1);
+		}
+	}
+	if (ISOPTSET(opttochk, OPT_j)) {
+		sn = selprog_test(SF_PID, SO_EQ, SQ_ALL, subj,
+		    SEL_NTYPES(subj));
+		selprog_value(sn->sn_test, (uint32_t)p_subid);
+		selprog_and(&prog, sn);
+	}
+	if (ISOPTSET(opttochk, OPT_op)) {
+		sn = selprog_test(SF_PID, SO_EQ, SQ_ALL, proc,
+		    SEL_NTYPES(proc));
+		selprog_value(sn->sn_test,
+		    (uint32_t)strtol(p_pidobj, (char **)NULL, 10));
+		selprog_and(&prog, sn);
+	}
+
+	if (ISOPTSET(opttochk, OPT_z)) {
+		sn = selprog_test(SF_ZONE, SO_EQ, SQ_ALL, zone,
+		    SEL_NTYPES(zone));
+		sn->sn_test->st_str = p_zone;
+		selprog_and(&prog, sn);
+	}
+
+	/* Each path has to be selected by the first expression it matches. */
+	if (ISOPTSET(opttochk, OPT_of)) {
+		sn = selprog_test(SF_PATH, SO_MATCH, SQ_ALL, path,
+		    SEL_NTYPES(path));
+		parse_regexp(&sn->sn_test->st_re, p_fileobj);
+		selprog_and(&prog, sn);
+		bloom_paths(&sn->sn_test->st_re);
+	}
+
+	/*
+	 * An IPC object of a type selected on has to have the given id, and
+	 * one of an unknown type is not selected at all.
+	 */
+	for (i = 0; i < sizeof(ipcids) / sizeof(ipcids[0]); i++) {
+		if (!ISOPTSET(opttochk, ipcids[i].opt))
+			continue;
+		sn = selprog_test(SF_IPCID, SO_EQ, SQ_ALL, ipc,
+		    SEL_NTYPES(ipc));
+		sn->sn_test->st_ipctype = ipcids[i].type;
+		selprog_value(sn->sn_test,
+		    (uint32_t)strtol(*ipcids[i].obj, (char **)NULL, 10));
+		selprog_and(&prog, sn);
+	}
+	if (ISOPTSET(opttochk, (OPT_om | OPT_ose | OPT_osh)))
+		selprog_and(&prog, selprog_test(SF_IPCKNOWN, SO_EQ, SQ_EACH,
+		    ipc, SEL_NTYPES(ipc)));
+
+	/*
+	 * A record is selected on its network addresses or ports if any
+	 * token carrying one matches.
+	 */
+	if (ISOPTSET(opttochk, OPT_on)) {
+		sn = selprog_test(SF_IP, SO_EQ, SQ_ANY, ip, SEL_NTYPES(ip));
+		sn->sn_test->st_net = p_netobj;
+		selprog_and(&prog, sn);
+	}
+	if (ISOPTSET(opttochk, OPT_opo)) {
+		sn = selprog_test(SF_PORT, SO_EQ, SQ_ANY, port,
+		    SEL_NTYPES(port));
+		last = NULL;
+		for (s = strtok_r(p_portobj, ",", &last); s != NULL;
+		    s = strtok_r(NULL, ",", &last)) {
+			n = strtoul(s, &end, 10);
+			if (*end == '\0' && n <= 65535)
+				selprog_value(sn->sn_test, n);
+			else if ((se = getservbyname(s, NULL)) != NULL)
+				selprog_value(sn->sn_test, ntohs(se->s_port));
+			else
+				errx(EXIT_FAILURE, "-o port: bad port %s", s);
+		}
+		selprog_and(&prog, sn);
+	}
+
+	/* No token is examined for sockets, so none is ever selected. */
+	if (ISOPTSET(opttochk, OPT_oso))
+		selprog_and(&prog, selprog_test(SF_PRESENT, SO_EQ, SQ_ALL,
+		    NULL, 0));
+
+	if (filter != NULL)
+		selprog_and(&prog, filter);
+	selprog_compile(&prog);
+}
+
+/*
+ * Start a child selecting records from one file onto a pipe.
+ */
+static void
+start_job(struct job *j, const char *fname)
+{
+	int fds[2];
+	FILE *fp;
+#ifdef HAVE_CAP_ENTER
+	int retval;
+#endif
+
+	fp = fopen(fname, "r");
+	if (fp == NULL)
+		errx(EXIT_FAILURE, "Couldn't open %s", fname);
+	if (pipe(fds) != 0)
+		err(EXIT_FAILURE, "pipe");
+
+	/* Leave nothing buffered for the child to write again on exit. */
+	if (fflush(NULL) != 0)
+		err(EXIT_FAILURE, "fflush");
+	j->j_fname = fname;
+	j->j_fd = fds[0];
+	j->j_spill = NULL;
+	j->j_pid = fork();
+	if (j->j_pid == -1)
+		err(EXIT_FAILURE, "fork");
+	if (j->j_pid == 0) {
+		/* Child. */
+		if (dup2(fds[1], STDOUT_FILENO) == -1)
+			err(EXIT_FAILURE, "dup2");
+		close(fds[0]);
+		close(fds[1]);
+#ifdef HAVE_CAP_ENTER
+		retval = cap_enter();
+		if (retval != 0 && errno != ENOSYS)
+			errx(EXIT_FAILURE, "cap_enter");
+#endif
+		if (select_file(fp) == -1)
+			errx(EXIT_FAILURE, "Couldn't select records %s", fname);
+		if (fflush(stdout) != 0)
+			exit(EXIT_FAILURE);
+		exit(0);
+	}
+	close(fds[1]);
+	fclose(fp);
+}
+
+/*
+ * Copy output of a job to the standard output, or keep it for later.
+ */
+static void
+job_output(struct job *j, const char *buf, size_t len, int current)
+{
+
+	if (current) {
+		if (fwrite(buf, 1, len, stdout) != len)
+			err(EXIT_FAILURE, "stdout");
+		return;
+	}
+	if (j->j_spill == NULL && (j->j_spill = tmpfile()) == NULL)
+		err(EXIT_FAILURE, "tmpfile");
+	if (fwrite(buf, 1, len, j->j_spill) != len)
+		err(EXIT_FAILURE, "%s", j->j_fname);
+}
+
+/*
+ * Select records from the files with p_workers children at once.  At most
+ * as many finished files again wait for their turn, bounding the temporary
+ * files and descriptors held.
+ */
+static void
+select_parallel(char **files, int nfiles)
+{
+	char buf[65536];
+	struct pollfd *pfd;
+	struct job *jobs, *j;
+	int cur, i, njobs, nfds, nextfile, running, status, window;
+	ssize_t len;
+	size_t n;
+
+	window = p_workers * 2;
+	jobs = calloc(window, sizeof(*jobs));
+	pfd = calloc(window, sizeof(*pfd));
+	if (jobs == NULL || pfd == NULL)
+		err(EXIT_FAILURE, "calloc");
+	njobs = nextfile = running = 0;
+	cur = -1;
+	while (nextfile < nfiles || njobs > 0) {
+		while (nextfile < nfiles && running < p_workers &&
+		    njobs < window) {
+			start_job(&jobs[njobs++], files[nextfile++]);
+			running++;
+		}
+
+		/*
+		 * Give the turn to the next job, copying out what it wrote
+		 * while waiting.
+		 */
+		if (cur == -1) {
+			cur = 0;
+			for (i = 0; unordered && i < njobs; i++)
+				if (jobs[i].j_pid == 0) {
+					cur = i;
+					break;
+				}
+			j = &jobs[cur];
+			if (j->j_spill != NULL) {
+				rewind(j->j_spill);
+				while ((n = fread(buf, 1, sizeof(buf),
+				    j->j_spill)) > 0)
+					job_output(j, buf, n, 1);
+				if (ferror(j->j_spill))
+					err(EXIT_FAILURE, "%s", j->j_fname);
+				fclose(j->j_spill);
+				j->j_spill = NULL;
+			}
+		}
+		if (jobs[cur].j_pid == 0) {
+			memmove(&jobs[cur], &jobs[cur + 1],
+			    (njobs - cur - 1) * sizeof(*jobs));
+			njobs--;
+			cur = -1;
+			continue;
+		}
+
+		nfds = 0;
+		for (i = 0; i < njobs; i++) {
+			if (jobs[i].j_fd == -1)
+				continue;
+			pfd[nfds].fd = jobs[i].j_fd;
+			pfd[nfds].events = POLLIN;
+			pfd[nfds].revents = 0;
+			nfds++;
+		}
+		if (poll(pfd, nfds, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "poll");
+		}
+		for (i = 0, nfds = 0; i < njobs; i++) {
+			j = &jobs[i];
+			if (j->j_fd == -1)
+				continue;
+			if (pfd[nfds++].revents == 0)
+				continue;
+			len = read(j->j_fd, buf, sizeof(buf));
+			if (len == -1) {
+				if (errno == EINTR || errno == EAGAIN)
+					continue;
+				err(EXIT_FAILURE, "read");
+			}
+			if (len > 0) {
+				job_output(j, buf, len, i == cur);
+				continue;
+			}
+
+			/*
+			 * NB: Unlike praudit(1), auditreduce(1) terminates
+			 * if it hits any errors.
+			 */
+			close(j->j_fd);
+			j->j_fd = -1;
+			while (waitpid(j->j_pid, &status, 0) == -1)
+				if (errno != EINTR)
+					err(EXIT_FAILURE, "waitpid");
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				exit(EXIT_FAILURE);
+			j->j_pid = 0;
+			running--;
+		}
+	}
+	free(pfd);
+	free(jobs);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -639,21 +1067,26 @@ main(int argc, char **argv)
 	struct passwd *pw;
 	struct tm tm;
 	au_event_t *n;
+	au_trailset_t *ts;
+	struct sel_node *filter, *sn;
+	const char *errstr;
 	FILE *fp;
-	int i;
+	int failed, i, j;
 	char *objval, *converr;
 	int ch;
 	char timestr[128];
 	char *fname;
 	uint16_t *etp;
 #ifdef HAVE_CAP_ENTER
+	FILE **fps;
 	int retval, status;
 	pid_t childpid, pid;
 #endif
 
 	converr = NULL;
+	filter = NULL;
 
-	while ((ch = getopt(argc, argv, "Aa:b:c:d:e:f:g:j:m:o:r:u:vz:")) != -1) {
+	while ((ch = getopt(argc, argv, "Aa:b:c:D:d:e:F:f:G:g:j:Mm:o:P:r:SUu:vz:")) != -1) {
 		switch(ch) {
 		case 'A':
 			SETOPT(opttochk, OPT_A);
@@ -693,6 +1126,12 @@ main(int argc, char **argv)
 			SETOPT(opttochk, OPT_c);
 			break;
 
+		case 'D':
+			if (agg_distinct(optarg) != 0)
+				usage("Incorrect field to count");
+			aggregate = 1;
+			break;
+
 		case 'd':
 			if (ISOPTSET(opttochk, OPT_b) || ISOPTSET(opttochk,
 			    OPT_a))
@@ -722,6 +1161,13 @@ main(int argc, char **argv)
 			SETOPT(opttochk, OPT_e);
 			break;
 
+		case 'F':
+			if ((sn = selprog_parse(optarg, &errstr)) == NULL)
+				errx(EX_USAGE, "Incorrect filter: %s", errstr);
+			filter = (filter == NULL) ? sn :
+			    selprog_node(SN_AND, filter, sn);
+			break;
+
 		case 'f':
 			p_egid = strtol(optarg, &converr, 10);
 			if (*converr != '\0') {
@@ -733,6 +1179,12 @@ main(int argc, char **argv)
 			SETOPT(opttochk, OPT_f);
 			break;
 
+		case 'G':
+			if (agg_groupby(optarg) != 0)
+				usage("Incorrect fields to group by");
+			aggregate = 1;
+			break;
+
 		case 'g':
 			p_rgid = strtol(optarg, &converr, 10);
 			if (*converr != '\0') {
@@ -749,6 +1201,10 @@ main(int argc, char **argv)
 			SETOPT(opttochk, OPT_j);
 			break;
 
+		case 'M':
+			merge = 1;
+			break;
+
 		case 'm':
 			if (p_evec == NULL) {
 				p_evec_alloc = 32;
@@ -783,6 +1239,12 @@ main(int argc, char **argv)
 			}
 			break;
 
+		case 'P':
+			p_workers = strtol(optarg, &converr, 10);
+			if (*converr != '\0' || p_workers < 1)
+				usage("Incorrect number of workers");
+			break;
+
 		case 'r':
 			p_ruid = strtol(optarg, &converr, 10);
 			if (*converr != '\0') {
@@ -793,6 +1255,14 @@ main(int argc, char **argv)
 			SETOPT(opttochk, OPT_r);
 			break;
 
+		case 'S':
+			summarize = 1;
+			break;
+
+		case 'U':
+			unordered = 1;
+			break;
+
 		case 'u':
 			p_auid = strtol(optarg, &converr, 10);
 			if (*converr != '\0') {
@@ -820,21 +1290,135 @@ main(int argc, char **argv)
 	argv += optind;
 	argc -= optind;
 
+	if (merge && p_workers > 0)
+		usage("'M' is exclusive with 'P'");
+	if (aggregate && p_workers > 0)
+		usage("'G' and 'D' are exclusive with 'P'");
+	if (summarize && argc == 0)
+		usage("'S' needs trail files");
+
+	compile_options(filter);
+
+	/*
+	 * Unless inverted, the selection of records by time is also a window
+	 * outside of which trails are not read.
+	 */
+	if (!ISOPTSET(opttochk, OPT_A) && !ISOPTSET(opttochk, OPT_v)) {
+		w_haslo = ISOPTSET(opttochk, OPT_a) != 0;
+		w_lo = p_atime;
+		w_hashi = ISOPTSET(opttochk, OPT_b) != 0;
+		w_hi = p_btime;
+	}
+
 	if (argc == 0) {
 #ifdef HAVE_CAP_ENTER
 		retval = cap_enter();
 		if (retval != 0 && errno != ENOSYS)
 			err(EXIT_FAILURE, "cap_enter");
 #endif
-		if (select_records(stdin) == -1)
+		if (select_records(stdin, NULL) == -1)
 			errx(EXIT_FAILURE,
 			    "Couldn't select records from stdin");
+		if (aggregate)
+			agg_print();
 		exit(EXIT_SUCCESS);
 	}
+	argv = expand_files(argv, argc, &argc);
+
+	if (summarize) {
+		failed = 0;
+		for (i = 0; i < argc; i++)
+			if (bloom_update(argv[i]) != 0) {
+				warn("Couldn't summarize %s", argv[i]);
+				failed = 1;
+			}
+		exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	/*
+	 * Trails whose summaries show they hold none of the IDs, events or
+	 * paths selected on are not read.
+	 */
+	if (!ISOPTSET(opttochk, OPT_v)) {
+		for (i = j = 0; i < argc; i++)
+			if (bloom_check(argv[i]))
+				argv[j++] = argv[i];
+		argc = j;
+	}
 
 	/*
-	 * XXX: We should actually be merging records here.
+	 * With -M, the files are read as one trail set, yielding records in
+	 * time order across them.  A sandbox cannot open files, so there
+	 * every trail is opened before entering it.
 	 */
+	if (merge) {
+#ifdef HAVE_CAP_ENTER
+		ts = au_trailset_open(AU_TRAILSET_PREOPEN, 0);
+#else
+		ts = au_trailset_open(0, 0);
+#endif
+		if (ts == NULL)
+			err(EXIT_FAILURE, "au_trailset_open");
+		for (i = 0; i < argc; i++) {
+			if (au_trailset_add(ts, argv[i]) == 0)
+				continue;
+			if (errno == EMFILE)
+				errx(EXIT_FAILURE, "Couldn't open %s: too many "
+				    "trails for -M to keep open; raise the "
+				    "open file limit", argv[i]);
+			errx(EXIT_FAILURE, "Couldn't open %s", argv[i]);
+		}
+#ifdef HAVE_CAP_ENTER
+		retval = cap_enter();
+		if (retval != 0 && errno != ENOSYS)
+			err(EXIT_FAILURE, "cap_enter");
+#endif
+		if (select_records(NULL, ts) == -1)
+			err(EXIT_FAILURE, "Couldn't select records");
+		au_trailset_close(ts);
+		if (aggregate)
+			agg_print();
+		exit(EXIT_SUCCESS);
+	}
+
+	/*
+	 * Aggregates are kept by this process, which therefore selects from
+	 * every file itself; in a sandbox, as with -M, once all are open.
+	 */
+	if (aggregate) {
+#ifdef HAVE_CAP_ENTER
+		if ((fps = calloc(argc, sizeof(*fps))) == NULL)
+			err(EXIT_FAILURE, "calloc");
+		for (i = 0; i < argc; i++)
+			if ((fps[i] = fopen(argv[i], "r")) == NULL)
+				errx(EXIT_FAILURE, "Couldn't open %s", argv[i]);
+		retval = cap_enter();
+		if (retval != 0 && errno != ENOSYS)
+			err(EXIT_FAILURE, "cap_enter");
+#endif
+		for (i = 0; i < argc; i++) {
+#ifdef HAVE_CAP_ENTER
+			fp = fps[i];
+#else
+			if ((fp = fopen(argv[i], "r")) == NULL)
+				errx(EXIT_FAILURE, "Couldn't open %s", argv[i]);
+#endif
+			if (select_file(fp) == -1)
+				errx(EXIT_FAILURE, "Couldn't select records %s",
+				    argv[i]);
+			fclose(fp);
+		}
+		agg_print();
+		exit(EXIT_SUCCESS);
+	}
+
+	if (p_workers > 0) {
+		select_parallel(argv, argc);
+		if (fflush(stdout) != 0)
+			err(EXIT_FAILURE, "stdout");
+		exit(EXIT_SUCCESS);
+	}
+
 	for (i = 0; i < argc; i++) {
 		fname = argv[i];
 		fp = fopen(fname, "r");
@@ -858,7 +1442,7 @@ main(int argc, char **argv)
 			retval = cap_enter();
 			if (retval != 0 && errno != ENOSYS)
 				errx(EXIT_FAILURE, "cap_enter");
-			if (select_records(fp) == -1)
+			if (select_file(fp) == -1)
 				errx(EXIT_FAILURE,
 				    "Couldn't select records %s", fname);
 			exit(0);
@@ -869,7 +1453,7 @@ main(int argc, char **argv)
 		if (WEXITSTATUS(status) != 0)
 			exit(EXIT_FAILURE);
 #else
-		if (select_records(fp) == -1)
+		if (select_file(fp) == -1)
 			errx(EXIT_FAILURE, "Couldn't select records %s",
 			    fname);
 #endif
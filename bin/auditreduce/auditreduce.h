@@ -35,9 +35,15 @@ struct re_entry {
 	char		*re_pattern;
 	int		 re_negate;
 	regex_t		 re_regexp;
+	char		*re_prefix;	/* Required prefix, or NULL. */
+	size_t		 re_prefixlen;
+	char		*re_literal;	/* Required substring, or NULL. */
+	int		 re_exact;	/* Literals decide the match. */
 	TAILQ_ENTRY(re_entry) re_glue;
 };
 
+TAILQ_HEAD(re_list, re_entry);
+
 #define OPT_a	0x00000001
 #define OPT_b	0x00000002
 #define OPT_c	0x00000004
@@ -58,10 +64,15 @@ struct re_entry {
 #define OPT_A	0x00020000
 #define OPT_v	0x00040000
 #define OPT_z	0x00080000
+#define OPT_on	0x00100000
+#define OPT_opo	0x00200000
 
 #define FILEOBJ "file"
+#define IPOBJ "ip"
 #define MSGQIDOBJ "msgqid"
+#define NETOBJ "net"
 #define PIDOBJ "pid"
+#define PORTOBJ "port"
 #define SEMIDOBJ "semid"
 #define SHMIDOBJ "shmid"
 #define SOCKOBJ "sock"
@@ -70,5 +81,132 @@ struct re_entry {
 #define SETOPT(optmask, bit)	(optmask |= bit)
 #define ISOPTSET(optmask, bit)	(optmask & bit)
 
+/*
+ * Selection program, see selprog.c.  Token fields examined by a test:
+ */
+#define	SF_PRESENT	0	/* Always passes; the token is present. */
+#define	SF_EVENT	1	/* Event of the header. */
+#define	SF_TIME		2	/* Seconds of the header. */
+#define	SF_CLASS	3	/* Event preselected by st_mask, either way. */
+#define	SF_CLASSRET	4	/* Event preselected for the return status. */
+#define	SF_AUID		5
+#define	SF_EUID		6
+#define	SF_EGID		7
+#define	SF_RUID		8
+#define	SF_RGID		9
+#define	SF_PID		10
+#define	SF_SUCCESS	11	/* 1 if the return status is zero, else 0. */
+#define	SF_RETURN	12	/* Return status. */
+#define	SF_PATH		13
+#define	SF_ZONE		14	/* Matched against the glob st_str. */
+#define	SF_IP		15	/* Any address of the token. */
+#define	SF_IPCID	16	/* Id of an IPC object of type st_ipctype. */
+#define	SF_IPCKNOWN	17	/* IPC object of a known type. */
+#define	SF_PORT		18	/* Any port of the token. */
+
+/* Comparisons; a list of values is only allowed with SO_EQ. */
+#define	SO_EQ		0
+#define	SO_LT		1
+#define	SO_LE		2
+#define	SO_GT		3
+#define	SO_GE		4
+#define	SO_MATCH	5	/* First of st_re to match decides. */
+
+/* How the tokens examined decide a test. */
+#define	SQ_ANY		0	/* Some token passes. */
+#define	SQ_ALL		1	/* Some token is examined and all pass. */
+#define	SQ_EACH		2	/* All tokens examined, if any, pass. */
+
+/* Nodes of the program. */
+#define	SN_TEST		0
+#define	SN_AND		1
+#define	SN_OR		2
+#define	SN_NOT		3
+
+struct net_trie;
+
+struct sel_test {
+	int		 st_field;
+	int		 st_op;
+	int		 st_quant;
+	const u_char	*st_types;	/* Token types examined. */
+	int		 st_ntypes;
+	int64_t		*st_vals;
+	int		 st_nvals;
+	au_mask_t	 st_mask;
+	const char	*st_str;
+	struct re_list	 st_re;
+	u_char		 st_ipctype;
+	struct net_trie	*st_net;
+	int		 st_state;	/* While a record is examined. */
+	int		 st_seen;
+};
+
+struct sel_node {
+	int		 sn_type;
+	struct sel_test	*sn_test;
+	struct sel_node	*sn_left;
+	struct sel_node	*sn_right;
+};
+
+struct sel_prog {
+	struct sel_node	 *sp_root;	/* NULL selects every record. */
+	struct sel_test	**sp_tests;
+	int		  sp_ntests;
+	struct sel_test	**sp_bytype[256];	/* NULL terminated. */
+};
+
+#define	SEL_NTYPES(types)	((int)(sizeof(types) / sizeof((types)[0])))
+
+/* Variants of the tokens holding the fields commonly selected on. */
+#define	SEL_HDR_TYPES	AUT_HEADER32, AUT_HEADER32_EX, AUT_HEADER64,	\
+			AUT_HEADER64_EX
+#define	SEL_SUBJ_TYPES	AUT_SUBJECT32, AUT_SUBJECT32_EX, AUT_SUBJECT64,	\
+			AUT_SUBJECT64_EX
+#define	SEL_PROC_TYPES	AUT_PROCESS32, AUT_PROCESS32_EX, AUT_PROCESS64,	\
+			AUT_PROCESS64_EX
+#define	SEL_RET_TYPES	AUT_RETURN32, AUT_RETURN64
+#define	SEL_IP_TYPES	AUT_IN_ADDR, AUT_IN_ADDR_EX, AUT_IP,		\
+			AUT_SOCKINET32, AUT_SOCKINET128, AUT_SOCKET_EX
+#define	SEL_PORT_TYPES	AUT_IPORT, AUT_SOCKINET32, AUT_SOCKINET128,	\
+			AUT_SOCKET_EX
+
+struct sel_node	*selprog_test(int field, int op, int quant,
+		    const u_char *types, int ntypes);
+void		 selprog_value(struct sel_test *st, int64_t val);
+void		 selprog_literal(struct re_entry *rep);
+struct sel_node	*selprog_node(int type, struct sel_node *left,
+		    struct sel_node *right);
+struct sel_node	*selprog_parse(const char *expr, const char **errstr);
+void		 selprog_and(struct sel_prog *sp, struct sel_node *sn);
+void		 selprog_compile(struct sel_prog *sp);
+int		 selprog_run(struct sel_prog *sp, u_char *buf, int len);
+
+/* Aggregation of the selected records (-G, -D), see aggregate.c. */
+int		 agg_groupby(const char *spec);
+int		 agg_distinct(const char *field);
+void		 agg_record(u_char *buf, int len);
+void		 agg_print(void);
+
+/* Sets of networks, see nettrie.c. */
+struct net_trie	*nettrie_alloc(void);
+int		 nettrie_add(struct net_trie *nt, const char *net);
+int		 nettrie_addlist(struct net_trie *nt, const char *list,
+		    const char **errstr);
+int		 nettrie_match(const struct net_trie *nt, int type,
+		    const void *addr);
+
+/* Trail summaries, see bloom.c.  Kinds of values summarized: */
+#define	BK_AUID		1
+#define	BK_EUID		2
+#define	BK_EVENT	3
+#define	BK_TRIGRAM	4	/* Three consecutive characters of a path. */
+
+void		 bloom_ids(int kind, const u_int32_t *ids, int n);
+void		 bloom_paths(struct re_list *head);
+int		 bloom_check(const char *fname);
+int		 bloom_update(const char *fname);
+size_t		 record_length(const u_char *buf, size_t len);
+
 
 #endif /* !_AUDITREDUCE_H_ */
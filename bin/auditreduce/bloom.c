@@ -0,0 +1,635 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Trail summaries for auditreduce(1).  Next to a trail file, a hidden
+ * sidecar keeps a Bloom filter of the audit and effective user IDs of its
+ * subject and process tokens, the events of its headers and the trigrams of
+ * its paths, along with the size and modification time of the trail it was
+ * built from.  A trail whose filter lacks every value some selection option
+ * requires holds no record selected and is not read.  Filters only give
+ * false positives, so the others are read as before.  A missing or stale
+ * sidecar is built again from the trail the first time it is needed, unless
+ * a sidecar could not be written in the same directory earlier in the run.
+ */
+
+#include <config/config.h>
+
+#ifdef HAVE_FULL_QUEUE_H
+#include <sys/queue.h>
+#else
+#include <compat/queue.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <bsm/libbsm.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "auditreduce.h"
+
+/*
+ * Layout of a sidecar, in big-endian order: magic, version, size and
+ * modification time of the trail, number of hash functions and base 2
+ * logarithm of the number of bits, then the bits.
+ */
+#define	BLOOM_MAGIC	"ARBF"
+#define	BLOOM_VERSION	1
+#define	BLOOM_HDRLEN	32
+#define	BLOOM_SUFFIX	".bloom"
+
+/* Hash functions and bits per value, for about 1% of false positives. */
+#define	BLOOM_K		7
+#define	BLOOM_BITS	10
+#define	BLOOM_MAXLOG	31
+
+struct bloom {
+	u_char		*bf_bits;
+	u_int32_t	 bf_k;
+	u_int32_t	 bf_log;	/* 1 << bf_log bits. */
+};
+
+/* Distinct hashes of the values of a trail, as it is summarized. */
+struct bloom_set {
+	u_int64_t	*bs_tab;	/* Zero for an empty slot. */
+	size_t		 bs_size;	/* A power of two. */
+	size_t		 bs_n;
+};
+
+/*
+ * Values the selected records need: every need has to be met by one of its
+ * alternatives, and an alternative by all of its values.
+ */
+struct bloom_alt {
+	u_int64_t	*ba_hash;
+	int		 ba_nhash;
+};
+
+struct bloom_need {
+	struct bloom_alt *bn_alt;
+	int		  bn_nalt;
+};
+
+/* A directory a sidecar could not be written in, and why. */
+struct bloom_rodir {
+	char		*br_dir;
+	int		 br_error;
+};
+
+static struct bloom_need	*bloom_needs;
+static int			 bloom_nneeds;
+static struct bloom_rodir	*bloom_rodirs;
+static int			 bloom_nrodirs;
+
+#define	BLOOM_IDS(bs, t) do {						\
+	bloom_setadd((bs), bloom_hash(BK_AUID, (t).auid));		\
+	bloom_setadd((bs), bloom_hash(BK_EUID, (t).euid));		\
+} while (0)
+
+static u_int64_t
+bloom_hash(int kind, u_int32_t v)
+{
+	u_int64_t h;
+
+	h = (u_int64_t)kind << 32 | v;
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return (h != 0 ? h : 1);
+}
+
+static u_int64_t
+bloom_trigram(const char *s)
+{
+
+	return (bloom_hash(BK_TRIGRAM, (u_char)s[0] << 16 |
+	    (u_char)s[1] << 8 | (u_char)s[2]));
+}
+
+static void
+bloom_setadd(struct bloom_set *bs, u_int64_t h)
+{
+	u_int64_t *tab;
+	size_t i, j, size;
+
+	if (bs->bs_n * 2 >= bs->bs_size) {
+		size = bs->bs_size != 0 ? bs->bs_size * 2 : 1024;
+		if ((tab = calloc(size, sizeof(*tab))) == NULL)
+			err(EXIT_FAILURE, "malloc");
+		for (i = 0; i < bs->bs_size; i++) {
+			if (bs->bs_tab[i] == 0)
+				continue;
+			for (j = bs->bs_tab[i] & (size - 1); tab[j] != 0;
+			    j = (j + 1) & (size - 1))
+				continue;
+			tab[j] = bs->bs_tab[i];
+		}
+		free(bs->bs_tab);
+		bs->bs_tab = tab;
+		bs->bs_size = size;
+	}
+	for (i = h & (bs->bs_size - 1); bs->bs_tab[i] != 0;
+	    i = (i + 1) & (bs->bs_size - 1))
+		if (bs->bs_tab[i] == h)
+			return;
+	bs->bs_tab[i] = h;
+	bs->bs_n++;
+}
+
+static void
+bloom_token(struct bloom_set *bs, tokenstr_t *tok)
+{
+	size_t i, len;
+
+	switch (tok->id) {
+	case AUT_HEADER32:
+		bloom_setadd(bs, bloom_hash(BK_EVENT, tok->tt.hdr32.e_type));
+		break;
+	case AUT_HEADER32_EX:
+		bloom_setadd(bs, bloom_hash(BK_EVENT,
+		    tok->tt.hdr32_ex.e_type));
+		break;
+	case AUT_HEADER64:
+		bloom_setadd(bs, bloom_hash(BK_EVENT, tok->tt.hdr64.e_type));
+		break;
+	case AUT_HEADER64_EX:
+		bloom_setadd(bs, bloom_hash(BK_EVENT,
+		    tok->tt.hdr64_ex.e_type));
+		break;
+	case AUT_SUBJECT32:
+		BLOOM_IDS(bs, tok->tt.subj32);
+		break;
+	case AUT_SUBJECT32_EX:
+		BLOOM_IDS(bs, tok->tt.subj32_ex);
+		break;
+	case AUT_SUBJECT64:
+		BLOOM_IDS(bs, tok->tt.subj64);
+		break;
+	case AUT_SUBJECT64_EX:
+		BLOOM_IDS(bs, tok->tt.subj64_ex);
+		break;
+	case AUT_PROCESS32:
+		BLOOM_IDS(bs, tok->tt.proc32);
+		break;
+	case AUT_PROCESS32_EX:
+		BLOOM_IDS(bs, tok->tt.proc32_ex);
+		break;
+	case AUT_PROCESS64:
+		BLOOM_IDS(bs, tok->tt.proc64);
+		break;
+	case AUT_PROCESS64_EX:
+		BLOOM_IDS(bs, tok->tt.proc64_ex);
+		break;
+	case AUT_PATH:
+		/* Paths are matched as C strings. */
+		len = strnlen(tok->tt.path.path, tok->tt.path.len);
+		for (i = 0; i + 3 <= len; i++)
+			bloom_setadd(bs, bloom_trigram(tok->tt.path.path + i));
+		break;
+	}
+}
+
+static void
+bloom_add(struct bloom *bf, u_int64_t h)
+{
+	u_int32_t h1, h2, i, mask;
+
+	h1 = h;
+	h2 = (h >> 32) | 1;
+	mask = (1U << bf->bf_log) - 1;
+	for (i = 0; i < bf->bf_k; i++, h1 += h2)
+		bf->bf_bits[(h1 & mask) / 8] |= 1 << (h1 & 7);
+}
+
+static int
+bloom_test(const struct bloom *bf, u_int64_t h)
+{
+	u_int32_t h1, h2, i, mask;
+
+	h1 = h;
+	h2 = (h >> 32) | 1;
+	mask = (1U << bf->bf_log) - 1;
+	for (i = 0; i < bf->bf_k; i++, h1 += h2)
+		if (!(bf->bf_bits[(h1 & mask) / 8] & (1 << (h1 & 7))))
+			return (0);
+	return (1);
+}
+
+/*
+ * Summarize the trail open on fd.  Every token that can be read is, as any
+ * may be examined when selecting records.
+ */
+static int
+bloom_build(int fd, const struct stat *sb, struct bloom *bf)
+{
+	struct bloom_set bs;
+	tokenstr_t tok;
+	u_char *base, *p, *end;
+	size_t i, off, reclen;
+
+	bzero(&bs, sizeof(bs));
+	if (sb->st_size > 0) {
+		if ((uintmax_t)sb->st_size > SIZE_MAX) {
+			errno = EFBIG;
+			return (-1);
+		}
+		base = mmap(NULL, sb->st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (base == MAP_FAILED)
+			return (-1);
+		end = base + sb->st_size;
+		for (p = base; (reclen = record_length(p, end - p)) != 0;
+		    p += reclen)
+			for (off = 0; off < reclen; off += tok.len) {
+				if (au_fetch_tok(&tok, p + off, reclen - off) ==
+				    -1)
+					break;
+				bloom_token(&bs, &tok);
+			}
+		munmap(base, sb->st_size);
+	}
+
+	bf->bf_k = BLOOM_K;
+	for (bf->bf_log = 6; bf->bf_log < BLOOM_MAXLOG &&
+	    ((size_t)1 << bf->bf_log) < bs.bs_n * BLOOM_BITS; bf->bf_log++)
+		continue;
+	if ((bf->bf_bits = calloc(1, (size_t)1 << (bf->bf_log - 3))) == NULL)
+		err(EXIT_FAILURE, "malloc");
+	for (i = 0; i < bs.bs_size; i++)
+		if (bs.bs_tab[i] != 0)
+			bloom_add(bf, bs.bs_tab[i]);
+	free(bs.bs_tab);
+	return (0);
+}
+
+static void
+bloom_enc(u_char *p, u_int64_t v, int len)
+{
+
+	while (len-- > 0) {
+		p[len] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static u_int64_t
+bloom_dec(const u_char *p, int len)
+{
+	u_int64_t v;
+
+	for (v = 0; len-- > 0; p++)
+		v = v << 8 | *p;
+	return (v);
+}
+
+/*
+ * Read the filter kept in path, if it was built from the trail as it is.
+ */
+static int
+bloom_read(const char *path, const struct stat *sb, struct bloom *bf)
+{
+	u_char hdr[BLOOM_HDRLEN];
+	size_t len;
+	FILE *fp;
+	int ret;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		return (-1);
+	ret = -1;
+	if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+	    memcmp(hdr, BLOOM_MAGIC, 4) != 0 ||
+	    bloom_dec(hdr + 4, 4) != BLOOM_VERSION ||
+	    bloom_dec(hdr + 8, 8) != (u_int64_t)sb->st_size ||
+	    bloom_dec(hdr + 16, 8) != (u_int64_t)sb->st_mtime)
+		goto out;
+	bf->bf_k = bloom_dec(hdr + 24, 4);
+	bf->bf_log = bloom_dec(hdr + 28, 4);
+	if (bf->bf_k == 0 || bf->bf_k > 32 || bf->bf_log < 3 ||
+	    bf->bf_log > BLOOM_MAXLOG)
+		goto out;
+	len = (size_t)1 << (bf->bf_log - 3);
+	if ((bf->bf_bits = malloc(len)) == NULL)
+		err(EXIT_FAILURE, "malloc");
+	if (fread(bf->bf_bits, 1, len, fp) != len || fgetc(fp) != EOF) {
+		free(bf->bf_bits);
+		goto out;
+	}
+	ret = 0;
+out:
+	fclose(fp);
+	return (ret);
+}
+
+/*
+ * Keep the filter in path, replacing any stale one at once.  It is as
+ * readable as the trail.
+ */
+static int
+bloom_write(const char *path, const struct stat *sb, const struct bloom *bf)
+{
+	u_char hdr[BLOOM_HDRLEN];
+	char *tmp;
+	size_t len;
+	FILE *fp;
+	int error, fd;
+
+	len = strlen(path) + sizeof(".XXXXXX");
+	if ((tmp = malloc(len)) == NULL)
+		err(EXIT_FAILURE, "malloc");
+	snprintf(tmp, len, "%s.XXXXXX", path);
+	if ((fd = mkstemp(tmp)) == -1) {
+		free(tmp);
+		return (-1);
+	}
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		goto fail;
+	}
+	memcpy(hdr, BLOOM_MAGIC, 4);
+	bloom_enc(hdr + 4, BLOOM_VERSION, 4);
+	bloom_enc(hdr + 8, sb->st_size, 8);
+	bloom_enc(hdr + 16, sb->st_mtime, 8);
+	bloom_enc(hdr + 24, bf->bf_k, 4);
+	bloom_enc(hdr + 28, bf->bf_log, 4);
+	if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+	    fwrite(bf->bf_bits, 1, (size_t)1 << (bf->bf_log - 3), fp) !=
+	    (size_t)1 << (bf->bf_log - 3) ||
+	    fchmod(fd, sb->st_mode & 0666) != 0) {
+		fclose(fp);
+		goto fail;
+	}
+	if (fclose(fp) != 0 || rename(tmp, path) != 0)
+		goto fail;
+	free(tmp);
+	return (0);
+fail:
+	error = errno;
+	unlink(tmp);
+	free(tmp);
+	errno = error;
+	return (-1);
+}
+
+/*
+ * Return the error that kept a sidecar from being written in the directory
+ * of the first dirlen bytes of fname, or 0 if none has been.
+ */
+static int
+bloom_rodir(const char *fname, size_t dirlen)
+{
+	int i;
+
+	for (i = 0; i < bloom_nrodirs; i++)
+		if (strlen(bloom_rodirs[i].br_dir) == dirlen &&
+		    strncmp(bloom_rodirs[i].br_dir, fname, dirlen) == 0)
+			return (bloom_rodirs[i].br_error);
+	return (0);
+}
+
+static void
+bloom_addrodir(const char *fname, size_t dirlen, int error)
+{
+	struct bloom_rodir *br;
+
+	br = realloc(bloom_rodirs, (bloom_nrodirs + 1) * sizeof(*br));
+	if (br == NULL)
+		err(EXIT_FAILURE, "realloc");
+	bloom_rodirs = br;
+	br += bloom_nrodirs;
+	if ((br->br_dir = malloc(dirlen + 1)) == NULL)
+		err(EXIT_FAILURE, "malloc");
+	memcpy(br->br_dir, fname, dirlen);
+	br->br_dir[dirlen] = '\0';
+	br->br_error = error;
+	bloom_nrodirs++;
+}
+
+/*
+ * Get the filter of a trail, building and keeping it if its sidecar is
+ * missing or stale; *saved tells whether it could be kept.  Once a sidecar
+ * cannot be written in a directory, no more are built there: each would be
+ * thrown away and built again by the next query, at the cost of reading the
+ * trail twice.  Trails still being written are not summarized.
+ */
+static int
+bloom_get(const char *fname, struct bloom *bf, int *saved)
+{
+	const char *base;
+	struct stat sb;
+	char *path;
+	size_t len;
+	int error, fd, ret;
+
+	*saved = 1;
+	base = strrchr(fname, '/');
+	base = (base != NULL) ? base + 1 : fname;
+	len = strlen(base);
+	if (strcmp(base, "current") == 0 || (len >= 14 &&
+	    strcmp(base + len - 14, "not_terminated") == 0)) {
+		errno = 0;
+		return (-1);
+	}
+	if (stat(fname, &sb) != 0)
+		return (-1);
+	if (!S_ISREG(sb.st_mode)) {
+		errno = 0;
+		return (-1);
+	}
+
+	len = strlen(fname) + sizeof("." BLOOM_SUFFIX);
+	if ((path = malloc(len)) == NULL)
+		err(EXIT_FAILURE, "malloc");
+	snprintf(path, len, "%.*s.%s" BLOOM_SUFFIX, (int)(base - fname),
+	    fname, base);
+	if ((ret = bloom_read(path, &sb, bf)) != 0 &&
+	    (error = bloom_rodir(fname, base - fname)) != 0) {
+		*saved = 0;
+		errno = error;
+	} else if (ret != 0 && (fd = open(fname, O_RDONLY)) != -1) {
+		if ((ret = fstat(fd, &sb)) == 0 &&
+		    (ret = bloom_build(fd, &sb, bf)) == 0 &&
+		    bloom_write(path, &sb, bf) != 0) {
+			*saved = 0;
+			bloom_addrodir(fname, base - fname, errno);
+		}
+		close(fd);
+	}
+	free(path);
+	return (ret);
+}
+
+static struct bloom_alt *
+bloom_addalt(struct bloom_need *bn)
+{
+	struct bloom_alt *ba;
+
+	bn->bn_alt = realloc(bn->bn_alt, (bn->bn_nalt + 1) *
+	    sizeof(*bn->bn_alt));
+	if (bn->bn_alt == NULL)
+		err(EXIT_FAILURE, "malloc");
+	ba = &bn->bn_alt[bn->bn_nalt++];
+	bzero(ba, sizeof(*ba));
+	return (ba);
+}
+
+static void
+bloom_althash(struct bloom_alt *ba, u_int64_t h)
+{
+
+	ba->ba_hash = realloc(ba->ba_hash, (ba->ba_nhash + 1) *
+	    sizeof(*ba->ba_hash));
+	if (ba->ba_hash == NULL)
+		err(EXIT_FAILURE, "malloc");
+	ba->ba_hash[ba->ba_nhash++] = h;
+}
+
+static struct bloom_need *
+bloom_addneed(void)
+{
+	struct bloom_need *bn;
+
+	bloom_needs = realloc(bloom_needs, (bloom_nneeds + 1) *
+	    sizeof(*bloom_needs));
+	if (bloom_needs == NULL)
+		err(EXIT_FAILURE, "malloc");
+	bn = &bloom_needs[bloom_nneeds++];
+	bzero(bn, sizeof(*bn));
+	return (bn);
+}
+
+/*
+ * Require the selected records to hold one of the n values of the given
+ * kind.
+ */
+void
+bloom_ids(int kind, const u_int32_t *ids, int n)
+{
+	struct bloom_need *bn;
+	int i;
+
+	bn = bloom_addneed();
+	for (i = 0; i < n; i++)
+		bloom_althash(bloom_addalt(bn), bloom_hash(kind, ids[i]));
+}
+
+/*
+ * Require a path matching one of the expressions that select paths, each of
+ * which contains the literal text found in the expression.  Nothing is
+ * required if some expression has too little of it.
+ */
+void
+bloom_paths(struct re_list *head)
+{
+	struct bloom_need need;
+	struct bloom_alt *ba;
+	struct re_entry *rep;
+	const char *lit[2];
+	size_t len[2], i;
+	int j;
+
+	bzero(&need, sizeof(need));
+	TAILQ_FOREACH(rep, head, re_glue) {
+		if (rep->re_negate)
+			continue;
+		lit[0] = rep->re_prefix;
+		len[0] = rep->re_prefix != NULL ? rep->re_prefixlen : 0;
+		lit[1] = rep->re_literal;
+		len[1] = rep->re_literal != NULL ? strlen(rep->re_literal) : 0;
+		ba = bloom_addalt(&need);
+		for (j = 0; j < 2; j++)
+			for (i = 0; i + 3 <= len[j]; i++)
+				bloom_althash(ba, bloom_trigram(lit[j] + i));
+		if (ba->ba_nhash == 0)
+			goto none;
+	}
+	if (need.bn_nalt == 0)
+		return;
+	*bloom_addneed() = need;
+	return;
+none:
+	for (j = 0; j < need.bn_nalt; j++)
+		free(need.bn_alt[j].ba_hash);
+	free(need.bn_alt);
+}
+
+/*
+ * Return whether a trail may hold records selected, that is unless its
+ * filter shows that some need is not met.
+ */
+int
+bloom_check(const char *fname)
+{
+	struct bloom_need *bn;
+	struct bloom_alt *ba;
+	struct bloom bf;
+	int i, j, k, met, saved;
+
+	if (bloom_nneeds == 0 || bloom_get(fname, &bf, &saved) != 0)
+		return (1);
+	for (i = 0; i < bloom_nneeds; i++) {
+		bn = &bloom_needs[i];
+		met = 0;
+		for (j = 0; j < bn->bn_nalt && !met; j++) {
+			ba = &bn->bn_alt[j];
+			for (k = 0; k < ba->ba_nhash; k++)
+				if (!bloom_test(&bf, ba->ba_hash[k]))
+					break;
+			met = (k == ba->ba_nhash);
+		}
+		if (!met)
+			break;
+	}
+	free(bf.bf_bits);
+	return (i == bloom_nneeds);
+}
+
+/*
+ * Make sure the sidecar of a trail is up to date.  Trails that are not
+ * summarized are no error.
+ */
+int
+bloom_update(const char *fname)
+{
+	struct bloom bf;
+	int saved;
+
+	if (bloom_get(fname, &bf, &saved) != 0)
+		return (errno == 0 ? 0 : -1);
+	free(bf.bf_bits);
+	return (saved ? 0 : -1);
+}
@@ -0,0 +1,311 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Sets of IPv4 and IPv6 networks for auditreduce(1), such as lists of
+ * prefixes of hosts to look out for.  Each family is kept in a binary radix
+ * trie whose nodes hold the prefix leading to them, so that chains of nodes
+ * with a single child are collapsed; an address is looked up by following
+ * its bits from the root, in at most as many steps as the longest prefix
+ * has bits.
+ */
+
+#include <config/config.h>
+
+#ifdef HAVE_FULL_QUEUE_H
+#include <sys/queue.h>
+#else
+#include <compat/queue.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <bsm/libbsm.h>
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef HAVE_STRLCPY
+#include <compat/strlcpy.h>
+#endif
+
+#include "auditreduce.h"
+
+struct net_node {
+	struct net_node	*nn_child[2];
+	u_char		 nn_addr[16];	/* Bits past nn_len are zero. */
+	int		 nn_len;
+	int		 nn_term;	/* A network ends here. */
+};
+
+struct net_trie {
+	struct net_node	*nt_root[2];	/* IPv4, IPv6. */
+};
+
+static char	net_err[128];
+
+/* The first 96 bits of an IPv4-mapped IPv6 address, ::ffff:0:0/96. */
+static const u_char	net_mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+			    0xff, 0xff };
+
+static int
+net_bit(const u_char *addr, int bit)
+{
+
+	return ((addr[bit / 8] >> (7 - bit % 8)) & 1);
+}
+
+/*
+ * Return the first bit from from on at which a and b differ, or to.
+ */
+static int
+net_diff(const u_char *a, const u_char *b, int from, int to)
+{
+	u_char x;
+	int bit;
+
+	for (bit = from; bit < to; ) {
+		if (bit % 8 == 0 && bit + 8 <= to) {
+			if ((x = a[bit / 8] ^ b[bit / 8]) == 0) {
+				bit += 8;
+				continue;
+			}
+			while (!(x & 0x80)) {
+				x <<= 1;
+				bit++;
+			}
+			return (bit);
+		}
+		if (net_bit(a, bit) != net_bit(b, bit))
+			return (bit);
+		bit++;
+	}
+	return (to);
+}
+
+static struct net_node *
+net_node(const u_char *addr, int len, int term)
+{
+	struct net_node *nn;
+	int i;
+
+	if ((nn = calloc(1, sizeof(*nn))) == NULL)
+		err(EXIT_FAILURE, "calloc");
+	memcpy(nn->nn_addr, addr, (len + 7) / 8);
+	if (len % 8 != 0)
+		nn->nn_addr[len / 8] &= 0xff << (8 - len % 8);
+	for (i = (len + 7) / 8; i < 16; i++)
+		nn->nn_addr[i] = 0;
+	nn->nn_len = len;
+	nn->nn_term = term;
+	return (nn);
+}
+
+static void
+net_insert(struct net_node **np, const u_char *addr, int len)
+{
+	struct net_node *nn, *mn;
+	int depth, diff;
+
+	for (depth = 0; (nn = *np) != NULL; depth = nn->nn_len) {
+		diff = net_diff(nn->nn_addr, addr, depth,
+		    nn->nn_len < len ? nn->nn_len : len);
+		if (diff == nn->nn_len) {
+			if (len == nn->nn_len) {
+				nn->nn_term = 1;
+				return;
+			}
+			np = &nn->nn_child[net_bit(addr, nn->nn_len)];
+			continue;
+		}
+
+		/* The new network is above nn, or they part at diff. */
+		if (diff == len) {
+			mn = net_node(addr, len, 1);
+			mn->nn_child[net_bit(nn->nn_addr, len)] = nn;
+		} else {
+			mn = net_node(addr, diff, 0);
+			mn->nn_child[net_bit(nn->nn_addr, diff)] = nn;
+			mn->nn_child[net_bit(addr, diff)] =
+			    net_node(addr, len, 1);
+		}
+		*np = mn;
+		return;
+	}
+	*np = net_node(addr, len, 1);
+}
+
+struct net_trie *
+nettrie_alloc(void)
+{
+	struct net_trie *nt;
+
+	if ((nt = calloc(1, sizeof(*nt))) == NULL)
+		err(EXIT_FAILURE, "calloc");
+	return (nt);
+}
+
+/*
+ * Add a network given as an address, with or without a prefix length.
+ * Bits of the address past the prefix are ignored.  An IPv4-mapped IPv6
+ * network is added as the IPv4 network, where mapped addresses are looked up.
+ */
+int
+nettrie_add(struct net_trie *nt, const char *net)
+{
+	char buf[INET6_ADDRSTRLEN + sizeof("/128")], *slash, *end;
+	u_char addr[16];
+	long len;
+	int v6;
+
+	if (strlcpy(buf, net, sizeof(buf)) >= sizeof(buf))
+		return (-1);
+	if ((slash = strchr(buf, '/')) != NULL)
+		*slash++ = '\0';
+	if (inet_pton(AF_INET, buf, addr) == 1)
+		v6 = 0;
+	else if (inet_pton(AF_INET6, buf, addr) == 1)
+		v6 = 1;
+	else
+		return (-1);
+	len = v6 ? 128 : 32;
+	if (slash != NULL) {
+		len = strtol(slash, &end, 10);
+		if (*slash == '\0' || *end != '\0' || len < 0 ||
+		    len > (v6 ? 128 : 32))
+			return (-1);
+	}
+	if (v6 && len >= 96 &&
+	    memcmp(addr, net_mapped, sizeof(net_mapped)) == 0) {
+		/* An IPv4-mapped network is the IPv4 network. */
+		memmove(addr, addr + sizeof(net_mapped), 4);
+		len -= 96;
+		v6 = 0;
+	}
+	net_insert(&nt->nt_root[v6], addr, len);
+	return (0);
+}
+
+static int
+nettrie_load(struct net_trie *nt, const char *fname, const char **errstr)
+{
+	char line[256], *p, *q;
+	FILE *fp;
+	int lineno;
+
+	if ((fp = fopen(fname, "r")) == NULL) {
+		snprintf(net_err, sizeof(net_err), "%s: %s", fname,
+		    strerror(errno));
+		*errstr = net_err;
+		return (-1);
+	}
+	for (lineno = 1; fgets(line, sizeof(line), fp) != NULL; lineno++) {
+		if ((p = strchr(line, '#')) != NULL)
+			*p = '\0';
+		for (p = line; isspace((u_char)*p); p++)
+			continue;
+		for (q = p + strlen(p); q > p && isspace((u_char)q[-1]); q--)
+			continue;
+		*q = '\0';
+		if (*p != '\0' && nettrie_add(nt, p) != 0) {
+			snprintf(net_err, sizeof(net_err),
+			    "%s: bad network at line %d", fname, lineno);
+			*errstr = net_err;
+			fclose(fp);
+			return (-1);
+		}
+	}
+	fclose(fp);
+	return (0);
+}
+
+/*
+ * Add the networks of a comma separated list, or those of the file named
+ * after an @, one per line with # starting comments.
+ */
+int
+nettrie_addlist(struct net_trie *nt, const char *list, const char **errstr)
+{
+	char *copy, *net, *last;
+
+	if (list[0] == '@')
+		return (nettrie_load(nt, list + 1, errstr));
+	if ((copy = strdup(list)) == NULL)
+		err(EXIT_FAILURE, "strdup");
+	for (net = strtok_r(copy, ",", &last); net != NULL;
+	    net = strtok_r(NULL, ",", &last))
+		if (nettrie_add(nt, net) != 0) {
+			snprintf(net_err, sizeof(net_err), "bad network %s",
+			    net);
+			*errstr = net_err;
+			free(copy);
+			return (-1);
+		}
+	free(copy);
+	return (0);
+}
+
+/*
+ * Return whether an address of the type of a token, AU_IPv4 or AU_IPv6, is
+ * in one of the networks.  An IPv4-mapped IPv6 address is looked up as the
+ * IPv4 address.
+ */
+int
+nettrie_match(const struct net_trie *nt, int type, const void *addr)
+{
+	const struct net_node *nn;
+	const u_char *a;
+	int bits, depth;
+
+	a = addr;
+	bits = 32;
+	if (type == AU_IPv6) {
+		if (memcmp(a, net_mapped, sizeof(net_mapped)) == 0 &&
+		    nettrie_match(nt, AU_IPv4, a + sizeof(net_mapped)))
+			return (1);
+		bits = 128;
+	}
+	depth = 0;
+	for (nn = nt->nt_root[bits == 128]; nn != NULL;
+	    nn = nn->nn_child[net_bit(a, nn->nn_len)]) {
+		if (net_diff(nn->nn_addr, a, depth, nn->nn_len) != nn->nn_len)
+			return (0);
+		if (nn->nn_term)
+			return (1);
+		if (nn->nn_len == bits)
+			return (0);
+		depth = nn->nn_len;
+	}
+	return (0);
+}
@@ -0,0 +1,1140 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Selection programs for auditreduce(1).  The selection options and filter
+ * expressions (-F) are compiled into tests of token fields, joined by and,
+ * or and not.  Each test knows the token types it examines, so that only
+ * those tests are run on a token; every token is still decoded by
+ * au_fetch_tok(3) to find the next.  A record is abandoned as soon as the
+ * tests decided so far reject it.
+ */
+
+#include <config/config.h>
+
+#define	_GNU_SOURCE		/* Required for strptime() on glibc2. */
+
+#ifdef HAVE_FULL_QUEUE_H
+#include <sys/queue.h>
+#else
+#include <compat/queue.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <bsm/libbsm.h>
+
+#include <ctype.h>
+#include <err.h>
+#include <fnmatch.h>
+#include <grp.h>
+#include <netdb.h>
+#include <pwd.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "auditreduce.h"
+
+/* State of a test while a record is examined. */
+#define	SS_UNKNOWN	0
+#define	SS_TRUE		1
+#define	SS_FALSE	2
+
+/*
+ * Token types examined by the fields of filter expressions, which accept
+ * every variant of a token.
+ */
+static const u_char	sel_hdr_types[] = { SEL_HDR_TYPES };
+static const u_char	sel_subj_types[] = { SEL_SUBJ_TYPES, SEL_PROC_TYPES };
+static const u_char	sel_ret_types[] = { SEL_RET_TYPES };
+static const u_char	sel_path_types[] = { AUT_PATH };
+static const u_char	sel_zone_types[] = { AUT_ZONENAME };
+static const u_char	sel_ip_types[] = { SEL_IP_TYPES };
+static const u_char	sel_port_types[] = { SEL_PORT_TYPES };
+
+static const struct sel_field {
+	const char	*sf_name;
+	int		 sf_field;
+	const u_char	*sf_types;
+	int		 sf_ntypes;
+} sel_fields[] = {
+	{ "event",	SF_EVENT,	sel_hdr_types,	SEL_NTYPES(sel_hdr_types) },
+	{ "class",	SF_CLASS,	sel_hdr_types,	SEL_NTYPES(sel_hdr_types) },
+	{ "time",	SF_TIME,	sel_hdr_types,	SEL_NTYPES(sel_hdr_types) },
+	{ "auid",	SF_AUID,	sel_subj_types,	SEL_NTYPES(sel_subj_types) },
+	{ "euid",	SF_EUID,	sel_subj_types,	SEL_NTYPES(sel_subj_types) },
+	{ "egid",	SF_EGID,	sel_subj_types,	SEL_NTYPES(sel_subj_types) },
+	{ "ruid",	SF_RUID,	sel_subj_types,	SEL_NTYPES(sel_subj_types) },
+	{ "rgid",	SF_RGID,	sel_subj_types,	SEL_NTYPES(sel_subj_types) },
+	{ "pid",	SF_PID,		sel_subj_types,	SEL_NTYPES(sel_subj_types) },
+	{ "return",	SF_RETURN,	sel_ret_types,	SEL_NTYPES(sel_ret_types) },
+	{ "path",	SF_PATH,	sel_path_types,	SEL_NTYPES(sel_path_types) },
+	{ "zone",	SF_ZONE,	sel_zone_types,	SEL_NTYPES(sel_zone_types) },
+	{ "ip",		SF_IP,		sel_ip_types,	SEL_NTYPES(sel_ip_types) },
+	{ "port",	SF_PORT,	sel_port_types,	SEL_NTYPES(sel_port_types) },
+	{ NULL,		0,		NULL,		0 }
+};
+
+static const struct sel_op {
+	const char	*so_name;
+	int		 so_op;		/* -1 for not equal. */
+} sel_ops[] = {
+	{ "==",	SO_EQ },
+	{ "!=",	-1 },
+	{ "<=",	SO_LE },
+	{ ">=",	SO_GE },
+	{ "=",	SO_EQ },
+	{ "<",	SO_LT },
+	{ ">",	SO_GT },
+	{ "~",	SO_MATCH },
+	{ NULL,	0 }
+};
+
+/* Header of the record being examined. */
+struct sel_rec {
+	int		sr_hdr;		/* Header seen. */
+	au_event_t	sr_event;
+	int64_t		sr_time;
+};
+
+struct sel_ids {
+	u_int32_t	auid;
+	u_int32_t	euid;
+	u_int32_t	egid;
+	u_int32_t	ruid;
+	u_int32_t	rgid;
+	u_int32_t	pid;
+};
+
+#define	SEL_IDS(ids, t) do {						\
+	(ids)->auid = (t).auid;						\
+	(ids)->euid = (t).euid;						\
+	(ids)->egid = (t).egid;						\
+	(ids)->ruid = (t).ruid;						\
+	(ids)->rgid = (t).rgid;						\
+	(ids)->pid = (t).pid;						\
+} while (0)
+
+struct sel_parse {
+	const char	*ps_p;
+	const char	*ps_err;
+};
+
+static struct sel_node	*sel_parse_or(struct sel_parse *ps);
+
+static void *
+sel_alloc(size_t size)
+{
+	void *p;
+
+	if ((p = calloc(1, size)) == NULL)
+		err(1, "calloc");
+	return (p);
+}
+
+/*
+ * Create a test of the given field, examining the given token types.
+ */
+struct sel_node *
+selprog_test(int field, int op, int quant, const u_char *types, int ntypes)
+{
+	struct sel_test *st;
+	struct sel_node *sn;
+
+	st = sel_alloc(sizeof(*st));
+	st->st_field = field;
+	st->st_op = op;
+	st->st_quant = quant;
+	st->st_types = types;
+	st->st_ntypes = ntypes;
+	TAILQ_INIT(&st->st_re);
+	sn = sel_alloc(sizeof(*sn));
+	sn->sn_type = SN_TEST;
+	sn->sn_test = st;
+	return (sn);
+}
+
+void
+selprog_value(struct sel_test *st, int64_t val)
+{
+
+	st->st_vals = realloc(st->st_vals, (st->st_nvals + 1) *
+	    sizeof(*st->st_vals));
+	if (st->st_vals == NULL)
+		err(1, "realloc");
+	st->st_vals[st->st_nvals++] = val;
+}
+
+struct sel_node *
+selprog_node(int type, struct sel_node *left, struct sel_node *right)
+{
+	struct sel_node *sn;
+
+	sn = sel_alloc(sizeof(*sn));
+	sn->sn_type = type;
+	sn->sn_left = left;
+	sn->sn_right = right;
+	return (sn);
+}
+
+/*
+ * Add a condition that every selected record has to meet.
+ */
+void
+selprog_and(struct sel_prog *sp, struct sel_node *sn)
+{
+
+	if (sp->sp_root == NULL)
+		sp->sp_root = sn;
+	else
+		sp->sp_root = selprog_node(SN_AND, sp->sp_root, sn);
+}
+
+static void
+sel_collect(struct sel_prog *sp, struct sel_node *sn)
+{
+
+	if (sn == NULL)
+		return;
+	if (sn->sn_type != SN_TEST) {
+		sel_collect(sp, sn->sn_left);
+		sel_collect(sp, sn->sn_right);
+		return;
+	}
+	sp->sp_tests = realloc(sp->sp_tests, (sp->sp_ntests + 1) *
+	    sizeof(*sp->sp_tests));
+	if (sp->sp_tests == NULL)
+		err(1, "realloc");
+	sp->sp_tests[sp->sp_ntests++] = sn->sn_test;
+}
+
+/*
+ * Index the tests of the program by the token types they examine, in the
+ * order they appear in it.
+ */
+void
+selprog_compile(struct sel_prog *sp)
+{
+	int count[256];
+	struct sel_test *st;
+	int i, j, t;
+
+	sel_collect(sp, sp->sp_root);
+	bzero(count, sizeof(count));
+	for (i = 0; i < sp->sp_ntests; i++)
+		for (j = 0; j < sp->sp_tests[i]->st_ntypes; j++)
+			count[sp->sp_tests[i]->st_types[j]]++;
+	for (t = 0; t < 256; t++)
+		if (count[t] != 0) {
+			sp->sp_bytype[t] = sel_alloc((count[t] + 1) *
+			    sizeof(*sp->sp_bytype[t]));
+			count[t] = 0;
+		}
+	for (i = 0; i < sp->sp_ntests; i++) {
+		st = sp->sp_tests[i];
+		for (j = 0; j < st->st_ntypes; j++) {
+			t = st->st_types[j];
+			sp->sp_bytype[t][count[t]++] = st;
+		}
+	}
+}
+
+/*
+ * Evaluate a node from the states of its tests, as far as they are known.
+ */
+static int
+sel_eval(struct sel_node *sn)
+{
+	int l, r;
+
+	switch (sn->sn_type) {
+	case SN_TEST:
+		return (sn->sn_test->st_state);
+
+	case SN_NOT:
+		l = sel_eval(sn->sn_left);
+		if (l == SS_UNKNOWN)
+			return (SS_UNKNOWN);
+		return (l == SS_TRUE ? SS_FALSE : SS_TRUE);
+
+	case SN_AND:
+		if ((l = sel_eval(sn->sn_left)) == SS_FALSE)
+			return (SS_FALSE);
+		if ((r = sel_eval(sn->sn_right)) == SS_FALSE)
+			return (SS_FALSE);
+		return (l == SS_TRUE && r == SS_TRUE ? SS_TRUE : SS_UNKNOWN);
+
+	case SN_OR:
+	default:
+		if ((l = sel_eval(sn->sn_left)) == SS_TRUE)
+			return (SS_TRUE);
+		if ((r = sel_eval(sn->sn_right)) == SS_TRUE)
+			return (SS_TRUE);
+		return (l == SS_FALSE && r == SS_FALSE ? SS_FALSE : SS_UNKNOWN);
+	}
+}
+
+static int
+sel_cmp(struct sel_test *st, int64_t v)
+{
+	int i;
+
+	switch (st->st_op) {
+	case SO_LT:
+		return (v < st->st_vals[0]);
+	case SO_LE:
+		return (v <= st->st_vals[0]);
+	case SO_GT:
+		return (v > st->st_vals[0]);
+	case SO_GE:
+		return (v >= st->st_vals[0]);
+	}
+	for (i = 0; i < st->st_nvals; i++)
+		if (v == st->st_vals[i])
+			return (1);
+	return (0);
+}
+
+static int
+sel_ids(tokenstr_t *tok, struct sel_ids *ids)
+{
+
+	switch (tok->id) {
+	case AUT_SUBJECT32:
+		SEL_IDS(ids, tok->tt.subj32);
+		break;
+	case AUT_SUBJECT32_EX:
+		SEL_IDS(ids, tok->tt.subj32_ex);
+		break;
+	case AUT_SUBJECT64:
+		SEL_IDS(ids, tok->tt.subj64);
+		break;
+	case AUT_SUBJECT64_EX:
+		SEL_IDS(ids, tok->tt.subj64_ex);
+		break;
+	case AUT_PROCESS32:
+		SEL_IDS(ids, tok->tt.proc32);
+		break;
+	case AUT_PROCESS32_EX:
+		SEL_IDS(ids, tok->tt.proc32_ex);
+		break;
+	case AUT_PROCESS64:
+		SEL_IDS(ids, tok->tt.proc64);
+		break;
+	case AUT_PROCESS64_EX:
+		SEL_IDS(ids, tok->tt.proc64_ex);
+		break;
+	default:
+		return (-1);
+	}
+	return (0);
+}
+
+static int
+sel_status(tokenstr_t *tok)
+{
+
+	if (tok->id == AUT_RETURN64)
+		return (tok->tt.ret64.err);
+	return (tok->tt.ret32.status);
+}
+
+static int
+sel_addr(struct sel_test *st, int type, const void *addr)
+{
+
+	return (nettrie_match(st->st_net, type, addr));
+}
+
+/* Ports are kept in network byte order, and only two bytes long. */
+static int
+sel_port(struct sel_test *st, const void *port)
+{
+	const u_char *p;
+
+	p = port;
+	return (sel_cmp(st, p[0] << 8 | p[1]));
+}
+
+/*
+ * Literal text every string matched by a path expression has to contain is
+ * found when it is compiled, so that most paths are passed over with a
+ * string search instead of running the expression.  The analysis is
+ * conservative: it only collects ordinary characters outside of groups and
+ * bracket expressions, and gives up on alternation.
+ */
+struct sel_lit {
+	char		*sl_run;	/* Characters since the last break. */
+	size_t		 sl_n;
+	char		*sl_best;	/* Longest run. */
+	size_t		 sl_bestlen;
+	char		*sl_prefix;	/* Run following the anchor. */
+	size_t		 sl_prefixlen;
+	int		 sl_nruns;
+	int		 sl_atstart;	/* No break since the anchor. */
+};
+
+static void
+sel_lit_break(struct sel_lit *sl)
+{
+
+	if (sl->sl_n > 0) {
+		if (sl->sl_atstart) {
+			memcpy(sl->sl_prefix, sl->sl_run, sl->sl_n);
+			sl->sl_prefixlen = sl->sl_n;
+		}
+		if (sl->sl_n > sl->sl_bestlen) {
+			memcpy(sl->sl_best, sl->sl_run, sl->sl_n);
+			sl->sl_bestlen = sl->sl_n;
+		}
+		sl->sl_nruns++;
+	}
+	sl->sl_n = 0;
+	sl->sl_atstart = 0;
+}
+
+/*
+ * Return the end of the bracket expression starting at p, or NULL.
+ */
+static const char *
+sel_lit_bracket(const char *p)
+{
+	const char *q;
+
+	p++;
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+	while (*p != ']') {
+		if (*p == '\0')
+			return (NULL);
+		if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+			for (q = p + 2; q[0] != '\0' && (q[0] != p[1] ||
+			    q[1] != ']'); q++)
+				;
+			if (*q == '\0')
+				return (NULL);
+			p = q + 2;
+		} else
+			p++;
+	}
+	return (p + 1);
+}
+
+void
+selprog_literal(struct re_entry *rep)
+{
+	struct sel_lit sl;
+	const char *p;
+	int anchored, depth, meta, optional;
+
+	bzero(&sl, sizeof(sl));
+	sl.sl_run = sel_alloc(strlen(rep->re_pattern) + 1);
+	sl.sl_best = sel_alloc(strlen(rep->re_pattern) + 1);
+	sl.sl_prefix = sel_alloc(strlen(rep->re_pattern) + 1);
+	p = rep->re_pattern;
+	anchored = (*p == '^');
+	if (anchored)
+		p++;
+	sl.sl_atstart = anchored;
+	depth = meta = 0;
+	while (*p != '\0') {
+		if (*p == '\\' && p[1] != '\0' &&
+		    strchr(".[]()*+?{}|^$\\", p[1]) != NULL) {
+			if (depth == 0)
+				sl.sl_run[sl.sl_n++] = p[1];
+			p += 2;
+			continue;
+		}
+		if (strchr(".[]()*+?{}|^$\\", *p) == NULL) {
+			if (depth == 0)
+				sl.sl_run[sl.sl_n++] = *p;
+			p++;
+			continue;
+		}
+		meta = 1;
+		switch (*p) {
+		case '*':
+		case '+':
+		case '?':
+		case '{':
+			/*
+			 * Unless only repeated, the character before may not
+			 * be there at all.
+			 */
+			optional = 0;
+			for (;; p++) {
+				if (*p == '{') {
+					optional = 1;
+					if ((p = strchr(p, '}')) == NULL)
+						goto none;
+				} else if (*p == '*' || *p == '?')
+					optional = 1;
+				else if (*p != '+')
+					break;
+			}
+			p--;
+			if (optional && sl.sl_n > 0)
+				sl.sl_n--;
+			break;
+
+		case '[':
+			if ((p = sel_lit_bracket(p)) == NULL)
+				goto none;
+			p--;
+			break;
+
+		case '(':
+			depth++;
+			break;
+
+		case ')':
+			if (--depth < 0)
+				goto none;
+			break;
+
+		case '|':
+			if (depth == 0)
+				goto none;
+			break;
+
+		case '\\':
+			if (p[1] != '\0')
+				p++;
+			break;
+		}
+		sel_lit_break(&sl);
+		p++;
+	}
+	sel_lit_break(&sl);
+
+	/*
+	 * The longest run is searched for unless it is the prefix, and a
+	 * pattern of a single run needs nothing more.
+	 */
+	if (sl.sl_prefixlen > 0) {
+		rep->re_prefix = sl.sl_prefix;
+		rep->re_prefixlen = sl.sl_prefixlen;
+		sl.sl_prefix = NULL;
+	}
+	if (sl.sl_bestlen > sl.sl_prefixlen) {
+		rep->re_literal = sl.sl_best;
+		sl.sl_best = NULL;
+	}
+	rep->re_exact = !meta && sl.sl_nruns == 1;
+none:
+	free(sl.sl_run);
+	free(sl.sl_best);
+	free(sl.sl_prefix);
+}
+
+static int
+sel_regexec(struct re_entry *rep, const char *path)
+{
+
+	if (rep->re_prefix != NULL &&
+	    strncmp(path, rep->re_prefix, rep->re_prefixlen) != 0)
+		return (0);
+	if (rep->re_literal != NULL && strstr(path, rep->re_literal) == NULL)
+		return (0);
+	if (rep->re_exact)
+		return (1);
+	return (regexec(&rep->re_regexp, path, 0, NULL, 0) != REG_NOMATCH);
+}
+
+/*
+ * Return whether a token passes a test, or -1 if the test does not apply to
+ * it.
+ */
+static int
+sel_token(struct sel_test *st, tokenstr_t *tok, struct sel_rec *sr)
+{
+	struct sel_ids ids;
+	struct re_entry *rep;
+	int sorf;
+
+	switch (st->st_field) {
+	case SF_PRESENT:
+		return (1);
+
+	case SF_EVENT:
+		return (sel_cmp(st, sr->sr_event));
+
+	case SF_TIME:
+		return (sel_cmp(st, sr->sr_time));
+
+	case SF_CLASS:
+		return (au_preselect(sr->sr_event, &st->st_mask, AU_PRS_BOTH,
+		    AU_PRS_USECACHE) == 1);
+
+	case SF_CLASSRET:
+		if (!sr->sr_hdr)
+			return (-1);
+		sorf = sel_status(tok) == 0 ? AU_PRS_SUCCESS : AU_PRS_FAILURE;
+		return (au_preselect(sr->sr_event, &st->st_mask, sorf,
+		    AU_PRS_USECACHE) == 1);
+
+	case SF_AUID:
+	case SF_EUID:
+	case SF_EGID:
+	case SF_RUID:
+	case SF_RGID:
+	case SF_PID:
+		if (sel_ids(tok, &ids) != 0)
+			return (-1);
+		switch (st->st_field) {
+		case SF_AUID:
+			return (sel_cmp(st, ids.auid));
+		case SF_EUID:
+			return (sel_cmp(st, ids.euid));
+		case SF_EGID:
+			return (sel_cmp(st, ids.egid));
+		case SF_RUID:
+			return (sel_cmp(st, ids.ruid));
+		case SF_RGID:
+			return (sel_cmp(st, ids.rgid));
+		default:
+			return (sel_cmp(st, ids.pid));
+		}
+
+	case SF_SUCCESS:
+		return (sel_cmp(st, sel_status(tok) == 0));
+
+	case SF_RETURN:
+		return (sel_cmp(st, sel_status(tok)));
+
+	case SF_PATH:
+		if (st->st_op == SO_EQ)
+			return (strcmp(tok->tt.path.path, st->st_str) == 0);
+		TAILQ_FOREACH(rep, &st->st_re, re_glue) {
+			if (sel_regexec(rep, tok->tt.path.path))
+				return (!rep->re_negate);
+		}
+		return (0);
+
+	case SF_ZONE:
+		return (fnmatch(st->st_str, tok->tt.zonename.zonename,
+		    FNM_PATHNAME) == 0);
+
+	case SF_IP:
+		switch (tok->id) {
+		case AUT_IN_ADDR:
+			return (sel_addr(st, AU_IPv4, &tok->tt.inaddr.addr));
+		case AUT_IN_ADDR_EX:
+			return (sel_addr(st, tok->tt.inaddr_ex.type,
+			    tok->tt.inaddr_ex.addr));
+		case AUT_IP:
+			return (sel_addr(st, AU_IPv4, &tok->tt.ip.src) ||
+			    sel_addr(st, AU_IPv4, &tok->tt.ip.dest));
+		case AUT_SOCKINET32:
+			return (sel_addr(st, AU_IPv4,
+			    tok->tt.sockinet_ex32.addr));
+		case AUT_SOCKINET128:
+			return (sel_addr(st, AU_IPv6,
+			    tok->tt.sockinet_ex32.addr));
+		case AUT_SOCKET_EX:
+			return (sel_addr(st, tok->tt.socket_ex32.atype,
+			    tok->tt.socket_ex32.l_addr) ||
+			    sel_addr(st, tok->tt.socket_ex32.atype,
+			    tok->tt.socket_ex32.r_addr));
+		}
+		return (-1);
+
+	case SF_PORT:
+		switch (tok->id) {
+		case AUT_IPORT:
+			return (sel_port(st, &tok->tt.iport.port));
+		case AUT_SOCKINET32:
+		case AUT_SOCKINET128:
+			return (sel_port(st, &tok->tt.sockinet_ex32.port));
+		case AUT_SOCKET_EX:
+			return (sel_port(st, &tok->tt.socket_ex32.l_port) ||
+			    sel_port(st, &tok->tt.socket_ex32.r_port));
+		}
+		return (-1);
+
+	case SF_IPCID:
+		if (tok->tt.ipc.type != st->st_ipctype)
+			return (-1);
+		return (sel_cmp(st, tok->tt.ipc.id));
+
+	case SF_IPCKNOWN:
+		return (tok->tt.ipc.type == AT_IPC_MSG ||
+		    tok->tt.ipc.type == AT_IPC_SEM ||
+		    tok->tt.ipc.type == AT_IPC_SHM);
+	}
+	return (-1);
+}
+
+/*
+ * Return 1 if a record is selected by the program, 0 if not, or -1 if it
+ * could not be decoded.  Tokens are fetched to find the next one, but only
+ * those of the types indexed are examined, each by the tests still
+ * undecided.  A record is given up once it is rejected; one selected is
+ * read to the end, so that an incomplete record is never selected.
+ */
+int
+selprog_run(struct sel_prog *sp, u_char *buf, int len)
+{
+	struct sel_test **stp, *st;
+	struct sel_rec sr;
+	tokenstr_t tok;
+	int bytesread, changed, i, r, result;
+
+	for (i = 0; i < sp->sp_ntests; i++) {
+		sp->sp_tests[i]->st_state = SS_UNKNOWN;
+		sp->sp_tests[i]->st_seen = 0;
+	}
+	sr.sr_hdr = 0;
+	sr.sr_event = 0;
+	sr.sr_time = 0;
+	result = (sp->sp_root == NULL) ? SS_TRUE : SS_UNKNOWN;
+	for (bytesread = 0; bytesread < len; bytesread += tok.len) {
+		if (au_fetch_tok(&tok, buf + bytesread, len - bytesread) == -1)
+			return (-1);
+		switch (tok.id) {
+		case AUT_HEADER32:
+			sr.sr_event = tok.tt.hdr32.e_type;
+			sr.sr_time = tok.tt.hdr32.s;
+			sr.sr_hdr = 1;
+			break;
+		case AUT_HEADER32_EX:
+			sr.sr_event = tok.tt.hdr32_ex.e_type;
+			sr.sr_time = tok.tt.hdr32_ex.s;
+			sr.sr_hdr = 1;
+			break;
+		case AUT_HEADER64:
+			sr.sr_event = tok.tt.hdr64.e_type;
+			sr.sr_time = tok.tt.hdr64.s;
+			sr.sr_hdr = 1;
+			break;
+		case AUT_HEADER64_EX:
+			sr.sr_event = tok.tt.hdr64_ex.e_type;
+			sr.sr_time = tok.tt.hdr64_ex.s;
+			sr.sr_hdr = 1;
+			break;
+		}
+		if (result != SS_UNKNOWN ||
+		    (stp = sp->sp_bytype[tok.id]) == NULL)
+			continue;
+		changed = 0;
+		for (; (st = *stp) != NULL; stp++) {
+			if (st->st_state != SS_UNKNOWN)
+				continue;
+			if ((r = sel_token(st, &tok, &sr)) == -1)
+				continue;
+			st->st_seen = 1;
+			if (st->st_quant == SQ_ANY ? r : !r) {
+				st->st_state = r ? SS_TRUE : SS_FALSE;
+				changed = 1;
+			}
+		}
+		if (changed && (result = sel_eval(sp->sp_root)) == SS_FALSE)
+			return (0);
+	}
+	if (result != SS_UNKNOWN)
+		return (result == SS_TRUE);
+
+	/* Decide the tests still waiting for a token. */
+	for (i = 0; i < sp->sp_ntests; i++) {
+		st = sp->sp_tests[i];
+		if (st->st_state != SS_UNKNOWN)
+			continue;
+		if (st->st_quant == SQ_ANY ||
+		    (st->st_quant == SQ_ALL && !st->st_seen))
+			st->st_state = SS_FALSE;
+		else
+			st->st_state = SS_TRUE;
+	}
+	return (sel_eval(sp->sp_root) == SS_TRUE);
+}
+
+static void
+sel_skip(struct sel_parse *ps)
+{
+
+	while (isspace((u_char)*ps->ps_p))
+		ps->ps_p++;
+}
+
+/*
+ * Consume a keyword or operator if it comes next.
+ */
+static int
+sel_accept(struct sel_parse *ps, const char *word)
+{
+	size_t len;
+
+	sel_skip(ps);
+	len = strlen(word);
+	if (strncmp(ps->ps_p, word, len) != 0)
+		return (0);
+	if (isalpha((u_char)word[0]) && (isalnum((u_char)ps->ps_p[len]) ||
+	    ps->ps_p[len] == '_'))
+		return (0);
+	ps->ps_p += len;
+	return (1);
+}
+
+/*
+ * A value is a quoted string, in which \" and \\ stand for " and \, or runs
+ * up to white space or a parenthesis.
+ */
+static char *
+sel_parse_value(struct sel_parse *ps)
+{
+	const char *p;
+	char *v, *value;
+
+	sel_skip(ps);
+	p = ps->ps_p;
+	value = v = sel_alloc(strlen(p) + 1);
+	if (*p == '"') {
+		for (p++; *p != '"'; p++) {
+			if (*p == '\0') {
+				ps->ps_err = "unterminated string";
+				free(value);
+				return (NULL);
+			}
+			if (*p == '\\' && (p[1] == '"' || p[1] == '\\'))
+				p++;
+			*v++ = *p;
+		}
+		p++;
+	} else {
+		while (*p != '\0' && !isspace((u_char)*p) && *p != '(' &&
+		    *p != ')')
+			*v++ = *p++;
+		if (v == value) {
+			ps->ps_err = "expected a value";
+			free(value);
+			return (NULL);
+		}
+	}
+	*v = '\0';
+	ps->ps_p = p;
+	return (value);
+}
+
+/*
+ * Convert one value of a numeric field: a number, or the name of an event,
+ * user or group, or a time as YYYYMMDD[HH[MM[SS]]].
+ */
+static int
+sel_number(int field, const char *s, int64_t *vp)
+{
+	struct group *gr;
+	struct passwd *pw;
+	struct servent *se;
+	au_event_t *ev;
+	struct tm tm;
+	char *end;
+	size_t len;
+	long long n;
+
+	if (field == SF_TIME) {
+		len = strspn(s, "0123456789");
+		if (s[len] != '\0' || len < 8 || len > 14 || len % 2 != 0)
+			return (-1);
+		bzero(&tm, sizeof(tm));
+		strptime(s, "%Y%m%d%H%M%S", &tm);
+		*vp = mktime(&tm);
+		return (0);
+	}
+	n = strtoll(s, &end, 10);
+	if (*s != '\0' && *end == '\0') {
+		*vp = (field == SF_RETURN) ? n : (u_int32_t)n;
+		return (0);
+	}
+	switch (field) {
+	case SF_EVENT:
+		if ((ev = getauevnonam(s)) == NULL)
+			return (-1);
+		*vp = *ev;
+		return (0);
+
+	case SF_AUID:
+	case SF_EUID:
+	case SF_RUID:
+		if ((pw = getpwnam(s)) == NULL)
+			return (-1);
+		*vp = pw->pw_uid;
+		return (0);
+
+	case SF_EGID:
+	case SF_RGID:
+		if ((gr = getgrnam(s)) == NULL)
+			return (-1);
+		*vp = gr->gr_gid;
+		return (0);
+
+	case SF_PORT:
+		if ((se = getservbyname(s, NULL)) == NULL)
+			return (-1);
+		*vp = ntohs(se->s_port);
+		return (0);
+	}
+	return (-1);
+}
+
+/*
+ * Compile a comparison of a field with a value.  "!=" is compiled as the
+ * negation of "=", so that it holds of records without the field.
+ */
+static struct sel_node *
+sel_compare(struct sel_parse *ps, const struct sel_field *sf, int op,
+    char *value)
+{
+	struct sel_node *sn, *rn;
+	struct sel_test *st;
+	struct re_entry *rep;
+	char re_error[64], *last, *s;
+	int64_t v;
+	int error, negate;
+
+	negate = (op == -1);
+	if (negate)
+		op = SO_EQ;
+	if (op == SO_MATCH && sf->sf_field != SF_PATH) {
+		ps->ps_err = "~ only applies to path";
+		return (NULL);
+	}
+	if (op != SO_EQ && op != SO_MATCH && (sf->sf_field == SF_CLASS ||
+	    sf->sf_field == SF_PATH || sf->sf_field == SF_ZONE ||
+	    sf->sf_field == SF_IP)) {
+		ps->ps_err = "field cannot be ordered";
+		return (NULL);
+	}
+	sn = selprog_test(sf->sf_field, op, SQ_ANY, sf->sf_types,
+	    sf->sf_ntypes);
+	st = sn->sn_test;
+	switch (sf->sf_field) {
+	case SF_CLASS:
+		/* As -c, the class applies to the outcome of the event. */
+		if (getauditflagsbin(value, &st->st_mask) != 0) {
+			ps->ps_err = "unknown class";
+			return (NULL);
+		}
+		rn = selprog_test(SF_CLASSRET, SO_EQ, SQ_EACH, sel_ret_types,
+		    SEL_NTYPES(sel_ret_types));
+		rn->sn_test->st_mask = st->st_mask;
+		sn = selprog_node(SN_AND, sn, rn);
+		break;
+
+	case SF_PATH:
+		if (op == SO_EQ) {
+			st->st_str = strdup(value);
+			if (st->st_str == NULL)
+				err(1, "strdup");
+			break;
+		}
+		rep = sel_alloc(sizeof(*rep));
+		if ((rep->re_pattern = strdup(value)) == NULL)
+			err(1, "strdup");
+		error = regcomp(&rep->re_regexp, rep->re_pattern,
+		    REG_EXTENDED | REG_NOSUB);
+		if (error != 0) {
+			regerror(error, &rep->re_regexp, re_error,
+			    sizeof(re_error));
+			errx(1, "regcomp: %s", re_error);
+		}
+		selprog_literal(rep);
+		TAILQ_INSERT_TAIL(&st->st_re, rep, re_glue);
+		break;
+
+	case SF_ZONE:
+		if ((st->st_str = strdup(value)) == NULL)
+			err(1, "strdup");
+		break;
+
+	case SF_IP:
+		st->st_net = nettrie_alloc();
+		if (nettrie_addlist(st->st_net, value, &ps->ps_err) != 0)
+			return (NULL);
+		break;
+
+	case SF_RETURN:
+		if (strcmp(value, "success") == 0 ||
+		    strcmp(value, "failure") == 0) {
+			if (op != SO_EQ) {
+				ps->ps_err = "field cannot be ordered";
+				return (NULL);
+			}
+			st->st_field = SF_SUCCESS;
+			selprog_value(st, value[0] == 's');
+			break;
+		}
+		/* FALLTHROUGH */
+	default:
+		last = NULL;
+		for (s = strtok_r(value, ",", &last); s != NULL;
+		    s = strtok_r(NULL, ",", &last)) {
+			if (sel_number(sf->sf_field, s, &v) != 0) {
+				ps->ps_err = "bad value";
+				return (NULL);
+			}
+			selprog_value(st, v);
+		}
+		if (st->st_nvals == 0 || (op != SO_EQ && st->st_nvals > 1)) {
+			ps->ps_err = "bad value";
+			return (NULL);
+		}
+		break;
+	}
+	if (negate)
+		sn = selprog_node(SN_NOT, sn, NULL);
+	return (sn);
+}
+
+static struct sel_node *
+sel_parse_cmp(struct sel_parse *ps)
+{
+	const struct sel_field *sf;
+	const struct sel_op *so;
+	struct sel_node *sn;
+	const char *p;
+	char *value;
+	size_t len;
+
+	sel_skip(ps);
+	for (len = 0; isalpha((u_char)ps->ps_p[len]); len++)
+		;
+	for (sf = sel_fields; sf->sf_name != NULL; sf++)
+		if (strlen(sf->sf_name) == len &&
+		    strncmp(sf->sf_name, ps->ps_p, len) == 0)
+			break;
+	if (sf->sf_name == NULL) {
+		ps->ps_err = (len == 0) ? "expected a field" : "unknown field";
+		return (NULL);
+	}
+	ps->ps_p += len;
+	for (so = sel_ops; so->so_name != NULL; so++)
+		if (sel_accept(ps, so->so_name))
+			break;
+	if (so->so_name == NULL) {
+		ps->ps_err = "expected a comparison";
+		return (NULL);
+	}
+	sel_skip(ps);
+	p = ps->ps_p;
+	if ((value = sel_parse_value(ps)) == NULL)
+		return (NULL);
+	if ((sn = sel_compare(ps, sf, so->so_op, value)) == NULL)
+		ps->ps_p = p;
+	free(value);
+	return (sn);
+}
+
+static struct sel_node *
+sel_parse_not(struct sel_parse *ps)
+{
+	struct sel_node *sn;
+
+	if (sel_accept(ps, "not") || sel_accept(ps, "!")) {
+		if ((sn = sel_parse_not(ps)) == NULL)
+			return (NULL);
+		return (selprog_node(SN_NOT, sn, NULL));
+	}
+	if (sel_accept(ps, "(")) {
+		if ((sn = sel_parse_or(ps)) == NULL)
+			return (NULL);
+		if (!sel_accept(ps, ")")) {
+			ps->ps_err = "expected ')'";
+			return (NULL);
+		}
+		return (sn);
+	}
+	return (sel_parse_cmp(ps));
+}
+
+static struct sel_node *
+sel_parse_and(struct sel_parse *ps)
+{
+	struct sel_node *left, *right;
+
+	if ((left = sel_parse_not(ps)) == NULL)
+		return (NULL);
+	while (sel_accept(ps, "and") || sel_accept(ps, "&&")) {
+		if ((right = sel_parse_not(ps)) == NULL)
+			return (NULL);
+		left = selprog_node(SN_AND, left, right);
+	}
+	return (left);
+}
+
+static struct sel_node *
+sel_parse_or(struct sel_parse *ps)
+{
+	struct sel_node *left, *right;
+
+	if ((left = sel_parse_and(ps)) == NULL)
+		return (NULL);
+	while (sel_accept(ps, "or") || sel_accept(ps, "||")) {
+		if ((right = sel_parse_and(ps)) == NULL)
+			return (NULL);
+		left = selprog_node(SN_OR, left, right);
+	}
+	return (left);
+}
+
+/*
+ * Parse a filter expression.  On error, NULL is returned and *errstr is set
+ * to a message pointing at where parsing stopped.
+ */
+struct sel_node *
+selprog_parse(const char *expr, const char **errstr)
+{
+	static char errbuf[128];
+	struct sel_parse ps;
+	struct sel_node *sn;
+
+	ps.ps_p = expr;
+	ps.ps_err = NULL;
+	sn = sel_parse_or(&ps);
+	if (sn != NULL) {
+		sel_skip(&ps);
+		if (*ps.ps_p != '\0') {
+			ps.ps_err = "unexpected text";
+			sn = NULL;
+		}
+	}
+	if (sn == NULL) {
+		if (*ps.ps_p == '\0')
+			snprintf(errbuf, sizeof(errbuf), "%s at end",
+			    ps.ps_err);
+		else
+			snprintf(errbuf, sizeof(errbuf), "%s at \"%.32s\"",
+			    ps.ps_err, ps.ps_p);
+		*errstr = errbuf;
+	}
+	return (sn);
+}
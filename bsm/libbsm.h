@@ -79,6 +79,7 @@
 #define	AUDIT_CLASS_FILE	"/etc/security/audit_class"
 #define	AUDIT_CONTROL_FILE	"/etc/security/audit_control"
 #define	AUDIT_USER_FILE		"/etc/security/audit_user"
+#define	AUDIT_DB_FILE		"/etc/security/audit.db"
 
 #define	DIR_CONTROL_ENTRY		"dir"
 #define	DIST_CONTROL_ENTRY		"dist"
@@ -102,6 +103,21 @@
 
 #define USE_DEFAULT_QSZ		-1	/* Use system default queue size */
 
+/*
+ * Bits of ac_valid in struct au_control, set for each entry present in
+ * audit_control and successfully parsed.
+ */
+#define	AU_CONTROL_DIR		0x0001
+#define	AU_CONTROL_DIST		0x0002
+#define	AU_CONTROL_EXPIRE	0x0004
+#define	AU_CONTROL_FILESZ	0x0008
+#define	AU_CONTROL_FLAGS	0x0010
+#define	AU_CONTROL_HOST		0x0020
+#define	AU_CONTROL_MINFREE	0x0040
+#define	AU_CONTROL_NAFLAGS	0x0080
+#define	AU_CONTROL_POLICY	0x0100
+#define	AU_CONTROL_QSIZE	0x0200
+
 /*
  * Arguments to au_close(3).
  */
@@ -139,6 +155,24 @@ struct au_user_ent {
 	au_mask_t	 au_never;
 };
 typedef struct au_user_ent au_user_ent_t;
+
+struct au_control {
+	u_int		  ac_valid;	/* AU_CONTROL_* */
+	int		  ac_ndirs;
+	const char	**ac_dirs;
+	int		  ac_dist;
+	int		  ac_expire_and;
+	time_t		  ac_expire_age;
+	size_t		  ac_expire_size;
+	size_t		  ac_filesz;
+	const char	 *ac_flags;
+	const char	 *ac_host;
+	int		  ac_minfree;
+	const char	 *ac_naflags;
+	int		  ac_policy;
+	int		  ac_qsize;
+};
+typedef struct au_control au_control_t;
 __END_DECLS
 
 #define	ADD_TO_MASK(m, c, sel) do {					\
@@ -824,9 +858,105 @@ struct tokenstr {
 
 typedef struct tokenstr tokenstr_t;
 
+/*
+ * Fields common to most records, gathered by au_rec_summary() from any
+ * variant of the tokens holding them.  ars_flags tells which were found.
+ */
+#define	AU_RECSUM_HEADER	0x0001
+#define	AU_RECSUM_SUBJECT	0x0002	/* From a subject token. */
+#define	AU_RECSUM_PROCESS	0x0004	/* From a process token instead. */
+#define	AU_RECSUM_RETURN	0x0008
+#define	AU_RECSUM_PATH		0x0010
+
+typedef struct au_rec_summary {
+	u_int64_t	 ars_sec;
+	u_int64_t	 ars_msec;
+	u_int64_t	 ars_port;	/* Terminal of the subject. */
+	u_int64_t	 ars_retval;
+	const char	*ars_path;	/* Within the record. */
+	u_int32_t	 ars_flags;
+	au_id_t		 ars_auid;
+	uid_t		 ars_euid;
+	gid_t		 ars_egid;
+	uid_t		 ars_ruid;
+	gid_t		 ars_rgid;
+	pid_t		 ars_pid;
+	au_asid_t	 ars_sid;
+	u_int32_t	 ars_ttype;	/* AU_IPv4 or AU_IPv6. */
+	u_int32_t	 ars_taddr[4];
+	au_event_t	 ars_event;
+	au_emod_t	 ars_emod;
+	u_int16_t	 ars_pathlen;
+	u_char		 ars_status;
+} au_rec_summary_t;
+
 int			 audit_submit(short au_event, au_id_t auid,
 			    char status, int reterr, const char *fmt, ...);
 
+/*
+ * Pre-encoded subject for high-rate callers of audit_submit(); the contents
+ * are private to libbsm.
+ */
+typedef struct au_prepared_subject	au_prepared_subject_t;
+
+au_prepared_subject_t	*audit_prepare_subject(au_id_t auid);
+void			 audit_free_prepared_subject(
+			    au_prepared_subject_t *aps);
+int			 audit_submit_prepared(
+			    const au_prepared_subject_t *aps,
+			    short au_event, char status, int reterr,
+			    const char *fmt, ...);
+int			 audit_submit_ratelimit(short au_event, u_int rate,
+			    u_int burst, u_int sample);
+int			 audit_submit_suppressed(short au_event,
+			    u_int64_t *suppressedp);
+
+/*
+ * Record templates for events with a fixed sequence of tokens; the layout
+ * is computed once by au_template_create() and each record is then encoded
+ * from an array of slot values, one per token, in template order.
+ */
+#define	AU_TEMPLATE_MAXSLOTS	16
+
+typedef struct au_template	au_template_t;
+
+typedef union au_tmpl_val {
+	const char	*tv_str;	/* AUT_TEXT, AUT_PATH, AUT_ZONENAME */
+	struct {
+		au_id_t		 auid;
+		uid_t		 euid;
+		gid_t		 egid;
+		uid_t		 ruid;
+		gid_t		 rgid;
+		pid_t		 pid;
+		au_asid_t	 sid;
+		au_tid_t	 tid;
+	} tv_subj;			/* AUT_SUBJECT32, AUT_PROCESS32 */
+	struct {
+		char		 status;
+		u_int64_t	 ret;
+	} tv_ret;			/* AUT_RETURN32, AUT_RETURN64 */
+	struct {
+		char		 no;
+		u_int64_t	 val;
+		const char	*text;
+	} tv_arg;			/* AUT_ARG32, AUT_ARG64 */
+	struct {
+		int		 retval;
+		int		 err;
+	} tv_exit;			/* AUT_EXIT */
+	u_int16_t	 tv_iport;	/* AUT_IPORT */
+} au_tmpl_val_t;
+
+au_template_t		*au_template_create(au_event_t event, au_emod_t emod,
+			    const u_char *types, int ntypes);
+void			 au_template_free(au_template_t *tmpl);
+int			 au_template_close(const au_template_t *tmpl,
+			    const au_tmpl_val_t *vals);
+int			 au_template_close_buffer(const au_template_t *tmpl,
+			    const au_tmpl_val_t *vals, u_char *buffer,
+			    size_t *buflen);
+
 /*
  * Functions relating to querying audit class information.
  */
@@ -856,11 +986,16 @@ int			 getachost(char *auditstr, size_t len);
 int			 getacmin(int *min_val);
 int			 getacna(char *auditstr, int len);
 int			 getacpol(char *auditstr, size_t len);
+const au_control_t	*au_control_get(void);
+void			 au_control_release(const au_control_t *ac);
 int			 getauditflagsbin(char *auditstr, au_mask_t *masks);
 int			 getauditflagschar(char *auditstr, au_mask_t *masks,
 			    int verbose);
 int			 au_preselect(au_event_t event, au_mask_t *mask_p,
 			    int sorf, int flag);
+int			 au_preselect_many(const au_event_t *events,
+			    const int *sorf, int *results, int count,
+			    au_mask_t *mask_p, int flag);
 ssize_t			 au_poltostr(int policy, size_t maxsize, char *buf);
 int			 au_strtopol(const char *polstr, int *policy);
 
@@ -881,6 +1016,17 @@ au_event_t		*getauevnonam(const char *event_name);
 au_event_t		*getauevnonam_r(au_event_t *ev,
 			    const char *event_name);
 
+/*
+ * Compile the audit_event, audit_class and audit_user files into the binary
+ * database used in their place while they are unchanged.
+ */
+int			 au_compile_db(const char *path);
+
+/*
+ * Reload the audit configuration files in the background when they change.
+ */
+int			 au_autoreload(int enable);
+
 /*
  * Functions relating to querying audit user information.
  */
@@ -900,6 +1046,8 @@ int			 getfauditflags(au_mask_t *usremask,
  */
 int			 au_read_rec(FILE *fp, u_char **buf);
 int			 au_fetch_tok(tokenstr_t *tok, u_char *buf, int len);
+int			 au_rec_summary(u_char *buf, int len,
+			    au_rec_summary_t *ars);
 //XXX The following interface has different prototype from BSM
 void			 au_print_tok(FILE *outfp, tokenstr_t *tok,
 			    char *del, char raw, char sfrm);
@@ -908,6 +1056,18 @@ void			 au_print_flags_tok(FILE *outfp, tokenstr_t *tok,
 void			 au_print_tok_xml(FILE *outfp, tokenstr_t *tok,
 			    char *del, char raw, char sfrm);
 
+/*
+ * Sets of audit trails read as one, in the order of record times.
+ */
+#define	AU_TRAILSET_PREOPEN	0x0001	/* Keep every trail open. */
+
+typedef struct au_trailset	au_trailset_t;
+
+au_trailset_t		*au_trailset_open(int flags, int maxopen);
+int			 au_trailset_add(au_trailset_t *ts, const char *path);
+int			 au_trailset_read(au_trailset_t *ts, u_char **buf);
+void			 au_trailset_close(au_trailset_t *ts);
+
 /* 
  * Functions relating to XML output.
  */
@@ -0,0 +1,354 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Push the event-to-class and event-to-name mappings of audit_event(5) into
+ * the kernel.  The mappings last pushed are remembered, so that after the
+ * first call only those that have changed are pushed again, and the class
+ * of an event removed from the file is cleared rather than left in place.
+ * Mappings are set through a back end, which may set many in one call where
+ * the kernel allows; the kernel back end sets them one auditon(2) call at a
+ * time, as no kernel yet takes them in bulk.
+ */
+
+#include <sys/types.h>
+
+#include <config/config.h>
+
+#include <bsm/audit.h>
+#include <bsm/auditd_lib.h>
+#include <bsm/libbsm.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef HAVE_STRLCPY
+#include <compat/strlcpy.h>
+#endif
+
+#include "auditd_evcmap.h"
+
+static void
+auditd_evcmap_kernel_class(void *arg, const au_evclass_map_t *evc,
+    int *error, int n)
+{
+	au_evclass_map_t evc_map;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		evc_map = evc[i];
+		error[i] = audit_set_class(&evc_map, sizeof(evc_map)) == 0 ?
+		    0 : errno;
+	}
+}
+
+static void
+auditd_evcmap_kernel_event(void *arg, const au_evname_map_t *evn,
+    int *error, int n)
+{
+	au_evname_map_t evn_map;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		evn_map = evn[i];
+		error[i] = audit_set_event(&evn_map, sizeof(evn_map)) == 0 ?
+		    0 : errno;
+	}
+}
+
+const struct auditd_evcmap_backend auditd_evcmap_kernel = {
+	.eb_set_class = auditd_evcmap_kernel_class,
+	.eb_set_event = auditd_evcmap_kernel_event,
+};
+
+/*
+ * Read the events of audit_event(5), in file order, into an array to be
+ * freed by the caller.  Return the number of events, or ADE_NOMEM.
+ */
+int
+auditd_evcmap_read(struct auditd_evcmap_ent **entp)
+{
+	struct auditd_evcmap_ent *ee, *ent;
+	au_event_ent_t ev, *evp;
+	int nent, size;
+
+	/*
+	 * XXX There's a risk here that the BSM library will return NULL
+	 * for an event when it can't properly map it to a class. In that
+	 * case, we will not process any events beyond the one that failed,
+	 * but should. We need a way to get a count of the events.
+	 */
+	ev.ae_name = (char *)malloc(AU_EVENT_NAME_MAX);
+	ev.ae_desc = (char *)malloc(AU_EVENT_DESC_MAX);
+	if (ev.ae_name == NULL || ev.ae_desc == NULL) {
+		if (ev.ae_name != NULL)
+			free(ev.ae_name);
+		return (ADE_NOMEM);
+	}
+
+	ent = NULL;
+	nent = size = 0;
+	evp = &ev;
+	setauevent();
+	while ((evp = getauevent_r(evp)) != NULL) {
+		if (nent == size) {
+			size = size == 0 ? 512 : size * 2;
+			ee = realloc(ent, size * sizeof(*ent));
+			if (ee == NULL) {
+				free(ent);
+				ent = NULL;
+				break;
+			}
+			ent = ee;
+		}
+		ee = &ent[nent++];
+		ee->ee_number = evp->ae_number;
+		ee->ee_class = evp->ae_class;
+		ee->ee_flags = 0;
+
+		/*
+		 * If there's not room in the in-kernel string, the name is
+		 * not set.  Possibly better than truncating...?
+		 */
+		if (strlcpy(ee->ee_name, evp->ae_name, sizeof(ee->ee_name)) >=
+		    sizeof(ee->ee_name))
+			ee->ee_flags = EE_NAME_LONG;
+	}
+	endauevent();
+	free(ev.ae_name);
+	free(ev.ae_desc);
+	if (ent == NULL && size != 0)
+		return (ADE_NOMEM);
+	*entp = ent;
+	return (nent);
+}
+
+static int
+auditd_evcmap_cmp(const void *a, const void *b)
+{
+	const struct auditd_evcmap_ent *ea = a, *eb = b;
+
+	if (ea->ee_number != eb->ee_number)
+		return (ea->ee_number < eb->ee_number ? -1 : 1);
+	return (ea->ee_seq - eb->ee_seq);
+}
+
+/*
+ * Bring the mappings in 'em' up to date with the 'nent' events in 'ent',
+ * in file order, pushing through 'eb' only those that differ.  'ent' is
+ * consumed.  Return:
+ *	 n	number of events whose class mapping is in place,
+ *   ADE_NOMEM	if there was an error allocating memory.
+ */
+int
+auditd_evcmap_sync(struct auditd_evcmap *em,
+    const struct auditd_evcmap_backend *eb, struct auditd_evcmap_ent *ent,
+    int nent)
+{
+	struct auditd_evcmap_ent *ee, *next, *oe;
+	au_evclass_map_t *evc;
+	au_evname_map_t *evn;
+	int *error, *evcent, *evnent;
+	int ctr, i, j, k, n, nevc, nevn, oflags;
+
+	/*
+	 * Of several entries for one event, the kernel used to be left with
+	 * the last, so keep that one.
+	 */
+	for (i = 0; i < nent; i++)
+		ent[i].ee_seq = i;
+	if (nent > 0)
+		qsort(ent, nent, sizeof(*ent), auditd_evcmap_cmp);
+	for (i = j = 0; i < nent; i++)
+		if (i + 1 == nent || ent[i + 1].ee_number != ent[i].ee_number)
+			ent[j++] = ent[i];
+	nent = j;
+
+	n = nent + em->em_nent + 1;
+	next = calloc(n, sizeof(*next));
+	evc = calloc(n, sizeof(*evc));
+	evn = calloc(n, sizeof(*evn));
+	evcent = calloc(n, sizeof(*evcent));
+	evnent = calloc(n, sizeof(*evnent));
+	error = calloc(n, sizeof(*error));
+	if (next == NULL || evc == NULL || evn == NULL || evcent == NULL ||
+	    evnent == NULL || error == NULL) {
+		free(next);
+		ctr = ADE_NOMEM;
+		goto out;
+	}
+
+	/*
+	 * Merge the new events with those last pushed, queueing the mappings
+	 * that are not already in place.
+	 */
+	i = j = k = nevc = nevn = 0;
+	while (i < nent || j < em->em_nent) {
+		if (j == em->em_nent || (i < nent &&
+		    ent[i].ee_number < em->em_ent[j].ee_number)) {
+			ee = &ent[i++];
+			oe = NULL;
+		} else if (i == nent ||
+		    ent[i].ee_number > em->em_ent[j].ee_number) {
+			ee = NULL;
+			oe = &em->em_ent[j++];
+		} else {
+			ee = &ent[i++];
+			oe = &em->em_ent[j++];
+		}
+
+		/*
+		 * The class of an event whose removal failed is still in
+		 * place, but is not the one recorded.
+		 */
+		oflags = 0;
+		if (oe != NULL)
+			oflags = (oe->ee_flags & EE_REMOVED) ? EE_REMOVED :
+			    oe->ee_flags;
+
+		if (ee == NULL) {
+			/*
+			 * Removed from the file: clear its class, if one was
+			 * set, and keep it until that succeeds.
+			 */
+			if (!(oflags & EE_REMOVED) &&
+			    (!(oflags & EE_CLASS_SET) || oe->ee_class == 0))
+				continue;
+			next[k] = *oe;
+			next[k].ee_class = 0;
+			next[k].ee_flags = EE_REMOVED;
+			evc[nevc].ec_number = oe->ee_number;
+			evc[nevc].ec_class = 0;
+			evcent[nevc++] = k++;
+			continue;
+		}
+
+		next[k] = *ee;
+		next[k].ee_flags &= EE_NAME_LONG;
+		if (oe != NULL) {
+			if ((oflags & EE_CLASS_SET) &&
+			    oe->ee_class == ee->ee_class)
+				next[k].ee_flags |= EE_CLASS_SET;
+			if ((oflags & EE_NAME_SET) &&
+			    !(ee->ee_flags & EE_NAME_LONG) &&
+			    strcmp(oe->ee_name, ee->ee_name) == 0)
+				next[k].ee_flags |= EE_NAME_SET;
+		}
+		if (!(next[k].ee_flags & (EE_NAME_SET | EE_NAME_LONG))) {
+			evn[nevn].en_number = ee->ee_number;
+			strlcpy(evn[nevn].en_name, ee->ee_name,
+			    sizeof(evn[nevn].en_name));
+			evnent[nevn++] = k;
+		}
+		if (!(next[k].ee_flags & EE_CLASS_SET)) {
+			evc[nevc].ec_number = ee->ee_number;
+			evc[nevc].ec_class = ee->ee_class;
+			evcent[nevc++] = k;
+		}
+		k++;
+	}
+
+	/*
+	 * Set the names first, as was always done.  Failures there are
+	 * ignored as not all kernels support the feature.
+	 */
+	if (nevn > 0) {
+		eb->eb_set_event(eb->eb_arg, evn, error, nevn);
+		for (i = 0; i < nevn; i++)
+			if (error[i] == 0)
+				next[evnent[i]].ee_flags |= EE_NAME_SET;
+	}
+	if (nevc > 0) {
+		eb->eb_set_class(eb->eb_arg, evc, error, nevc);
+		for (i = 0; i < nevc; i++)
+			if (error[i] == 0)
+				next[evcent[i]].ee_flags |= EE_CLASS_SET;
+	}
+
+	/* Forget the removed events whose class has been cleared. */
+	ctr = 0;
+	for (i = j = 0; i < k; i++) {
+		if ((next[i].ee_flags & (EE_REMOVED | EE_CLASS_SET)) ==
+		    (EE_REMOVED | EE_CLASS_SET))
+			continue;
+		if (next[i].ee_flags & EE_CLASS_SET)
+			ctr++;
+		next[j++] = next[i];
+	}
+	free(em->em_ent);
+	em->em_ent = next;
+	em->em_nent = j;
+
+out:
+	free(evc);
+	free(evn);
+	free(evcent);
+	free(evnent);
+	free(error);
+	free(ent);
+	return (ctr);
+}
+
+void
+auditd_evcmap_free(struct auditd_evcmap *em)
+{
+
+	free(em->em_ent);
+	em->em_ent = NULL;
+	em->em_nent = 0;
+}
+
+/*
+ * The mappings set by auditd_set_evcmap().
+ */
+static struct auditd_evcmap	auditd_evcmap;
+
+/*
+ * Process the audit event file, obtaining a class mapping for each event, and
+ * set that mapping into the kernel. Return:
+ *	 n	number of event mappings that were successfully processed,
+ *   ADE_NOMEM	if there was an error allocating memory.
+ *
+ * Historically, this code only set up the in-kernel class mapping.  On
+ * systems with an in-kernel event-to-name mapping, it also now installs that,
+ * as it is iterating over the event list anyway.  Failures there will be
+ * ignored as not all kernels support the feature.
+ *
+ * Only the mappings that differ from those set by the previous call are set
+ * again, and the class of an event no longer in the file is cleared.
+ */
+int
+auditd_set_evcmap(void)
+{
+	struct auditd_evcmap_ent *ent;
+	int nent;
+
+	if ((nent = auditd_evcmap_read(&ent)) < 0)
+		return (nent);
+	return (auditd_evcmap_sync(&auditd_evcmap, &auditd_evcmap_kernel, ent,
+	    nent));
+}
@@ -0,0 +1,81 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LIBAUDITD_AUDITD_EVCMAP_H_
+#define	_LIBAUDITD_AUDITD_EVCMAP_H_
+
+/*
+ * Private interface between auditd_set_evcmap() and the back ends that set
+ * event mappings, exposed so that the mappings pushed can be checked against
+ * a mock back end.
+ */
+
+/*
+ * One event of audit_event(5), and the state of its mappings in the kernel.
+ */
+struct auditd_evcmap_ent {
+	au_event_t	ee_number;
+	au_class_t	ee_class;
+	char		ee_name[EVNAMEMAP_NAME_SIZE];
+	int		ee_flags;
+	int		ee_seq;		/* Position in the file. */
+};
+
+#define	EE_CLASS_SET	0x01	/* Class mapping set in the kernel. */
+#define	EE_NAME_SET	0x02	/* Name mapping set in the kernel. */
+#define	EE_NAME_LONG	0x04	/* Name does not fit the kernel. */
+#define	EE_REMOVED	0x08	/* Removed, but class not yet cleared. */
+
+/*
+ * A back end sets 'n' mappings at once, which it may do in a single call
+ * where the kernel allows, and stores 0 or an errno value for each in
+ * 'error'.
+ */
+struct auditd_evcmap_backend {
+	void	(*eb_set_class)(void *arg, const au_evclass_map_t *evc,
+		    int *error, int n);
+	void	(*eb_set_event)(void *arg, const au_evname_map_t *evn,
+		    int *error, int n);
+	void	*eb_arg;
+};
+
+/*
+ * The mappings last pushed through a back end, sorted by event number.
+ */
+struct auditd_evcmap {
+	struct auditd_evcmap_ent	*em_ent;
+	int				 em_nent;
+};
+
+extern const struct auditd_evcmap_backend	auditd_evcmap_kernel;
+
+int	auditd_evcmap_read(struct auditd_evcmap_ent **entp);
+int	auditd_evcmap_sync(struct auditd_evcmap *em,
+	    const struct auditd_evcmap_backend *eb,
+	    struct auditd_evcmap_ent *ent, int nent);
+void	auditd_evcmap_free(struct auditd_evcmap *em);
+
+#endif /* !_LIBAUDITD_AUDITD_EVCMAP_H_ */
@@ -88,6 +88,12 @@
  */
 #define	JAN_01_2000	946598400
 
+/*
+ * Summary of a trail written next to it by auditreduce(1), named
+ * .<trail>.bloom; it expires with its trail.
+ */
+#define	AUDIT_SUMMARY_SUFFIX	".bloom"
+
 struct dir_ent {
 	char			*dirname;
 	uint8_t			 softlim;
@@ -100,6 +106,7 @@ static TAILQ_HEAD(, dir_ent)	dir_q;
 struct audit_trail {
 	time_t			 at_time;
 	char			*at_path;
+	char			*at_summary;
 	off_t			 at_size;
 
 	TAILQ_ENTRY(audit_trail) at_trls;
@@ -525,6 +532,19 @@ auditd_expire_trails(int (*warn_expired)(char *))
 			new->at_time = tstamp;
 			new->at_size = stbuf.st_size;
 			new->at_path = pn;
+			if (asprintf(&new->at_summary, "%s/.%s"
+			    AUDIT_SUMMARY_SUFFIX, traildir->dirname,
+			    dp->d_name) < 0) {
+				free(pn);
+				free(new);
+				ret = ADE_NOMEM;
+				break;
+			}
+			if (stat(new->at_summary, &stbuf) == 0 &&
+			    S_ISREG(stbuf.st_mode)) {
+				total_size += stbuf.st_size;
+				new->at_size += stbuf.st_size;
+			}
 
 			/*
 			 * Check to see if we have a new head.  Otherwise,
@@ -565,6 +585,7 @@ auditd_expire_trails(int (*warn_expired)(char *))
 					(*warn_expired)(at->at_path);
 				if (unlink(at->at_path) < 0)
 					ret = ADE_EXPIRE;
+				(void)unlink(at->at_summary);
 				total_size -= at->at_size;
 			}
 		} else {
@@ -574,11 +595,13 @@ auditd_expire_trails(int (*warn_expired)(char *))
 					(*warn_expired)(at->at_path);
 				if (unlink(at->at_path) < 0)
 					ret = ADE_EXPIRE;
+				(void)unlink(at->at_summary);
 				total_size -= at->at_size;
 			}
 		}
 
 		free(at->at_path);
+		free(at->at_summary);
 		free(at);
 		at = at_next;
 	}
@@ -676,72 +699,6 @@ auditd_close_dirs(void)
 }
 
 
-/*
- * Process the audit event file, obtaining a class mapping for each event, and
- * set that mapping into the kernel. Return:
- *	 n	number of event mappings that were successfully processed,
- *   ADE_NOMEM	if there was an error allocating memory.
- *
- * Historically, this code only set up the in-kernel class mapping.  On
- * systems with an in-kernel event-to-name mapping, it also now installs that,
- * as it is iterating over the event list anyway.  Failures there will be
- * ignored as not all kernels support the feature.
- */
-int
-auditd_set_evcmap(void)
-{
-	au_event_ent_t ev, *evp;
-	au_evclass_map_t evc_map;
-	au_evname_map_t evn_map;
-	int ctr = 0;
-
-	/*
-	 * XXX There's a risk here that the BSM library will return NULL
-	 * for an event when it can't properly map it to a class. In that
-	 * case, we will not process any events beyond the one that failed,
-	 * but should. We need a way to get a count of the events.
-	 */
-	ev.ae_name = (char *)malloc(AU_EVENT_NAME_MAX);
-	ev.ae_desc = (char *)malloc(AU_EVENT_DESC_MAX);
-	if (ev.ae_name == NULL || ev.ae_desc == NULL) {
-		if (ev.ae_name != NULL)
-			free(ev.ae_name);
-		return (ADE_NOMEM);
-	}
-
-	/*
-	 * XXXRW: Currently we have no way to remove mappings from the kernel
-	 * when they are removed from the file-based mappings.
-	 */
-	evp = &ev;
-	setauevent();
-	while ((evp = getauevent_r(evp)) != NULL) {
-		/*
-		 * Set the event-to-name mapping entry.  If there's not room
-		 * in the in-kernel string, then we skip the entry.  Possibly
-		 * better than truncating...?
-		 */
-		if (strlcpy(evn_map.en_name, evp->ae_name,
-		    sizeof(evn_map.en_name)) < sizeof(evn_map.en_name)) {
-			evn_map.en_number = evp->ae_number;
-			(void)audit_set_event(&evn_map, sizeof(evn_map));
-		}
-
-		/*
-		 * Set the event-to-class mapping entry.
-		 */
-		evc_map.ec_number = evp->ae_number;
-		evc_map.ec_class = evp->ae_class;
-		if (audit_set_class(&evc_map, sizeof(evc_map)) == 0)
-			ctr++;
-	}
-	endauevent();
-	free(ev.ae_name);
-	free(ev.ae_desc);
-
-	return (ctr);
-}
-
 /*
  * Get the non-attributable event string and set the kernel mask.  Return:
  *	ADE_NOERR	on success,
@@ -32,6 +32,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <config/config.h>
 #ifdef HAVE_FULL_QUEUE_H
@@ -207,6 +208,73 @@ au_write(int d, token_t *tok)
 	return (0); /* Success */
 }
 
+/*
+ * Add an exec argument or environment token to the record, truncated if
+ * necessary so that it fits in the space remaining once the header, trailer,
+ * and reserve bytes for tokens the caller has yet to write are accounted
+ * for, rather than failing the record as an oversized token would.
+ */
+static int
+au_write_exec_strings(int d, char **strs, size_t reserve,
+    token_t *(*tokfn)(const struct iovec *, int, size_t))
+{
+	au_record_t *rec;
+	struct iovec *iov;
+	token_t *tok;
+	size_t room;
+	int count, i;
+
+	if (strs == NULL) {
+		errno = EINVAL;
+		return (-1);
+	}
+	rec = open_desc_table[d];
+	if ((rec == NULL) || (rec->used == 0)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if (rec->len + reserve + MAX_AUDIT_HEADER_SIZE + AUDIT_TRAILER_SIZE >=
+	    MAX_AUDIT_RECORD_SIZE) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	room = MAX_AUDIT_RECORD_SIZE - MAX_AUDIT_HEADER_SIZE -
+	    AUDIT_TRAILER_SIZE - rec->len - reserve;
+
+	for (count = 0; strs[count] != NULL; count++)
+		;
+	iov = malloc((count + 1) * sizeof(*iov));
+	if (iov == NULL)
+		return (-1);
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = strs[i];
+		iov[i].iov_len = strlen(strs[i]);
+	}
+	tok = tokfn(iov, count, room);
+	free(iov);
+	if (tok == NULL)
+		return (-1);
+	if (au_write(d, tok) < 0) {
+		au_free_token(tok);
+		return (-1);
+	}
+	return (0);
+}
+
+int
+au_write_exec_args(int d, char **argv, size_t reserve)
+{
+
+	return (au_write_exec_strings(d, argv, reserve, au_to_exec_args_iov));
+}
+
+int
+au_write_exec_env(int d, char **envp, size_t reserve)
+{
+
+	return (au_write_exec_strings(d, envp, reserve, au_to_exec_env_iov));
+}
+
 /*
  * Assemble an audit record out of its tokens, including allocating header and
  * trailer tokens.  Does not free the token chain, which must be done by the
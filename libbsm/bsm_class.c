@@ -43,12 +43,13 @@
 #include <compat/strlcpy.h>
 #endif
 
+#include "bsm_db.h"
+
 /*
- * Parse the contents of the audit_class file to return struct au_class_ent
- * entries.
+ * Parse the contents of the audit_class file into a snapshot (see bsm_db.h)
+ * on first use, from which struct au_class_ent entries are returned.
  */
-static FILE		*fp = NULL;
-static char		 linestr[AU_LINE_MAX];
+static int		 cursor = 0;
 static const char	*classdelim = ":";
 
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
@@ -92,26 +93,26 @@ classfromstr(char *str, struct au_class_ent *c)
 }
 
 /*
- * Return the next au_class_ent structure from the file setauclass should be
- * called before invoking this function for the first time.
- *
- * Must be called with mutex held.
+ * Load the audit_class file into a snapshot, up to the first line that
+ * cannot be parsed.
  */
-static struct au_class_ent *
-getauclassent_r_locked(struct au_class_ent *c)
+int
+au_db_load_class(struct au_db *db)
 {
-	char *tokptr, *nl;
-
-	if ((fp == NULL) && ((fp = fopen(AUDIT_CLASS_FILE, "r")) == NULL))
-		return (NULL);
-
-	/*
-	 * Read until next non-comment line is found, or EOF.
-	 */
-	while (1) {
-		if (fgets(linestr, AU_LINE_MAX, fp) == NULL)
-			return (NULL);
-
+	char linestr[AU_LINE_MAX];
+	char class_ent_name[AU_CLASS_NAME_MAX];
+	char class_ent_desc[AU_CLASS_DESC_MAX];
+	struct au_class_ent c;
+	struct au_db_ent de;
+	FILE *fp;
+	char *nl;
+
+	if ((fp = fopen(AUDIT_CLASS_FILE, "r")) == NULL)
+		return (-1);
+	c.ac_name = class_ent_name;
+	c.ac_desc = class_ent_desc;
+	bzero(&de, sizeof(de));
+	while (fgets(linestr, AU_LINE_MAX, fp) != NULL) {
 		/* Skip comments. */
 		if (linestr[0] == '#')
 			continue;
@@ -121,27 +122,52 @@ getauclassent_r_locked(struct au_class_ent *c)
 			*nl = '\0';
 
 		/* Parse tokptr to au_class_ent components. */
-		tokptr = linestr;
-		if (classfromstr(tokptr, c) == NULL)
-			return (NULL);
-		break;
+		if (classfromstr(linestr, &c) == NULL)
+			break;
+		de.de_name = c.ac_name;
+		de.de_desc = c.ac_desc;
+		de.de_number = c.ac_class;
+		if (au_db_add(db, &de) != 0) {
+			fclose(fp);
+			return (-1);
+		}
 	}
+	fclose(fp);
+	return (0);
+}
 
+static struct au_class_ent *
+copyauclass(struct au_class_ent *c, const struct au_db_ent *de)
+{
+
+	strlcpy(c->ac_name, de->de_name, AU_CLASS_NAME_MAX);
+	strlcpy(c->ac_desc, de->de_desc, AU_CLASS_DESC_MAX);
+	c->ac_class = de->de_number;
 	return (c);
 }
 
+/*
+ * Return the next au_class_ent structure from the file setauclass should be
+ * called before invoking this function for the first time.
+ */
 struct au_class_ent *
 getauclassent_r(struct au_class_ent *c)
 {
+	const struct au_db *db;
 	struct au_class_ent *cp;
 
+	if ((db = au_db_enter(AU_DB_CLASS)) == NULL)
+		return (NULL);
+	cp = NULL;
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	cp = getauclassent_r_locked(c);
+	if (cursor < db->adb_nenum)
+		cp = copyauclass(c, &db->adb_ent[cursor++]);
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
+	au_db_exit(AU_DB_CLASS);
 	return (cp);
 }
 
@@ -150,7 +176,7 @@ getauclassent(void)
 {
 	static char class_ent_name[AU_CLASS_NAME_MAX];
 	static char class_ent_desc[AU_CLASS_DESC_MAX];
-	static struct au_class_ent c, *cp;
+	static struct au_class_ent c;
 
 	bzero(&c, sizeof(c));
 	bzero(class_ent_name, sizeof(class_ent_name));
@@ -158,29 +184,12 @@ getauclassent(void)
 	c.ac_name = class_ent_name;
 	c.ac_desc = class_ent_desc;
 
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_lock(&mutex);
-#endif
-	cp = getauclassent_r_locked(&c);
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_unlock(&mutex);
-#endif
-	return (cp);
+	return (getauclassent_r(&c));
 }
 
 /*
  * Rewind to the beginning of the enumeration.
- *
- * Must be called with mutex held.
  */
-static void
-setauclass_locked(void)
-{
-
-	if (fp != NULL)
-		fseek(fp, 0, SEEK_SET);
-}
-
 void
 setauclass(void)
 {
@@ -188,7 +197,7 @@ setauclass(void)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setauclass_locked();
+	cursor = 0;
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
@@ -200,27 +209,19 @@ setauclass(void)
 struct au_class_ent *
 getauclassnam_r(struct au_class_ent *c, const char *name)
 {
+	const struct au_db_ent *de;
+	const struct au_db *db;
 	struct au_class_ent *cp;
 
 	if (name == NULL)
 		return (NULL);
-
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_lock(&mutex);
-#endif
-	setauclass_locked();
-	while ((cp = getauclassent_r_locked(c)) != NULL) {
-		if (strcmp(name, cp->ac_name) == 0) {
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-			pthread_mutex_unlock(&mutex);
-#endif
-			return (cp);
-		}
-	}
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_unlock(&mutex);
-#endif
-	return (NULL);
+	if ((db = au_db_enter(AU_DB_CLASS)) == NULL)
+		return (NULL);
+	cp = NULL;
+	if ((de = au_db_byname(db, name)) != NULL)
+		cp = copyauclass(c, de);
+	au_db_exit(AU_DB_CLASS);
+	return (cp);
 }
 
 struct au_class_ent *
@@ -248,23 +249,17 @@ getauclassnam(const char *name)
 struct au_class_ent *
 getauclassnum_r(struct au_class_ent *c, au_class_t class_number)
 {
+	const struct au_db_ent *de;
+	const struct au_db *db;
 	struct au_class_ent *cp;
 
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_lock(&mutex);
-#endif
-	setauclass_locked();
-	while ((cp = getauclassent_r_locked(c)) != NULL) {
-		if (class_number == cp->ac_class)
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-			pthread_mutex_unlock(&mutex);
-#endif
-			return (cp);
-	}
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_unlock(&mutex);
-#endif
-	return (NULL);
+	if ((db = au_db_enter(AU_DB_CLASS)) == NULL)
+		return (NULL);
+	cp = NULL;
+	if ((de = au_db_bynum(db, class_number)) != NULL)
+		cp = copyauclass(c, de);
+	au_db_exit(AU_DB_CLASS);
+	return (cp);
 }
 
 struct au_class_ent *
@@ -284,7 +279,8 @@ getauclassnum(au_class_t class_number)
 }
 
 /*
- * audit_class processing is complete; close any open files.
+ * audit_class processing is complete; the file will be read again on next
+ * use.
  */
 void
 endauclass(void)
@@ -293,11 +289,9 @@ endauclass(void)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	if (fp != NULL) {
-		fclose(fp);
-		fp = NULL;
-	}
+	cursor = 0;
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
+	au_db_invalidate(AU_DB_CLASS);
 }
@@ -53,19 +53,59 @@
 #ifndef HAVE_STRLCPY
 #include <compat/strlcpy.h>
 #endif
+#ifndef HAVE_CLOCK_GETTIME
+#include <compat/clock_gettime.h>
+#endif
 
 #include <sys/stat.h>
 
+#include "bsm_db.h"
+
 /*
- * Parse the contents of the audit_control file to return the audit control
- * parameters.  These static fields are protected by 'mutex'.
+ * The audit_control file is read into a snapshot holding each of its lines
+ * as a type and value, and the values parsed into a struct au_control.  The
+ * snapshot is read again when the inode, size or modification time of the
+ * file changes, or after endac().  The file is checked for changes by
+ * setac(), and otherwise at most every AU_CONTROL_CHECK_INTERVAL seconds,
+ * so that a run of getters costs no system calls.  The getac*() functions
+ * search the lines of the snapshot as they used to search the file: each
+ * starts again from the first line, and getacdir() continues from the line
+ * after the last one found, in the snapshot it started from.
+ *
+ * These static fields are protected by 'mutex'; a snapshot is freed when
+ * the last reference to it is released.
  */
-static FILE	*fp = NULL;
-static char	linestr[AU_LINE_MAX];
+struct au_control_line {
+	char	*acl_type;
+	char	*acl_value;		/* May be NULL. */
+};
+
+struct au_control_snap {
+	struct au_control	 acs_ac;	/* Must be first. */
+	struct au_control_line	*acs_line;
+	int			 acs_nline;
+	u_int			 acs_refs;
+	dev_t			 acs_dev;
+	ino_t			 acs_ino;
+	off_t			 acs_size;
+	time_t			 acs_mtime;
+	time_t			 acs_checked;	/* When last compared. */
+};
+
+#define	AU_CONTROL_CHECK_INTERVAL	1
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#define	AU_CONTROL_CLOCK		CLOCK_MONOTONIC
+#else
+#define	AU_CONTROL_CLOCK		CLOCK_REALTIME
+#endif
+
+static struct au_control_snap	*cur = NULL;	/* Latest snapshot. */
+static struct au_control_snap	*possnap = NULL; /* Snapshot being read. */
+static int			 pos = 0;	/* Next line in possnap. */
 static char	*delim = ":";
 
-static char	inacdir = 0;
-static char	ptrmoved = 0;
+static void	setac_locked(int check);
 
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 static pthread_mutex_t	mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -99,49 +139,31 @@ static struct audit_polstr au_polstr[] = {
 
 /*
  * Returns the string value corresponding to the given label from the
- * configuration file.
+ * snapshot, starting at the current position.
  *
  * Must be called with mutex held.
  */
 static int
 getstrfromtype_locked(const char *name, char **str)
 {
-	char *type, *nl;
-	char *tokptr;
-	char *last;
+	struct au_control_line *acl;
 
 	*str = NULL;
 
-	if ((fp == NULL) && ((fp = fopen(AUDIT_CONTROL_FILE, "r")) == NULL))
+	if (possnap == NULL)
+		setac_locked(0);
+	if (possnap == NULL)
 		return (-1); /* Error */
 
-	while (1) {
-		if (fgets(linestr, AU_LINE_MAX, fp) == NULL) {
-			if (ferror(fp))
-				return (-1);
-			return (0);	/* EOF */
-		}
-
-		if (linestr[0] == '#')
-			continue;
-
-		/* Remove trailing new line character and white space. */
-		nl = strchr(linestr, '\0') - 1;
-		while (nl >= linestr && ('\n' == *nl || ' ' == *nl ||
-			'\t' == *nl)) {
-			*nl = '\0';
-			nl--;
-		}
-
-		tokptr = linestr;
-		if ((type = strtok_r(tokptr, delim, &last)) != NULL) {
-			if (strcmp(name, type) == 0) {
-				/* Found matching name. */
-				*str = last;
-				return (0); /* Success */
-			}
+	while (pos < possnap->acs_nline) {
+		acl = &possnap->acs_line[pos++];
+		if (strcmp(name, acl->acl_type) == 0) {
+			/* Found matching name. */
+			*str = acl->acl_value;
+			return (0); /* Success */
 		}
 	}
+	return (0);	/* EOF */
 }
 
 /*
@@ -220,6 +242,138 @@ au_spacetobytes(size_t *bytes, u_long value, char mult)
 	return (0);
 }
 
+/*
+ * Set expiration conditions.
+ */
+static int
+setexpirecond(time_t *age, size_t *size, u_long value, char mult)
+{
+
+	if (isupper(mult) || ' ' == mult)
+		return (au_spacetobytes(size, value, mult));
+	else
+		return (au_timetosec(age, value, mult));
+}
+
+/*
+ * Parse the value of the filesz entry.
+ */
+static int
+au_control_filesz(const char *str, size_t *filesz_val)
+{
+	size_t val;
+	char mult;
+	int nparsed;
+
+	/* Trim off any leading white space. */
+	while (*str == ' ' || *str == '\t')
+		str++;
+
+	nparsed = sscanf(str, "%ju%c", (uintmax_t *)&val, &mult);
+
+	switch (nparsed) {
+	case 1:
+		/* If no multiplier then assume 'B' (bytes). */
+		mult = 'B';
+		/* fall through */
+	case 2:
+		if (au_spacetobytes(filesz_val, val, mult) == 0)
+			break;
+		/* fall through */
+	default:
+		errno = EINVAL;
+		return (-1);
+	}
+
+	/*
+	 * The file size must either be 0 or >= MIN_AUDIT_FILE_SIZE.  0
+	 * indicates no rotation size.
+	 */
+	if (*filesz_val < 0 || (*filesz_val > 0 &&
+		*filesz_val < MIN_AUDIT_FILE_SIZE)) {
+		filesz_val = 0L;
+		errno = EINVAL;
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Parse the value of the expire-after entry.
+ */
+static int
+au_control_expire(const char *str, int *andflg, time_t *age, size_t *size)
+{
+	int nparsed;
+	u_long val1, val2;
+	char mult1, mult2;
+	char andor[AU_LINE_MAX];
+
+	/* First, trim off any leading white space. */
+	while (*str == ' ' || *str == '\t')
+		str++;
+
+	nparsed = sscanf(str, "%lu%c%[ \tadnorADNOR]%lu%c", &val1, &mult1,
+	    andor, &val2, &mult2);
+
+	switch (nparsed) {
+	case 1:
+		/* If no multiplier then assume 'B' (Bytes). */
+		mult1 = 'B';
+		/* fall through */
+	case 2:
+		/* One expiration condition. */
+		if (setexpirecond(age, size, val1, mult1) != 0)
+			return (-1);
+		break;
+
+	case 5:
+		/* Two expiration conditions. */
+		if (setexpirecond(age, size, val1, mult1) != 0 ||
+		    setexpirecond(age, size, val2, mult2) != 0)
+			return (-1);
+		if (strcasestr(andor, "and") != NULL)
+			*andflg = 1;
+		else if (strcasestr(andor, "or") != NULL)
+			*andflg = 0;
+		else
+			return (-1);
+		break;
+
+	default:
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Parse the value of the qsize entry.
+ */
+static int
+au_control_qsize(const char *str, int *qsz_val)
+{
+	int nparsed;
+
+	/* Trim off any leading white space. */
+	while (*str == ' ' || *str == '\t')
+		str++;
+
+	nparsed = sscanf(str, "%d", (int *)qsz_val);
+
+	if (nparsed != 1) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	/* The queue size must either be 0 or < AQ_MAXHIGH */
+	if (*qsz_val < 0 || *qsz_val > AQ_MAXHIGH) {
+		qsz_val = 0L;
+		errno = EINVAL;
+		return (-1);
+	}
+	return (0);
+}
+
 /*
  * Convert a policy to a string.  Return -1 on failure, or >= 0 representing
  * the actual size of the string placed in the buffer (excluding terminating
@@ -287,33 +441,253 @@ au_strtopol(const char *polstr, int *policy)
 	return (0);
 }
 
+static void
+au_control_rele(struct au_control_snap *acs)
+{
+	int i;
+
+	if (__atomic_sub_fetch(&acs->acs_refs, 1, __ATOMIC_SEQ_CST) != 0)
+		return;
+	for (i = 0; i < acs->acs_nline; i++) {
+		free(acs->acs_line[i].acl_type);
+		free(acs->acs_line[i].acl_value);
+	}
+	free(acs->acs_line);
+	free(acs->acs_ac.ac_dirs);
+	free(acs);
+}
+
 /*
- * Rewind the file pointer to beginning.
+ * Return the value of the first line of the given type in a snapshot.
  */
-static void
-setac_locked(void)
+static const char *
+au_control_find(const struct au_control_snap *acs, const char *name,
+    int *found)
 {
-	static time_t lastctime = 0;
-	struct stat sbuf;
+	int i;
+
+	for (i = 0; i < acs->acs_nline; i++) {
+		if (strcmp(name, acs->acs_line[i].acl_type) == 0) {
+			*found = 1;
+			return (acs->acs_line[i].acl_value);
+		}
+	}
+	*found = 0;
+	return (NULL);
+}
+
+/*
+ * Fill in the parsed form of a snapshot, as the getac*() functions would
+ * return each value.
+ */
+static int
+au_control_parse(struct au_control_snap *acs)
+{
+	struct au_control *ac;
+	const char *str;
+	int found, i;
+
+	ac = &acs->acs_ac;
+	ac->ac_dirs = calloc(acs->acs_nline + 1, sizeof(*ac->ac_dirs));
+	if (ac->ac_dirs == NULL)
+		return (-1);
+	for (i = 0; i < acs->acs_nline; i++) {
+		if (strcmp(acs->acs_line[i].acl_type, DIR_CONTROL_ENTRY) != 0)
+			continue;
+		/* getacdir() stops at a directory with no value. */
+		if (acs->acs_line[i].acl_value == NULL)
+			break;
+		ac->ac_dirs[ac->ac_ndirs++] = acs->acs_line[i].acl_value;
+	}
+	if (ac->ac_ndirs != 0)
+		ac->ac_valid |= AU_CONTROL_DIR;
+
+	str = au_control_find(acs, DIST_CONTROL_ENTRY, &found);
+	if (str != NULL && (strcasecmp(str, "on") == 0 ||
+	    strcasecmp(str, "yes") == 0))
+		ac->ac_dist = 1;
+	if (found)
+		ac->ac_valid |= AU_CONTROL_DIST;
+
+	str = au_control_find(acs, EXPIRE_AFTER_CONTROL_ENTRY, &found);
+	if (str != NULL && au_control_expire(str, &ac->ac_expire_and,
+	    &ac->ac_expire_age, &ac->ac_expire_size) == 0)
+		ac->ac_valid |= AU_CONTROL_EXPIRE;
+	else {
+		ac->ac_expire_and = 0;
+		ac->ac_expire_age = 0;
+		ac->ac_expire_size = 0;
+	}
+
+	str = au_control_find(acs, FILESZ_CONTROL_ENTRY, &found);
+	if (str != NULL && au_control_filesz(str, &ac->ac_filesz) == 0)
+		ac->ac_valid |= AU_CONTROL_FILESZ;
+	else
+		ac->ac_filesz = 0;
+
+	str = au_control_find(acs, FLAGS_CONTROL_ENTRY, &found);
+	if (found) {
+		ac->ac_flags = str != NULL ? str : "";
+		ac->ac_valid |= AU_CONTROL_FLAGS;
+	}
+
+	str = au_control_find(acs, HOST_CONTROL_ENTRY, &found);
+	if (found) {
+		ac->ac_host = str != NULL ? str : "";
+		ac->ac_valid |= AU_CONTROL_HOST;
+	}
+
+	str = au_control_find(acs, MINFREE_CONTROL_ENTRY, &found);
+	if (str != NULL) {
+		ac->ac_minfree = atoi(str);
+		ac->ac_valid |= AU_CONTROL_MINFREE;
+	}
+
+	str = au_control_find(acs, NA_CONTROL_ENTRY, &found);
+	if (found) {
+		ac->ac_naflags = str != NULL ? str : "";
+		ac->ac_valid |= AU_CONTROL_NAFLAGS;
+	}
+
+	str = au_control_find(acs, POLICY_CONTROL_ENTRY, &found);
+	if (found && au_strtopol(str != NULL ? str : "",
+	    &ac->ac_policy) == 0)
+		ac->ac_valid |= AU_CONTROL_POLICY;
+	else
+		ac->ac_policy = 0;
+
+	str = au_control_find(acs, QSZ_CONTROL_ENTRY, &found);
+	if (str == NULL) {
+		ac->ac_qsize = USE_DEFAULT_QSZ;
+		ac->ac_valid |= AU_CONTROL_QSIZE;
+	} else if (au_control_qsize(str, &ac->ac_qsize) == 0)
+		ac->ac_valid |= AU_CONTROL_QSIZE;
+	else
+		ac->ac_qsize = 0;
+	return (0);
+}
+
+/*
+ * Read the audit_control file into a new snapshot.
+ */
+static struct au_control_snap *
+au_control_load(void)
+{
+	char linestr[AU_LINE_MAX];
+	struct au_control_snap *acs;
+	struct au_control_line *acl;
+	char *type, *nl;
+	char *last;
+	struct stat sb;
+	int error, size;
+	FILE *fp;
+
+	if ((fp = fopen(AUDIT_CONTROL_FILE, "r")) == NULL)
+		return (NULL);
+	if (fstat(fileno(fp), &sb) != 0 ||
+	    (acs = calloc(1, sizeof(*acs))) == NULL) {
+		error = errno;
+		fclose(fp);
+		errno = error;
+		return (NULL);
+	}
+	acs->acs_refs = 1;
+	acs->acs_dev = sb.st_dev;
+	acs->acs_ino = sb.st_ino;
+	acs->acs_size = sb.st_size;
+	acs->acs_mtime = sb.st_mtime;
+	size = 0;
+	while (fgets(linestr, AU_LINE_MAX, fp) != NULL) {
+		if (linestr[0] == '#')
+			continue;
 
-	ptrmoved = 1;
-	if (fp != NULL) {
-		/*
-		 * Check to see if the file on disk has changed.  If so,
-		 * force a re-read of the file by closing it.
-		 */
-		if (fstat(fileno(fp), &sbuf) < 0)
-			goto closefp;
-		if (lastctime != sbuf.st_ctime) {
-			lastctime = sbuf.st_ctime;
-closefp:
-			fclose(fp);
-			fp = NULL;
-			return;
+		/* Remove trailing new line character and white space. */
+		nl = strchr(linestr, '\0') - 1;
+		while (nl >= linestr && ('\n' == *nl || ' ' == *nl ||
+			'\t' == *nl)) {
+			*nl = '\0';
+			nl--;
 		}
 
-		fseek(fp, 0, SEEK_SET);
+		if ((type = strtok_r(linestr, delim, &last)) == NULL)
+			continue;
+		if (acs->acs_nline == size) {
+			size = size == 0 ? 16 : size * 2;
+			acl = realloc(acs->acs_line, size * sizeof(*acl));
+			if (acl == NULL)
+				goto fail;
+			acs->acs_line = acl;
+		}
+		acl = &acs->acs_line[acs->acs_nline];
+		acl->acl_type = strdup(type);
+		acl->acl_value = last != NULL ? strdup(last) : NULL;
+		if (acl->acl_type == NULL ||
+		    (last != NULL && acl->acl_value == NULL)) {
+			free(acl->acl_type);
+			free(acl->acl_value);
+			goto fail;
+		}
+		acs->acs_nline++;
 	}
+	if (ferror(fp) || au_control_parse(acs) != 0)
+		goto fail;
+	fclose(fp);
+	return (acs);
+
+fail:
+	error = errno;
+	fclose(fp);
+	au_control_rele(acs);
+	errno = error;
+	return (NULL);
+}
+
+/*
+ * Return the latest snapshot, reading the file again if it has changed.  If
+ * the file can no longer be found, the snapshot already read is kept, as the
+ * open file used to be.
+ *
+ * Must be called with mutex held.
+ */
+static struct au_control_snap *
+au_control_cur_locked(int check)
+{
+	struct timespec ts;
+	struct stat sbuf;
+
+	if (clock_gettime(AU_CONTROL_CLOCK, &ts) < 0)
+		ts.tv_sec = 0;
+	if (cur != NULL && !check && ts.tv_sec >= cur->acs_checked &&
+	    ts.tv_sec - cur->acs_checked < AU_CONTROL_CHECK_INTERVAL)
+		return (cur);
+	if (cur != NULL && (stat(AUDIT_CONTROL_FILE, &sbuf) != 0 ||
+	    (sbuf.st_dev == cur->acs_dev && sbuf.st_ino == cur->acs_ino &&
+	    sbuf.st_size == cur->acs_size &&
+	    sbuf.st_mtime == cur->acs_mtime))) {
+		cur->acs_checked = ts.tv_sec;
+		return (cur);
+	}
+	if (cur != NULL)
+		au_control_rele(cur);
+	if ((cur = au_control_load()) != NULL)
+		cur->acs_checked = ts.tv_sec;
+	return (cur);
+}
+
+/*
+ * Rewind to the first line of the latest snapshot.
+ */
+static void
+setac_locked(int check)
+{
+	struct au_control_snap *acs;
+
+	if ((acs = au_control_cur_locked(check)) != NULL)
+		__atomic_add_fetch(&acs->acs_refs, 1, __ATOMIC_SEQ_CST);
+	if (possnap != NULL)
+		au_control_rele(possnap);
+	possnap = acs;
+	pos = 0;
 }
 
 void
@@ -323,14 +697,14 @@ setac(void)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setac_locked();
+	setac_locked(1);
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
 }
 
 /*
- * Close the audit_control file.
+ * Close the audit_control file; it will be read again on next use.
  */
 void
 endac(void)
@@ -339,16 +713,76 @@ endac(void)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	ptrmoved = 1;
-	if (fp != NULL) {
-		fclose(fp);
-		fp = NULL;
+	if (possnap != NULL) {
+		au_control_rele(possnap);
+		possnap = NULL;
+	}
+	if (cur != NULL) {
+		au_control_rele(cur);
+		cur = NULL;
 	}
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
 }
 
+/*
+ * Return the parsed contents of the audit_control file, reading it again
+ * if it has changed.  The caller must release the snapshot with
+ * au_control_release().
+ */
+const au_control_t *
+au_control_get(void)
+{
+	struct au_control_snap *acs;
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_lock(&mutex);
+#endif
+	if ((acs = au_control_cur_locked(0)) != NULL)
+		__atomic_add_fetch(&acs->acs_refs, 1, __ATOMIC_SEQ_CST);
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&mutex);
+#endif
+	return (acs != NULL ? &acs->acs_ac : NULL);
+}
+
+void
+au_control_release(const au_control_t *ac)
+{
+
+	au_control_rele((struct au_control_snap *)ac);
+}
+
+/*
+ * Read the audit_control file into a new snapshot and make it the latest,
+ * without holding the mutex while the file is read.  As on other reads, the
+ * snapshot already read is kept if the file cannot be read, and a file not
+ * yet read is left for the first getter.
+ */
+void
+au_control_reload(void)
+{
+	struct au_control_snap *acs;
+	struct timespec ts;
+
+	if (__atomic_load_n(&cur, __ATOMIC_SEQ_CST) == NULL ||
+	    (acs = au_control_load()) == NULL)
+		return;
+	if (clock_gettime(AU_CONTROL_CLOCK, &ts) < 0)
+		ts.tv_sec = 0;
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_lock(&mutex);
+#endif
+	if (cur != NULL)
+		au_control_rele(cur);
+	cur = acs;
+	cur->acs_checked = ts.tv_sec;
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
 /*
  * Return audit directory information from the audit control file.
  */
@@ -358,19 +792,9 @@ getacdir(char *name, int len)
 	char *dir;
 	int ret = 0;
 
-	/*
-	 * Check if another function was called between successive calls to
-	 * getacdir.
-	 */
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	if (inacdir && ptrmoved) {
-		ptrmoved = 0;
-		if (fp != NULL)
-			fseek(fp, 0, SEEK_SET);
-		ret = 2;
-	}
 	if (getstrfromtype_locked(DIR_CONTROL_ENTRY, &dir) < 0) {
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 		pthread_mutex_unlock(&mutex);
@@ -410,7 +834,7 @@ getacdist(void)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setac_locked();
+	setac_locked(0);
 	if (getstrfromtype_locked(DIST_CONTROL_ENTRY, &str) < 0) {
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 		pthread_mutex_unlock(&mutex);
@@ -444,7 +868,7 @@ getacmin(int *min_val)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setac_locked();
+	setac_locked(0);
 	if (getstrfromtype_locked(MINFREE_CONTROL_ENTRY, &min) < 0) {
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 		pthread_mutex_unlock(&mutex);
@@ -471,14 +895,12 @@ int
 getacfilesz(size_t *filesz_val)
 {
 	char *str;
-	size_t val;
-	char mult;
-	int nparsed;
+	int ret;
 
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setac_locked();
+	setac_locked(0);
 	if (getstrfromtype_locked(FILESZ_CONTROL_ENTRY, &str) < 0) {
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 		pthread_mutex_unlock(&mutex);
@@ -493,46 +915,11 @@ getacfilesz(size_t *filesz_val)
 		return (-1);
 	}
 
-	/* Trim off any leading white space. */
-	while (*str == ' ' || *str == '\t')
-		str++;
-
-	nparsed = sscanf(str, "%ju%c", (uintmax_t *)&val, &mult);
-
-	switch (nparsed) {
-	case 1:
-		/* If no multiplier then assume 'B' (bytes). */
-		mult = 'B';
-		/* fall through */
-	case 2:
-		if (au_spacetobytes(filesz_val, val, mult) == 0)
-			break;
-		/* fall through */
-	default:
-		errno = EINVAL;
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-		pthread_mutex_unlock(&mutex);
-#endif
-		return (-1);
-	}
-
-	/*
-	 * The file size must either be 0 or >= MIN_AUDIT_FILE_SIZE.  0
-	 * indicates no rotation size.
-	 */
-	if (*filesz_val < 0 || (*filesz_val > 0 &&
-		*filesz_val < MIN_AUDIT_FILE_SIZE)) {
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-		pthread_mutex_unlock(&mutex);
-#endif
-		filesz_val = 0L;
-		errno = EINVAL;
-		return (-1);
-	}
+	ret = au_control_filesz(str, filesz_val);
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
-	return (0);
+	return (ret);
 }
 
 static int
@@ -543,7 +930,7 @@ getaccommon(const char *name, char *auditstr, int len)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setac_locked();
+	setac_locked(0);
 	if (getstrfromtype_locked(name, &str) < 0) {
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 		pthread_mutex_unlock(&mutex);
@@ -605,19 +992,6 @@ getachost(char *auditstr, size_t len)
 	return (getaccommon(HOST_CONTROL_ENTRY, auditstr, len));
 }
 
-/*
- * Set expiration conditions.
- */
-static int
-setexpirecond(time_t *age, size_t *size, u_long value, char mult)
-{
-
-	if (isupper(mult) || ' ' == mult)
-		return (au_spacetobytes(size, value, mult));
-	else
-		return (au_timetosec(age, value, mult));
-}
-
 /*
  * Return the expire-after field from the audit control file.
  */
@@ -625,10 +999,7 @@ int
 getacexpire(int *andflg, time_t *age, size_t *size)
 {
 	char *str;
-	int nparsed;
-	u_long val1, val2;
-	char mult1, mult2;
-	char andor[AU_LINE_MAX];
+	int ret;
 
 	*age = 0L;
 	*size = 0LL;
@@ -637,7 +1008,7 @@ getacexpire(int *andflg, time_t *age, size_t *size)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setac_locked();
+	setac_locked(0);
 	if (getstrfromtype_locked(EXPIRE_AFTER_CONTROL_ENTRY, &str) < 0) {
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 		pthread_mutex_unlock(&mutex);
@@ -651,60 +1022,11 @@ getacexpire(int *andflg, time_t *age, size_t *size)
 		return (-1);
 	}
 
-	/* First, trim off any leading white space. */
-	while (*str == ' ' || *str == '\t')
-		str++;
-
-	nparsed = sscanf(str, "%lu%c%[ \tadnorADNOR]%lu%c", &val1, &mult1,
-	    andor, &val2, &mult2);
-
-	switch (nparsed) {
-	case 1:
-		/* If no multiplier then assume 'B' (Bytes). */
-		mult1 = 'B';
-		/* fall through */
-	case 2:
-		/* One expiration condition. */
-		if (setexpirecond(age, size, val1, mult1) != 0) {
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-			pthread_mutex_unlock(&mutex);
-#endif
-			return (-1);
-		}
-		break;
-
-	case 5:
-		/* Two expiration conditions. */
-		if (setexpirecond(age, size, val1, mult1) != 0 ||
-		    setexpirecond(age, size, val2, mult2) != 0) {
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-			pthread_mutex_unlock(&mutex);
-#endif
-			return (-1);
-		}
-		if (strcasestr(andor, "and") != NULL)
-			*andflg = 1;
-		else if (strcasestr(andor, "or") != NULL)
-			*andflg = 0;
-		else {
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-			pthread_mutex_unlock(&mutex);
-#endif
-			return (-1);
-		}
-		break;
-
-	default:
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-		pthread_mutex_unlock(&mutex);
-#endif
-		return (-1);
-	}
-
+	ret = au_control_expire(str, andflg, age, size);
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
-	return (0);
+	return (ret);
 }
 /*
  * Return the desired queue size from the audit control file.
@@ -713,12 +1035,12 @@ int
 getacqsize(int *qsz_val)
 {
 	char *str;
-	int nparsed;
+	int ret;
 
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setac_locked();
+	setac_locked(0);
 	if (getstrfromtype_locked(QSZ_CONTROL_ENTRY, &str) < 0) {
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 		pthread_mutex_unlock(&mutex);
@@ -733,31 +1055,9 @@ getacqsize(int *qsz_val)
 		return (0);
 	}
 
-	/* Trim off any leading white space. */
-	while (*str == ' ' || *str == '\t')
-		str++;
-
-	nparsed = sscanf(str, "%d", (int *)qsz_val);
-
-	if (nparsed != 1) {
-		errno = EINVAL;
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-		pthread_mutex_unlock(&mutex);
-#endif
-		return (-1);
-	}
-
-	/* The queue size must either be 0 or < AQ_MAXHIGH */
-	if (*qsz_val < 0 || *qsz_val > AQ_MAXHIGH) {
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-		pthread_mutex_unlock(&mutex);
-#endif
-		qsz_val = 0L;
-		errno = EINVAL;
-		return (-1);
-	}
+	ret = au_control_qsize(str, qsz_val);
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
-	return (0);
+	return (ret);
 }
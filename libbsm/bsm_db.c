@@ -0,0 +1,1229 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Snapshots of the audit_event, audit_class and audit_user databases; see
+ * bsm_db.h.
+ *
+ * Readers are tracked by epoch, in a slot per thread so that they share no
+ * cache line that is written.  A reader stores the global epoch in its slot
+ * before loading the snapshot pointer, and clears it when done.  A writer
+ * swaps the pointer first and then advances the epoch, tagging the old
+ * snapshot with the epoch it replaced; a reader that could have loaded the
+ * old pointer announced that epoch or an earlier one before the swap, so
+ * the snapshot is freed once no slot holds an epoch that old.  At most
+ * AU_DB_MAXRETIRED snapshots are kept waiting: a writer that would exceed
+ * that waits for the readers still using them to leave.
+ *
+ * Snapshots are built without the mutex, which is held only to publish one
+ * and to free retired ones, so readers never wait for a file to be parsed;
+ * a reader that finds the mutex busy leaves freeing to its holder.  Each
+ * build takes a generation number when it starts.  A build is published
+ * only if it started after the last invalidation and after the snapshot it
+ * would replace, so one that read the files before they changed never
+ * replaces one that read them after.
+ *
+ * A snapshot is taken from the compiled database, AUDIT_DB_FILE, when that
+ * was compiled from the text files as they are now, and parsed from the
+ * text file otherwise.  The compiled database is mapped once and shared by
+ * all snapshots taken from it; it is unmapped when the last of those is
+ * freed.
+ *
+ * Databases listed in au_db_recheck[] are also replaced when a file they
+ * were read from changes: readers compare the files with those recorded in
+ * the snapshot at most every AU_DB_CHECK_INTERVAL seconds.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <config/config.h>
+
+#include <bsm/libbsm.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#ifndef HAVE_CLOCK_GETTIME
+#include <compat/clock_gettime.h>
+#endif
+
+#include "bsm_db.h"
+
+#define	AU_DB_POOLSIZE	(64 * 1024)
+#define	AU_DB_ALIGN(x)	(((x) + 7) & ~(size_t)7)
+#define	AU_DB_CHECK_INTERVAL	1
+#define	AU_DB_MAXRETIRED	4
+#define	AU_DB_IDLE		UINT64_MAX	/* Slot epoch of a non-reader. */
+#define	AU_DB_LINE		64
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#define	AU_DB_CLOCK		CLOCK_MONOTONIC
+#else
+#define	AU_DB_CLOCK		CLOCK_REALTIME
+#endif
+
+struct au_db_pool {
+	struct au_db_pool	*adp_next;
+	size_t			 adp_used;
+	size_t			 adp_size;
+	char			 adp_data[];
+};
+
+struct au_db_map {
+	const char	*adm_addr;
+	size_t		 adm_len;
+	dev_t		 adm_dev;
+	ino_t		 adm_ino;
+	time_t		 adm_mtime;
+	u_int		 adm_refs;
+};
+
+struct au_dbf_buf {
+	char		*db_data;
+	size_t		 db_len;
+	size_t		 db_size;
+};
+
+/*
+ * A thread's reader state, padded to a cache line of its own.  Slots are
+ * never freed: a thread that exits leaves its slot for the next new thread.
+ */
+struct au_db_slot {
+	u_int64_t		 ads_epoch[AU_DB_MAX];	/* Epoch entered in. */
+	u_int			 ads_depth[AU_DB_MAX];	/* Nesting; owner only. */
+	int			 ads_used;		/* Owned by a thread. */
+	struct au_db_slot	*ads_next;
+	char			 ads_pad[AU_DB_LINE];
+};
+
+static int		(*au_db_load[AU_DB_MAX])(struct au_db *) = {
+	au_db_load_event,
+	au_db_load_class,
+	au_db_load_user,
+};
+
+static const char	*au_db_source[AU_DB_MAX] = {
+	AUDIT_EVENT_FILE,
+	AUDIT_CLASS_FILE,
+	AUDIT_USER_FILE,
+};
+
+/*
+ * The text files each database depends on: events and users are resolved
+ * against audit_class.
+ */
+static const int	 au_db_deps[AU_DB_MAX] = {
+	(1 << AU_DB_EVENT) | (1 << AU_DB_CLASS),
+	(1 << AU_DB_CLASS),
+	(1 << AU_DB_USER) | (1 << AU_DB_CLASS),
+};
+
+/*
+ * Whether readers check for changes to the files.  audit_user is looked up
+ * on each login and edited while the system runs; the event and class
+ * databases are left to be re-read with endauevent() and endauclass(), to
+ * keep au_preselect(3) free of clock reads.
+ */
+static const int	 au_db_recheck[AU_DB_MAX] = { 0, 0, 1 };
+
+static struct au_db_map	*au_db_mapcur;
+
+static struct au_db	*au_db_cur[AU_DB_MAX];
+static struct au_db	*au_db_retired[AU_DB_MAX];
+static int		 au_db_nretired[AU_DB_MAX];
+static u_int64_t	 au_db_epoch;
+static u_int		 au_db_gen;
+static u_int		 au_db_floor[AU_DB_MAX];	/* Gen at invalidation. */
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+static pthread_mutex_t	au_db_mutex[AU_DB_MAX] = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER,
+};
+static pthread_mutex_t	au_db_mapmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t	au_db_once = PTHREAD_ONCE_INIT;
+static pthread_key_t	au_db_key;
+static int		au_db_keyerr;
+static struct au_db_slot *au_db_slots;
+#else
+static struct au_db_slot au_db_slot0 = {
+	{ AU_DB_IDLE, AU_DB_IDLE, AU_DB_IDLE }, { 0, 0, 0 }, 1, NULL, { 0 }
+};
+static struct au_db_slot *au_db_slots = &au_db_slot0;
+#endif
+
+u_int32_t
+au_db_hashstr(const char *str)
+{
+	u_int32_t h;
+
+	/* FNV-1a. */
+	h = 2166136261U;
+	while (*str != '\0') {
+		h ^= (u_char)*str++;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+static u_int32_t
+au_db_hashnum(u_int32_t number)
+{
+
+	return (number * 2654435761U);
+}
+
+static const char *
+au_db_strdup(struct au_db *db, const char *str)
+{
+	struct au_db_pool *pool;
+	size_t len, size;
+	char *cp;
+
+	if (str == NULL)
+		return (NULL);
+	len = strlen(str) + 1;
+	pool = db->adb_pool;
+	if (pool == NULL || pool->adp_size - pool->adp_used < len) {
+		size = len > AU_DB_POOLSIZE ? len : AU_DB_POOLSIZE;
+		pool = malloc(sizeof(*pool) + size);
+		if (pool == NULL)
+			return (NULL);
+		pool->adp_used = 0;
+		pool->adp_size = size;
+		pool->adp_next = db->adb_pool;
+		db->adb_pool = pool;
+	}
+	cp = pool->adp_data + pool->adp_used;
+	memcpy(cp, str, len);
+	pool->adp_used += len;
+	return (cp);
+}
+
+static void
+au_db_map_rele(struct au_db_map *map)
+{
+
+	if (__atomic_sub_fetch(&map->adm_refs, 1, __ATOMIC_SEQ_CST) == 0) {
+		munmap((void *)map->adm_addr, map->adm_len);
+		free(map);
+	}
+}
+
+static void
+au_db_free(struct au_db *db)
+{
+	struct au_db_pool *pool;
+
+	free(db->adb_bitent);
+	if (db->adb_map != NULL) {
+		/* Everything but the entries lives in the mapping. */
+		au_db_map_rele(db->adb_map);
+		free(db->adb_ent);
+		free(db);
+		return;
+	}
+	while ((pool = db->adb_pool) != NULL) {
+		db->adb_pool = pool->adp_next;
+		free(pool);
+	}
+	free(db->adb_byname);
+	free(db->adb_bynum);
+	free(db->adb_evclass);
+	free(db->adb_evknown);
+	free(db->adb_ent);
+	free(db);
+}
+
+/*
+ * Append an entry to a snapshot being loaded.
+ */
+int
+au_db_add(struct au_db *db, const struct au_db_ent *de)
+{
+	struct au_db_ent *ent;
+	int size;
+
+	if (db->adb_nent == db->adb_size) {
+		size = db->adb_size == 0 ? 64 : db->adb_size * 2;
+		ent = realloc(db->adb_ent, size * sizeof(*ent));
+		if (ent == NULL)
+			return (-1);
+		db->adb_ent = ent;
+		db->adb_size = size;
+	}
+	ent = &db->adb_ent[db->adb_nent];
+	*ent = *de;
+	if ((ent->de_name = au_db_strdup(db, de->de_name)) == NULL)
+		return (-1);
+	if (de->de_desc != NULL &&
+	    (ent->de_desc = au_db_strdup(db, de->de_desc)) == NULL)
+		return (-1);
+	db->adb_nent++;
+	return (0);
+}
+
+/*
+ * Enumeration with getau*ent() historically stops at the first line that
+ * cannot be parsed; the loader calls this when it meets one so that later
+ * entries are only visible to lookups.
+ */
+void
+au_db_endenum(struct au_db *db)
+{
+
+	if (!db->adb_enumset) {
+		db->adb_nenum = db->adb_nent;
+		db->adb_enumset = 1;
+	}
+}
+
+/*
+ * Build the hash indexes.  Where a name or number appears more than once,
+ * the first entry wins, as it did when the file was searched in order.
+ */
+static int
+au_db_index(struct au_db *db)
+{
+	u_int32_t size, h;
+	int32_t *slot;
+	int i;
+
+	au_db_endenum(db);
+	for (size = 16; size < 2 * (u_int32_t)db->adb_nent; size <<= 1)
+		;
+	db->adb_hmask = size - 1;
+	db->adb_byname = malloc(size * sizeof(int32_t));
+	db->adb_bynum = malloc(size * sizeof(int32_t));
+	if (db->adb_byname == NULL || db->adb_bynum == NULL)
+		return (-1);
+	memset(db->adb_byname, 0xff, size * sizeof(int32_t));
+	memset(db->adb_bynum, 0xff, size * sizeof(int32_t));
+	for (i = 0; i < db->adb_nent; i++) {
+		h = au_db_hashstr(db->adb_ent[i].de_name) & db->adb_hmask;
+		for (;; h = (h + 1) & db->adb_hmask) {
+			slot = &db->adb_byname[h];
+			if (*slot == -1) {
+				*slot = i;
+				break;
+			}
+			if (strcmp(db->adb_ent[*slot].de_name,
+			    db->adb_ent[i].de_name) == 0)
+				break;
+		}
+		h = au_db_hashnum(db->adb_ent[i].de_number) & db->adb_hmask;
+		for (;; h = (h + 1) & db->adb_hmask) {
+			slot = &db->adb_bynum[h];
+			if (*slot == -1) {
+				*slot = i;
+				break;
+			}
+			if (db->adb_ent[*slot].de_number ==
+			    db->adb_ent[i].de_number)
+				break;
+		}
+	}
+	return (0);
+}
+
+/*
+ * Index the enumerable entries of the class database by the lowest bit of
+ * their mask, in file order within each bit; classes with an empty mask are
+ * left out.
+ */
+static int
+au_db_index_bits(struct au_db *db)
+{
+	int pos[AU_DB_NBITS];
+	int b, i;
+
+	bzero(pos, sizeof(pos));
+	for (i = 0; i < db->adb_nenum; i++)
+		if (db->adb_ent[i].de_number != 0)
+			pos[ffs(db->adb_ent[i].de_number) - 1]++;
+	db->adb_bitstart[0] = 0;
+	for (b = 0; b < AU_DB_NBITS; b++) {
+		db->adb_bitstart[b + 1] = db->adb_bitstart[b] + pos[b];
+		pos[b] = db->adb_bitstart[b];
+	}
+	db->adb_bitent = malloc((db->adb_bitstart[AU_DB_NBITS] + 1) *
+	    sizeof(int32_t));
+	if (db->adb_bitent == NULL)
+		return (-1);
+	for (i = 0; i < db->adb_nenum; i++)
+		if (db->adb_ent[i].de_number != 0)
+			db->adb_bitent[pos[ffs(db->adb_ent[i].de_number) -
+			    1]++] = i;
+	return (0);
+}
+
+const struct au_db_ent *
+au_db_byname(const struct au_db *db, const char *name)
+{
+	const struct au_db_ent *de;
+	u_int32_t h;
+	int32_t i;
+
+	h = au_db_hashstr(name) & db->adb_hmask;
+	while ((i = db->adb_byname[h]) != -1) {
+		de = &db->adb_ent[i];
+		if (strcmp(de->de_name, name) == 0)
+			return (de);
+		h = (h + 1) & db->adb_hmask;
+	}
+	return (NULL);
+}
+
+const struct au_db_ent *
+au_db_bynum(const struct au_db *db, u_int32_t number)
+{
+	const struct au_db_ent *de;
+	u_int32_t h;
+	int32_t i;
+
+	h = au_db_hashnum(number) & db->adb_hmask;
+	while ((i = db->adb_bynum[h]) != -1) {
+		de = &db->adb_ent[i];
+		if (de->de_number == number)
+			return (de);
+		h = (h + 1) & db->adb_hmask;
+	}
+	return (NULL);
+}
+
+/*
+ * Record the identity of a text file, as compared against the one stored in
+ * the compiled database.
+ */
+static void
+au_db_identify(const char *path, struct au_dbf_source *ds)
+{
+	struct stat sb;
+
+	bzero(ds, sizeof(*ds));
+	if (stat(path, &sb) != 0)
+		return;
+	ds->ds_mtime = sb.st_mtime;
+	ds->ds_size = sb.st_size;
+	ds->ds_ino = sb.st_ino;
+}
+
+static int
+au_db_inmap(size_t len, u_int32_t off, u_int32_t n, size_t size)
+{
+
+	return (off != 0 && off % 8 == 0 && off <= len &&
+	    n <= (len - off) / size);
+}
+
+/*
+ * Map the compiled database and check its header.
+ */
+static struct au_db_map *
+au_db_map_open(void)
+{
+	const struct au_dbf_hdr *dh;
+	struct au_db_map *map;
+	struct stat sb;
+	void *addr;
+	int fd;
+
+	if ((fd = open(AUDIT_DB_FILE, O_RDONLY)) < 0)
+		return (NULL);
+	if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) ||
+	    sb.st_size < (off_t)sizeof(*dh) || sb.st_size > UINT_MAX) {
+		close(fd);
+		return (NULL);
+	}
+	addr = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return (NULL);
+	dh = addr;
+	if (dh->dh_magic != AU_DBF_MAGIC || dh->dh_version != AU_DBF_VERSION ||
+	    dh->dh_size != sb.st_size ||
+	    ((const char *)addr)[sb.st_size - 1] != '\0' ||
+	    (map = malloc(sizeof(*map))) == NULL) {
+		munmap(addr, sb.st_size);
+		return (NULL);
+	}
+	map->adm_addr = addr;
+	map->adm_len = sb.st_size;
+	map->adm_dev = sb.st_dev;
+	map->adm_ino = sb.st_ino;
+	map->adm_mtime = sb.st_mtime;
+	map->adm_refs = 1;
+	return (map);
+}
+
+/*
+ * Return a reference to the compiled database if it is current, mapping it
+ * again if it has been replaced since it was last mapped.
+ */
+static struct au_db_map *
+au_db_map_get(void)
+{
+	struct au_dbf_source ds;
+	const struct au_dbf_hdr *dh;
+	struct au_db_map *map;
+	struct stat sb;
+	int i;
+
+	map = NULL;
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_lock(&au_db_mapmutex);
+#endif
+	if (au_db_mapcur != NULL && (stat(AUDIT_DB_FILE, &sb) != 0 ||
+	    sb.st_dev != au_db_mapcur->adm_dev ||
+	    sb.st_ino != au_db_mapcur->adm_ino ||
+	    sb.st_mtime != au_db_mapcur->adm_mtime)) {
+		au_db_map_rele(au_db_mapcur);
+		au_db_mapcur = NULL;
+	}
+	if (au_db_mapcur == NULL &&
+	    (au_db_mapcur = au_db_map_open()) == NULL)
+		goto out;
+	dh = (const struct au_dbf_hdr *)au_db_mapcur->adm_addr;
+	for (i = 0; i < AU_DB_MAX; i++) {
+		au_db_identify(au_db_source[i], &ds);
+		if (memcmp(&ds, &dh->dh_source[i], sizeof(ds)) != 0)
+			goto out;
+	}
+	map = au_db_mapcur;
+	__atomic_add_fetch(&map->adm_refs, 1, __ATOMIC_SEQ_CST);
+out:
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&au_db_mapmutex);
+#endif
+	return (map);
+}
+
+/*
+ * Take a snapshot from the compiled database.  Only the entries are
+ * allocated, to turn the offsets of their strings into pointers; the
+ * indexes are used where they lie in the mapping.  On failure the snapshot
+ * is left empty, to be loaded from the text file instead.
+ */
+static int
+au_db_mapload(struct au_db *db, int which)
+{
+	const struct au_dbf_table *dt;
+	const struct au_dbf_hdr *dh;
+	const struct au_dbf_ent *df;
+	const int32_t *byname, *bynum;
+	struct au_db_map *map;
+	struct au_db_ent *ent;
+	u_int32_t hsize, i;
+	const char *base;
+	int empty;
+
+	if ((map = au_db_map_get()) == NULL)
+		return (-1);
+	base = map->adm_addr;
+	dh = (const struct au_dbf_hdr *)base;
+	dt = &dh->dh_table[which];
+	ent = NULL;
+	hsize = dt->dt_hmask + 1;
+	if (!dt->dt_present || dt->dt_nenum > dt->dt_nent || hsize < 16 ||
+	    (hsize & dt->dt_hmask) != 0 ||
+	    !au_db_inmap(map->adm_len, dt->dt_ent, dt->dt_nent,
+	    sizeof(*df)) ||
+	    !au_db_inmap(map->adm_len, dt->dt_byname, hsize, sizeof(int32_t)) ||
+	    !au_db_inmap(map->adm_len, dt->dt_bynum, hsize, sizeof(int32_t)))
+		goto fail;
+	if (which == AU_DB_EVENT &&
+	    (!au_db_inmap(map->adm_len, dt->dt_evclass, AU_DB_NEVENTS,
+	    sizeof(au_class_t)) ||
+	    !au_db_inmap(map->adm_len, dt->dt_evknown, AU_DB_NEVENTS / 32,
+	    sizeof(u_int32_t))))
+		goto fail;
+
+	/*
+	 * Lookups probe until they find an empty slot, so there must be one,
+	 * and every other slot must name an entry.
+	 */
+	byname = (const int32_t *)(base + dt->dt_byname);
+	bynum = (const int32_t *)(base + dt->dt_bynum);
+	empty = 0;
+	for (i = 0; i < hsize; i++) {
+		if (byname[i] < -1 || byname[i] >= (int32_t)dt->dt_nent ||
+		    bynum[i] < -1 || bynum[i] >= (int32_t)dt->dt_nent)
+			goto fail;
+		if (byname[i] == -1)
+			empty |= 1;
+		if (bynum[i] == -1)
+			empty |= 2;
+	}
+	if (empty != 3)
+		goto fail;
+
+	ent = calloc(dt->dt_nent != 0 ? dt->dt_nent : 1, sizeof(*ent));
+	if (ent == NULL)
+		goto fail;
+	df = (const struct au_dbf_ent *)(base + dt->dt_ent);
+	for (i = 0; i < dt->dt_nent; i++, df++) {
+		if (df->df_name == 0 || df->df_name >= map->adm_len ||
+		    df->df_desc >= map->adm_len)
+			goto fail;
+		ent[i].de_name = base + df->df_name;
+		ent[i].de_desc = df->df_desc != 0 ? base + df->df_desc : NULL;
+		ent[i].de_number = df->df_number;
+		ent[i].de_class = df->df_class;
+		ent[i].de_always.am_success = df->df_always_s;
+		ent[i].de_always.am_failure = df->df_always_f;
+		ent[i].de_never.am_success = df->df_never_s;
+		ent[i].de_never.am_failure = df->df_never_f;
+	}
+	db->adb_ent = ent;
+	db->adb_nent = dt->dt_nent;
+	db->adb_nenum = dt->dt_nenum;
+	db->adb_enumset = 1;
+	db->adb_size = dt->dt_nent;
+	db->adb_byname = (int32_t *)byname;
+	db->adb_bynum = (int32_t *)bynum;
+	db->adb_hmask = dt->dt_hmask;
+	if (which == AU_DB_EVENT) {
+		db->adb_evclass = (au_class_t *)(base + dt->dt_evclass);
+		db->adb_evknown = (u_int32_t *)(base + dt->dt_evknown);
+	}
+	db->adb_map = map;
+	return (0);
+
+fail:
+	free(ent);
+	au_db_map_rele(map);
+	return (-1);
+}
+
+/*
+ * Record the files a snapshot is about to be read from.  They are
+ * identified first, so that a change while they are read makes the
+ * snapshot stale rather than wrong.
+ */
+static void
+au_db_identify_all(struct au_db *db)
+{
+	struct timespec ts;
+	int i;
+
+	if (clock_gettime(AU_DB_CLOCK, &ts) < 0)
+		ts.tv_sec = 0;
+	db->adb_checked = ts.tv_sec;
+	for (i = 0; i < AU_DB_MAX; i++)
+		au_db_identify(au_db_source[i], &db->adb_source[i]);
+}
+
+/*
+ * Return a mask of the databases whose files have changed since a snapshot
+ * was read, if they have not been compared in the last interval.  Several
+ * readers may compare at once; they reach the same result.
+ */
+static int
+au_db_changed(const struct au_db *db, int which)
+{
+	struct au_dbf_source ds;
+	struct timespec ts;
+	time_t checked;
+	int i, stale;
+
+	if (clock_gettime(AU_DB_CLOCK, &ts) < 0)
+		return (0);
+	checked = __atomic_load_n(&db->adb_checked, __ATOMIC_RELAXED);
+	if (ts.tv_sec >= checked &&
+	    ts.tv_sec - checked < AU_DB_CHECK_INTERVAL)
+		return (0);
+	__atomic_store_n((time_t *)&db->adb_checked, ts.tv_sec,
+	    __ATOMIC_RELAXED);
+	stale = 0;
+	for (i = 0; i < AU_DB_MAX; i++) {
+		if ((au_db_deps[which] & (1 << i)) == 0)
+			continue;
+		au_db_identify(au_db_source[i], &ds);
+		if (memcmp(&ds, &db->adb_source[i], sizeof(ds)) != 0)
+			stale |= 1 << i;
+	}
+	return (stale);
+}
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+/*
+ * A thread that exits gives up its slot.  In a new child process only the
+ * forking thread remains, so every other slot is given up too.
+ */
+static void
+au_db_slot_rele(void *arg)
+{
+	struct au_db_slot *ads;
+	int i;
+
+	ads = arg;
+	for (i = 0; i < AU_DB_MAX; i++) {
+		ads->ads_depth[i] = 0;
+		__atomic_store_n(&ads->ads_epoch[i], AU_DB_IDLE,
+		    __ATOMIC_SEQ_CST);
+	}
+	__atomic_store_n(&ads->ads_used, 0, __ATOMIC_SEQ_CST);
+}
+
+static void
+au_db_postfork_child(void)
+{
+	struct au_db_slot *ads, *mine;
+
+	mine = pthread_getspecific(au_db_key);
+	for (ads = au_db_slots; ads != NULL; ads = ads->ads_next)
+		if (ads != mine)
+			au_db_slot_rele(ads);
+}
+
+static void
+au_db_slot_init(void)
+{
+
+	au_db_keyerr = pthread_key_create(&au_db_key, au_db_slot_rele);
+	if (au_db_keyerr == 0)
+		(void)pthread_atfork(NULL, NULL, au_db_postfork_child);
+}
+
+/*
+ * Return the calling thread's slot, taking a free one or adding one on its
+ * first call.
+ */
+static struct au_db_slot *
+au_db_slot(void)
+{
+	struct au_db_slot *ads;
+	int i, unused;
+
+	(void)pthread_once(&au_db_once, au_db_slot_init);
+	if (au_db_keyerr != 0) {
+		errno = au_db_keyerr;
+		return (NULL);
+	}
+	if ((ads = pthread_getspecific(au_db_key)) != NULL)
+		return (ads);
+	for (ads = __atomic_load_n(&au_db_slots, __ATOMIC_SEQ_CST);
+	    ads != NULL; ads = ads->ads_next) {
+		unused = 0;
+		if (__atomic_compare_exchange_n(&ads->ads_used, &unused, 1, 0,
+		    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			break;
+	}
+	if (ads == NULL) {
+		if ((ads = calloc(1, sizeof(*ads))) == NULL)
+			return (NULL);
+		for (i = 0; i < AU_DB_MAX; i++)
+			ads->ads_epoch[i] = AU_DB_IDLE;
+		ads->ads_used = 1;
+		ads->ads_next = __atomic_load_n(&au_db_slots,
+		    __ATOMIC_SEQ_CST);
+		while (!__atomic_compare_exchange_n(&au_db_slots,
+		    &ads->ads_next, ads, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			;
+	}
+	if (pthread_setspecific(au_db_key, ads) != 0) {
+		au_db_slot_rele(ads);
+		return (NULL);
+	}
+	return (ads);
+}
+
+/*
+ * Return the calling thread's slot, or NULL if it has none.
+ */
+static struct au_db_slot *
+au_db_slot_get(void)
+{
+
+	(void)pthread_once(&au_db_once, au_db_slot_init);
+	if (au_db_keyerr != 0)
+		return (NULL);
+	return (pthread_getspecific(au_db_key));
+}
+#else
+static struct au_db_slot *
+au_db_slot(void)
+{
+
+	return (&au_db_slot0);
+}
+
+static struct au_db_slot *
+au_db_slot_get(void)
+{
+
+	return (&au_db_slot0);
+}
+#endif
+
+/*
+ * Put a snapshot that has been replaced on the retired list, tagged with
+ * the epoch it was current in.  Called with the mutex held, after the swap.
+ */
+static void
+au_db_retire(int which, struct au_db *db)
+{
+
+	db->adb_retire = __atomic_fetch_add(&au_db_epoch, 1,
+	    __ATOMIC_SEQ_CST);
+	db->adb_next = au_db_retired[which];
+	__atomic_store_n(&au_db_retired[which], db, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&au_db_nretired[which], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Free the retired snapshots no reader can still be using: those retired
+ * in an epoch before the oldest any reader entered in.  Called with the
+ * mutex held.
+ */
+static void
+au_db_reap(int which)
+{
+	struct au_db_slot *ads;
+	struct au_db **dbp, *db;
+	u_int64_t epoch, oldest;
+
+	oldest = AU_DB_IDLE;
+	for (ads = __atomic_load_n(&au_db_slots, __ATOMIC_SEQ_CST);
+	    ads != NULL; ads = ads->ads_next) {
+		epoch = __atomic_load_n(&ads->ads_epoch[which],
+		    __ATOMIC_SEQ_CST);
+		if (epoch < oldest)
+			oldest = epoch;
+	}
+	for (dbp = &au_db_retired[which]; (db = *dbp) != NULL; ) {
+		if (db->adb_retire < oldest) {
+			__atomic_store_n(dbp, db->adb_next, __ATOMIC_SEQ_CST);
+			__atomic_sub_fetch(&au_db_nretired[which], 1,
+			    __ATOMIC_RELAXED);
+			au_db_free(db);
+		} else
+			dbp = &db->adb_next;
+	}
+}
+
+/*
+ * Wait for readers to leave until no more than AU_DB_MAXRETIRED snapshots
+ * are retired.  A caller that is itself reading any database does not
+ * wait, as a reader it waits for could be waiting for it in turn.
+ */
+static void
+au_db_drain(int which)
+{
+	struct au_db_slot *ads;
+	int i;
+
+	if ((ads = au_db_slot_get()) != NULL)
+		for (i = 0; i < AU_DB_MAX; i++)
+			if (ads->ads_depth[i] != 0)
+				return;
+	while (__atomic_load_n(&au_db_nretired[which], __ATOMIC_RELAXED) >
+	    AU_DB_MAXRETIRED) {
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		sched_yield();
+		pthread_mutex_lock(&au_db_mutex[which]);
+#endif
+		au_db_reap(which);
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_unlock(&au_db_mutex[which]);
+#endif
+	}
+}
+
+/*
+ * Read a database into a new snapshot, from the compiled database if it is
+ * current and from the text file otherwise.
+ */
+static struct au_db *
+au_db_build(int which)
+{
+	struct au_db *db;
+
+	if ((db = calloc(1, sizeof(*db))) == NULL)
+		return (NULL);
+	db->adb_gen = __atomic_add_fetch(&au_db_gen, 1, __ATOMIC_SEQ_CST);
+	au_db_identify_all(db);
+	if ((au_db_mapload(db, which) != 0 &&
+	    (au_db_load[which](db) != 0 || au_db_index(db) != 0)) ||
+	    (which == AU_DB_CLASS && au_db_index_bits(db) != 0)) {
+		au_db_free(db);
+		return (NULL);
+	}
+	return (db);
+}
+
+const struct au_db *
+au_db_enter(int which)
+{
+	struct au_db_slot *ads;
+	struct au_db *db;
+	int i, stale;
+
+	if ((ads = au_db_slot()) == NULL)
+		return (NULL);
+	for (;;) {
+		if (ads->ads_depth[which]++ == 0)
+			__atomic_store_n(&ads->ads_epoch[which],
+			    __atomic_load_n(&au_db_epoch, __ATOMIC_ACQUIRE),
+			    __ATOMIC_SEQ_CST);
+		db = __atomic_load_n(&au_db_cur[which], __ATOMIC_SEQ_CST);
+		if (db != NULL) {
+			if (!au_db_recheck[which] ||
+			    (stale = au_db_changed(db, which)) == 0)
+				return (db);
+			au_db_exit(which);
+			for (i = 0; i < AU_DB_MAX; i++)
+				if (stale & (1 << i))
+					au_db_invalidate(i);
+			continue;
+		}
+		au_db_exit(which);
+
+		if ((db = au_db_build(which)) == NULL)
+			return (NULL);
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_lock(&au_db_mutex[which]);
+#endif
+		if (au_db_cur[which] == NULL &&
+		    db->adb_gen > au_db_floor[which]) {
+			__atomic_store_n(&au_db_cur[which], db,
+			    __ATOMIC_SEQ_CST);
+			db = NULL;
+		}
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_unlock(&au_db_mutex[which]);
+#endif
+		if (db != NULL)
+			au_db_free(db);
+	}
+}
+
+void
+au_db_exit(int which)
+{
+	struct au_db_slot *ads;
+
+	ads = au_db_slot_get();
+	if (--ads->ads_depth[which] != 0)
+		return;
+	__atomic_store_n(&ads->ads_epoch[which], AU_DB_IDLE, __ATOMIC_RELEASE);
+	if (__atomic_load_n(&au_db_retired[which], __ATOMIC_ACQUIRE) == NULL)
+		return;
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	if (pthread_mutex_trylock(&au_db_mutex[which]) != 0)
+		return;
+#endif
+	au_db_reap(which);
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&au_db_mutex[which]);
+#endif
+}
+
+/*
+ * Discard the current snapshot of a database.  Event and user entries hold
+ * class masks resolved against audit_class, so discarding the class
+ * snapshot discards those too.
+ */
+void
+au_db_invalidate(int which)
+{
+	struct au_db *db;
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_lock(&au_db_mutex[which]);
+#endif
+	au_db_floor[which] = __atomic_load_n(&au_db_gen, __ATOMIC_SEQ_CST);
+	db = __atomic_exchange_n(&au_db_cur[which], NULL, __ATOMIC_SEQ_CST);
+	if (db != NULL)
+		au_db_retire(which, db);
+	au_db_reap(which);
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&au_db_mutex[which]);
+#endif
+	au_db_drain(which);
+	if (which == AU_DB_CLASS) {
+		au_db_invalidate(AU_DB_EVENT);
+		au_db_invalidate(AU_DB_USER);
+	}
+}
+
+/*
+ * Append data to the compiled database being built, at an offset aligned
+ * as requested.
+ */
+static int
+au_dbf_append(struct au_dbf_buf *b, const void *data, size_t len,
+    size_t align, u_int32_t *offp)
+{
+	size_t off, size;
+	char *p;
+
+	off = (b->db_len + align - 1) & ~(align - 1);
+	if (off + len > UINT_MAX) {
+		errno = EFBIG;
+		return (-1);
+	}
+	if (off + len > b->db_size) {
+		for (size = b->db_size != 0 ? b->db_size : AU_DB_POOLSIZE;
+		    size < off + len; size *= 2)
+			;
+		if ((p = realloc(b->db_data, size)) == NULL)
+			return (-1);
+		memset(p + b->db_size, 0, size - b->db_size);
+		b->db_data = p;
+		b->db_size = size;
+	}
+	memcpy(b->db_data + off, data, len);
+	b->db_len = off + len;
+	*offp = off;
+	return (0);
+}
+
+/*
+ * Load one database from its text file and append it to the compiled
+ * database.  A database that cannot be loaded is marked absent, so that it
+ * is looked for in the text file when used.
+ */
+static int
+au_dbf_write_table(struct au_dbf_buf *b, int which, struct au_dbf_table *dt)
+{
+	const struct au_db_ent *de;
+	struct au_dbf_ent *df;
+	struct au_db *db;
+	int error, i;
+
+	bzero(dt, sizeof(*dt));
+	if ((db = calloc(1, sizeof(*db))) == NULL)
+		return (-1);
+	if (au_db_load[which](db) != 0 || au_db_index(db) != 0) {
+		au_db_free(db);
+		return (0);
+	}
+	error = -1;
+	df = calloc(db->adb_nent != 0 ? db->adb_nent : 1, sizeof(*df));
+	if (df == NULL)
+		goto out;
+	for (i = 0; i < db->adb_nent; i++) {
+		de = &db->adb_ent[i];
+		if (au_dbf_append(b, de->de_name, strlen(de->de_name) + 1, 1,
+		    &df[i].df_name) != 0)
+			goto out;
+		if (de->de_desc != NULL && au_dbf_append(b, de->de_desc,
+		    strlen(de->de_desc) + 1, 1, &df[i].df_desc) != 0)
+			goto out;
+		df[i].df_number = de->de_number;
+		df[i].df_class = de->de_class;
+		df[i].df_always_s = de->de_always.am_success;
+		df[i].df_always_f = de->de_always.am_failure;
+		df[i].df_never_s = de->de_never.am_success;
+		df[i].df_never_f = de->de_never.am_failure;
+	}
+	if (au_dbf_append(b, df, db->adb_nent * sizeof(*df), 8,
+	    &dt->dt_ent) != 0 ||
+	    au_dbf_append(b, db->adb_byname, (db->adb_hmask + 1) *
+	    sizeof(int32_t), 8, &dt->dt_byname) != 0 ||
+	    au_dbf_append(b, db->adb_bynum, (db->adb_hmask + 1) *
+	    sizeof(int32_t), 8, &dt->dt_bynum) != 0)
+		goto out;
+	if (db->adb_evclass != NULL &&
+	    (au_dbf_append(b, db->adb_evclass, AU_DB_NEVENTS *
+	    sizeof(au_class_t), 8, &dt->dt_evclass) != 0 ||
+	    au_dbf_append(b, db->adb_evknown, AU_DB_NEVENTS / 32 *
+	    sizeof(u_int32_t), 8, &dt->dt_evknown) != 0))
+		goto out;
+	dt->dt_present = 1;
+	dt->dt_nent = db->adb_nent;
+	dt->dt_nenum = db->adb_nenum;
+	dt->dt_hmask = db->adb_hmask;
+	error = 0;
+out:
+	free(df);
+	au_db_free(db);
+	return (error);
+}
+
+/*
+ * The mode to give the compiled database: no permission any of the text
+ * files it is compiled from lacks, and no group permission unless they all
+ * belong to the group the new file does.  audit_user is often readable by
+ * root alone, and the compiled database must not make it readable by more.
+ */
+static mode_t
+au_db_mode(int fd)
+{
+	struct stat sb;
+	mode_t mode;
+	gid_t gid;
+	int i;
+
+	if (fstat(fd, &sb) != 0)
+		return (S_IRUSR | S_IWUSR);
+	gid = sb.st_gid;
+	mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+	for (i = 0; i < AU_DB_MAX; i++) {
+		if (stat(au_db_source[i], &sb) != 0)
+			continue;
+		mode &= sb.st_mode;
+		if (sb.st_gid != gid)
+			mode &= ~(S_IRGRP | S_IWGRP);
+	}
+	return (mode | S_IRUSR | S_IWUSR);
+}
+
+/*
+ * Compile the text databases into path, or AUDIT_DB_FILE if path is NULL.
+ * The file is written under a temporary name and renamed into place, so
+ * that readers see either the old database or the new one.
+ */
+int
+au_compile_db(const char *path)
+{
+	char tmp[PATH_MAX];
+	struct au_dbf_hdr dh;
+	struct au_dbf_buf b;
+	u_int32_t off;
+	size_t done;
+	ssize_t len;
+	int error, fd, i;
+
+	if (path == NULL)
+		path = AUDIT_DB_FILE;
+	bzero(&dh, sizeof(dh));
+	bzero(&b, sizeof(b));
+	dh.dh_magic = AU_DBF_MAGIC;
+	dh.dh_version = AU_DBF_VERSION;
+
+	/*
+	 * Identify the text files before reading them: if one changes while
+	 * it is being read, the result is then stale rather than wrong.  The
+	 * event and user loaders resolve class names, so make sure they do
+	 * so against audit_class as it is now.
+	 */
+	for (i = 0; i < AU_DB_MAX; i++)
+		au_db_identify(au_db_source[i], &dh.dh_source[i]);
+	au_db_invalidate(AU_DB_CLASS);
+	if (au_dbf_append(&b, &dh, sizeof(dh), 8, &off) != 0)
+		goto fail;
+	for (i = 0; i < AU_DB_MAX; i++)
+		if (au_dbf_write_table(&b, i, &dh.dh_table[i]) != 0)
+			goto fail;
+	if (au_dbf_append(&b, "", 1, 1, &off) != 0)
+		goto fail;
+	dh.dh_size = b.db_len;
+	memcpy(b.db_data, &dh, sizeof(dh));
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >=
+	    (int)sizeof(tmp)) {
+		errno = ENAMETOOLONG;
+		goto fail;
+	}
+	if ((fd = mkstemp(tmp)) < 0)
+		goto fail;
+	for (done = 0; done < b.db_len; done += len) {
+		len = write(fd, b.db_data + done, b.db_len - done);
+		if (len < 0) {
+			if (errno == EINTR) {
+				len = 0;
+				continue;
+			}
+			break;
+		}
+	}
+	if (done < b.db_len || fchmod(fd, au_db_mode(fd)) != 0 || fsync(fd) != 0) {
+		error = errno;
+		close(fd);
+		unlink(tmp);
+		errno = error;
+		goto fail;
+	}
+	if (close(fd) != 0 || rename(tmp, path) != 0) {
+		error = errno;
+		unlink(tmp);
+		errno = error;
+		goto fail;
+	}
+	free(b.db_data);
+	return (0);
+
+fail:
+	error = errno;
+	free(b.db_data);
+	errno = error;
+	return (-1);
+}
+
+/*
+ * Read a database again and publish the new snapshot in place of the
+ * current one, which readers go on using until the switch.  If the database
+ * cannot be read, the current snapshot is discarded instead, so that the
+ * next reader tries again.  A database not yet loaded is left for its first
+ * reader, and dependent databases are not reloaded.  The new snapshot is
+ * dropped if a newer one was published or the database was invalidated
+ * while it was being read.
+ */
+void
+au_db_reload(int which)
+{
+	struct au_db *db, *old;
+
+	if (__atomic_load_n(&au_db_cur[which], __ATOMIC_SEQ_CST) == NULL)
+		return;
+	if ((db = au_db_build(which)) == NULL) {
+		au_db_invalidate(which);
+		return;
+	}
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_lock(&au_db_mutex[which]);
+#endif
+	old = au_db_cur[which];
+	if (old != NULL && db->adb_gen > old->adb_gen &&
+	    db->adb_gen > au_db_floor[which]) {
+		__atomic_store_n(&au_db_cur[which], db, __ATOMIC_SEQ_CST);
+		au_db_retire(which, old);
+		au_db_reap(which);
+		db = NULL;
+	}
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&au_db_mutex[which]);
+#endif
+	if (db != NULL)
+		au_db_free(db);
+	au_db_drain(which);
+}
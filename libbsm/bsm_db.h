@@ -0,0 +1,187 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LIBBSM_BSM_DB_H_
+#define	_LIBBSM_BSM_DB_H_
+
+/*
+ * Private to libbsm: immutable in-memory snapshots of the audit_event,
+ * audit_class and audit_user databases.  Each snapshot is loaded from its
+ * file on first use, indexed by name and by number, and published through a
+ * pointer that readers load without locking.  A snapshot is replaced as a
+ * whole; one that has been replaced is freed once no reader can still be
+ * using it.
+ */
+
+#define	AU_DB_EVENT	0
+#define	AU_DB_CLASS	1
+#define	AU_DB_USER	2
+#define	AU_DB_MAX	3
+
+/*
+ * Size of the direct-indexed event to class table built for preselection.
+ */
+#define	AU_DB_NEVENTS	65536
+
+/*
+ * Classes are indexed by the lowest bit of their mask, for
+ * getauditflagschar(3).
+ */
+#define	AU_DB_NBITS	32
+
+#define	AU_DB_EVKNOWN(db, ev)						\
+	(((db)->adb_evknown[(ev) / 32] & (1U << ((ev) % 32))) != 0)
+
+/*
+ * One entry of any of the databases; fields not used by a database are
+ * zero.
+ */
+struct au_db_ent {
+	const char	*de_name;
+	const char	*de_desc;	/* Event or class description. */
+	u_int32_t	 de_number;	/* Event number or class mask. */
+	au_class_t	 de_class;	/* Classes of an event. */
+	au_mask_t	 de_always;	/* Masks of a user. */
+	au_mask_t	 de_never;
+};
+
+/*
+ * Identity of a text file a snapshot was loaded from.
+ */
+struct au_dbf_source {
+	int64_t		ds_mtime;
+	int64_t		ds_size;
+	u_int64_t	ds_ino;		/* Zero if the file did not exist. */
+};
+
+struct au_db_map;
+struct au_db_pool;
+
+struct au_db {
+	struct au_db_ent	*adb_ent;
+	int			 adb_nent;
+	int			 adb_nenum;	/* Entries seen by getau*ent(). */
+	int			 adb_enumset;
+	int			 adb_size;	/* Allocated entries. */
+	int32_t			*adb_byname;	/* Hash of names. */
+	int32_t			*adb_bynum;	/* Hash of numbers. */
+	u_int32_t		 adb_hmask;
+	au_class_t		*adb_evclass;	/* Classes by event number. */
+	u_int32_t		*adb_evknown;	/* Bitmap of known events. */
+	int32_t			*adb_bitent;	/* Classes by lowest bit; */
+	int			 adb_bitstart[AU_DB_NBITS + 1]; /* by bit. */
+	struct au_db_pool	*adb_pool;	/* String storage. */
+	struct au_db_map	*adb_map;	/* Or the compiled database. */
+	u_int			 adb_gen;	/* Unique to this snapshot. */
+	struct au_dbf_source	 adb_source[AU_DB_MAX]; /* Files read. */
+	time_t			 adb_checked;	/* Sources last compared. */
+	struct au_db		*adb_next;	/* Retired snapshots. */
+	u_int64_t		 adb_retire;	/* Epoch when replaced. */
+};
+
+/*
+ * Layout of the compiled database written by au_compile_db(3).  It holds
+ * the snapshots of all three databases in the form used in memory, with
+ * pointers replaced by file offsets, and the identity of each text file it
+ * was compiled from; it is used only while all of those are unchanged.
+ * Offsets are from the start of the file, aligned to 8 bytes, and a string
+ * offset of zero stands for NULL.  The file ends with a NUL byte, so no
+ * string can run past its end.  Integers are in host byte order; a file
+ * written on another host fails the magic number check.
+ */
+#define	AU_DBF_MAGIC	0x41554442	/* "AUDB" */
+#define	AU_DBF_VERSION	1
+
+struct au_dbf_table {
+	u_int32_t	dt_present;	/* Zero if the text loader failed. */
+	u_int32_t	dt_nent;
+	u_int32_t	dt_nenum;
+	u_int32_t	dt_hmask;
+	u_int32_t	dt_ent;
+	u_int32_t	dt_byname;
+	u_int32_t	dt_bynum;
+	u_int32_t	dt_evclass;	/* Event table only. */
+	u_int32_t	dt_evknown;
+	u_int32_t	dt_pad;
+};
+
+struct au_dbf_ent {
+	u_int32_t	df_name;
+	u_int32_t	df_desc;
+	u_int32_t	df_number;
+	u_int32_t	df_class;
+	u_int32_t	df_always_s;
+	u_int32_t	df_always_f;
+	u_int32_t	df_never_s;
+	u_int32_t	df_never_f;
+};
+
+struct au_dbf_hdr {
+	u_int32_t		dh_magic;
+	u_int32_t		dh_version;
+	u_int32_t		dh_size;
+	u_int32_t		dh_pad;
+	struct au_dbf_source	dh_source[AU_DB_MAX];
+	struct au_dbf_table	dh_table[AU_DB_MAX];
+};
+
+/*
+ * Loaders, one per database, and the functions they use to fill in a new
+ * snapshot.
+ */
+int			 au_db_load_event(struct au_db *db);
+int			 au_db_load_class(struct au_db *db);
+int			 au_db_load_user(struct au_db *db);
+int			 au_db_add(struct au_db *db,
+			    const struct au_db_ent *de);
+void			 au_db_endenum(struct au_db *db);
+
+/*
+ * Used by readers: au_db_enter() returns the current snapshot, loading it
+ * if need be, and the caller must call au_db_exit() once it has finished
+ * with any entry found in it; au_db_enter() returns NULL if the database
+ * cannot be loaded.  A thread may enter a database it is already in.
+ * au_db_invalidate() causes the next reader to load a fresh snapshot;
+ * au_db_reload() loads one and replaces the current snapshot with it, so
+ * that readers need not wait.
+ */
+const struct au_db	*au_db_enter(int which);
+void			 au_db_exit(int which);
+void			 au_db_invalidate(int which);
+void			 au_db_reload(int which);
+const struct au_db_ent	*au_db_byname(const struct au_db *db,
+			    const char *name);
+const struct au_db_ent	*au_db_bynum(const struct au_db *db,
+			    u_int32_t number);
+u_int32_t		 au_db_hashstr(const char *str);
+
+/*
+ * The audit_control file has its own snapshot, in bsm_control.c; this reads
+ * it again and replaces the latest snapshot.
+ */
+void			 au_control_reload(void);
+
+#endif /* !_LIBBSM_BSM_DB_H_ */
@@ -442,11 +442,22 @@ static const struct bsm_domain bsm_domains[] = {
 static const int bsm_domains_count = sizeof(bsm_domains) /
 	    sizeof(bsm_domains[0]);
 
+/*
+ * Lookups use indexes of bsm_domains by each constant, generated from it by
+ * bsm_mktables, and only search it for values beyond them.
+ */
+#ifndef BSM_MKTABLES
+#include "bsm_tables.h"
+
 static const struct bsm_domain *
 bsm_lookup_local_domain(int local_domain)
 {
 	int i;
 
+	if (local_domain >= 0 && local_domain < BSM_DOMAINS_NLOCAL) {
+		i = bsm_domains_bylocal[local_domain];
+		return (i != 0 ? &bsm_domains[i - 1] : NULL);
+	}
 	for (i = 0; i < bsm_domains_count; i++) {
 		if (bsm_domains[i].bd_local_domain == local_domain)
 			return (&bsm_domains[i]);
@@ -470,6 +481,10 @@ bsm_lookup_bsm_domain(u_short bsm_domain)
 {
 	int i;
 
+	if (bsm_domain < BSM_DOMAINS_NBSM) {
+		i = bsm_domains_bybsm[bsm_domain];
+		return (i != 0 ? &bsm_domains[i - 1] : NULL);
+	}
 	for (i = 0; i < bsm_domains_count; i++) {
 		if (bsm_domains[i].bd_bsm_domain == bsm_domain)
 			return (&bsm_domains[i]);
@@ -488,3 +503,4 @@ au_bsm_to_domain(u_short bsm_domain, int *local_domainp)
 	*local_domainp = bstp->bd_local_domain;
 	return (0);
 }
+#endif /* !BSM_MKTABLES */
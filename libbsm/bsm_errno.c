@@ -64,14 +64,13 @@ struct bsm_errno {
 
 /*
  * Mapping table -- please maintain in numeric sorted order with respect to
- * the BSM constant.  Today we do a linear lookup, but could switch to a
- * binary search if it makes sense.  We only ifdef errors that aren't
- * generally available, but it does make the table a lot more ugly.
+ * the BSM constant.  We only ifdef errors that aren't generally available,
+ * but it does make the table a lot more ugly.
  *
- * XXXRW: It would be nice to have a similar ordered table mapping to BSM
- * constant from local constant, but the order of local constants varies by
- * OS.  Really we need to build that table at compile-time but don't do that
- * yet.
+ * Lookups in either direction go through indexes of the table by BSM and
+ * by local constant, generated at build time by bsm_mktables, as the order
+ * of local constants varies by OS.  Values outside the indexes fall back
+ * to a linear search.
  *
  * XXXRW: We currently embed English-language error strings here, but should
  * support catalogues; these are only used if the OS doesn't have an error
@@ -706,11 +705,18 @@ static const struct bsm_errno bsm_errnos[] = {
 };
 static const int bsm_errnos_count = sizeof(bsm_errnos) / sizeof(bsm_errnos[0]);
 
+#ifndef BSM_MKTABLES
+#include "bsm_tables.h"
+
 static const struct bsm_errno *
 bsm_lookup_errno_local(int local_errno)
 {
 	int i;
 
+	if (local_errno >= 0 && local_errno < BSM_ERRNOS_NLOCAL) {
+		i = bsm_errnos_bylocal[local_errno];
+		return (i != 0 ? &bsm_errnos[i - 1] : NULL);
+	}
 	for (i = 0; i < bsm_errnos_count; i++) {
 		if (bsm_errnos[i].be_local_errno == local_errno)
 			return (&bsm_errnos[i]);
@@ -738,6 +744,10 @@ bsm_lookup_errno_bsm(u_char bsm_errno)
 {
 	int i;
 
+	if (bsm_errno < BSM_ERRNOS_NBSM) {
+		i = bsm_errnos_bybsm[bsm_errno];
+		return (i != 0 ? &bsm_errnos[i - 1] : NULL);
+	}
 	for (i = 0; i < bsm_errnos_count; i++) {
 		if (bsm_errnos[i].be_bsm_errno == bsm_errno)
 			return (&bsm_errnos[i]);
@@ -776,3 +786,4 @@ au_strerror(u_char bsm_errno)
 	return (bsme->be_strerror);
 }
 #endif
+#endif /* !BSM_MKTABLES */
@@ -43,13 +43,15 @@
 #include <compat/strlcpy.h>
 #endif
 
+#include "bsm_db.h"
+
 
 /*
- * Parse the contents of the audit_event file to return
- * au_event_ent entries
+ * The audit_event file is loaded into a snapshot (see bsm_db.h) on first
+ * use; lookups by name or number are then served from its indexes, and
+ * enumeration walks its entries with a cursor protected by the mutex.
  */
-static FILE		*fp = NULL;
-static char		 linestr[AU_LINE_MAX];
+static int		 cursor = 0;
 static const char	*eventdelim = ":";
 
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
@@ -102,16 +104,84 @@ eventfromstr(char *str, struct au_event_ent *e)
 }
 
 /*
- * Rewind the audit_event file.
+ * Load every entry of the audit_event file into a snapshot.  Lines that
+ * cannot be parsed are skipped, as the lookup functions always have, but end
+ * the entries visible to getauevent().
  */
-static void
-setauevent_locked(void)
+int
+au_db_load_event(struct au_db *db)
+{
+	char linestr[AU_LINE_MAX];
+	char event_ent_name[AU_EVENT_NAME_MAX];
+	char event_ent_desc[AU_EVENT_DESC_MAX];
+	struct au_event_ent e;
+	struct au_db_ent de;
+	au_event_t ev;
+	FILE *fp;
+	char *nl;
+	int i;
+
+	if ((fp = fopen(AUDIT_EVENT_FILE, "r")) == NULL)
+		return (-1);
+	e.ae_name = event_ent_name;
+	e.ae_desc = event_ent_desc;
+	bzero(&de, sizeof(de));
+	while (fgets(linestr, AU_LINE_MAX, fp) != NULL) {
+		/* Remove new lines. */
+		if ((nl = strrchr(linestr, '\n')) != NULL)
+			*nl = '\0';
+
+		/* Skip comments. */
+		if (linestr[0] == '#')
+			continue;
+
+		if (eventfromstr(linestr, &e) == NULL) {
+			au_db_endenum(db);
+			continue;
+		}
+		de.de_name = e.ae_name;
+		de.de_desc = e.ae_desc;
+		de.de_number = e.ae_number;
+		de.de_class = e.ae_class;
+		if (au_db_add(db, &de) != 0) {
+			fclose(fp);
+			return (-1);
+		}
+	}
+	fclose(fp);
+
+	/*
+	 * Build the direct-indexed class table used by au_preselect(3) from
+	 * the entries getauevent() would return.  Where an event number
+	 * appears twice the later entry wins, as it always has there.
+	 */
+	au_db_endenum(db);
+	db->adb_evclass = calloc(AU_DB_NEVENTS, sizeof(au_class_t));
+	db->adb_evknown = calloc(AU_DB_NEVENTS / 32, sizeof(u_int32_t));
+	if (db->adb_evclass == NULL || db->adb_evknown == NULL)
+		return (-1);
+	for (i = 0; i < db->adb_nenum; i++) {
+		ev = db->adb_ent[i].de_number;
+		db->adb_evclass[ev] = db->adb_ent[i].de_class;
+		db->adb_evknown[ev / 32] |= 1U << (ev % 32);
+	}
+	return (0);
+}
+
+static struct au_event_ent *
+copyauevent(struct au_event_ent *e, const struct au_db_ent *de)
 {
 
-	if (fp != NULL)
-		fseek(fp, 0, SEEK_SET);
+	e->ae_number = de->de_number;
+	strlcpy(e->ae_name, de->de_name, AU_EVENT_NAME_MAX);
+	strlcpy(e->ae_desc, de->de_desc, AU_EVENT_DESC_MAX);
+	e->ae_class = de->de_class;
+	return (e);
 }
 
+/*
+ * Rewind the audit_event file.
+ */
 void
 setauevent(void)
 {
@@ -119,14 +189,14 @@ setauevent(void)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setauevent_locked();
+	cursor = 0;
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
 }
 
 /*
- * Close the open file pointers.
+ * Finish with the audit_event file; it will be read again on next use.
  */
 void
 endauevent(void)
@@ -135,59 +205,34 @@ endauevent(void)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	if (fp != NULL) {
-		fclose(fp);
-		fp = NULL;
-	}
+	cursor = 0;
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
+	au_db_invalidate(AU_DB_EVENT);
 }
 
 /*
  * Enumerate the au_event_ent entries.
  */
-static struct au_event_ent *
-getauevent_r_locked(struct au_event_ent *e)
-{
-	char *nl;
-
-	if ((fp == NULL) && ((fp = fopen(AUDIT_EVENT_FILE, "r")) == NULL))
-		return (NULL);
-
-	while (1) {
-		if (fgets(linestr, AU_LINE_MAX, fp) == NULL)
-			return (NULL);
-
-		/* Remove new lines. */
-		if ((nl = strrchr(linestr, '\n')) != NULL)
-			*nl = '\0';
-
-		/* Skip comments. */
-		if (linestr[0] == '#')
-			continue;
-
-		/* Get the next event structure. */
-		if (eventfromstr(linestr, e) == NULL)
-			return (NULL);
-		break;
-	}
-
-	return (e);
-}
-
 struct au_event_ent *
 getauevent_r(struct au_event_ent *e)
 {
+	const struct au_db *db;
 	struct au_event_ent *ep;
 
+	if ((db = au_db_enter(AU_DB_EVENT)) == NULL)
+		return (NULL);
+	ep = NULL;
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	ep = getauevent_r_locked(e);
+	if (cursor < db->adb_nenum)
+		ep = copyauevent(e, &db->adb_ent[cursor++]);
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
+	au_db_exit(AU_DB_EVENT);
 	return (ep);
 }
 
@@ -211,46 +256,21 @@ getauevent(void)
  *
  * XXXRW: Why accept NULL name?
  */
-static struct au_event_ent *
-getauevnam_r_locked(struct au_event_ent *e, const char *name)
-{
-	char *nl;
-
-	if (name == NULL)
-		return (NULL);
-
-	/* Rewind to beginning of the file. */
-	setauevent_locked();
-
-	if ((fp == NULL) && ((fp = fopen(AUDIT_EVENT_FILE, "r")) == NULL))
-		return (NULL);
-
-	while (fgets(linestr, AU_LINE_MAX, fp) != NULL) {
-		/* Remove new lines. */
-		if ((nl = strrchr(linestr, '\n')) != NULL)
-			*nl = '\0';
-
-		if (eventfromstr(linestr, e) != NULL) {
-			if (strcmp(name, e->ae_name) == 0)
-				return (e);
-		}
-	}
-
-	return (NULL);
-}
-
 struct au_event_ent *
 getauevnam_r(struct au_event_ent *e, const char *name)
 {
+	const struct au_db_ent *de;
+	const struct au_db *db;
 	struct au_event_ent *ep;
 
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_lock(&mutex);
-#endif
-	ep = getauevnam_r_locked(e, name);
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_unlock(&mutex);
-#endif
+	if (name == NULL)
+		return (NULL);
+	if ((db = au_db_enter(AU_DB_EVENT)) == NULL)
+		return (NULL);
+	ep = NULL;
+	if ((de = au_db_byname(db, name)) != NULL)
+		ep = copyauevent(e, de);
+	au_db_exit(AU_DB_EVENT);
 	return (ep);
 }
 
@@ -272,43 +292,19 @@ getauevnam(const char *name)
 /*
  * Search for an audit event structure having the given event number.
  */
-static struct au_event_ent *
-getauevnum_r_locked(struct au_event_ent *e, au_event_t event_number)
-{
-	char *nl;
-
-	/* Rewind to beginning of the file. */
-	setauevent_locked();
-
-	if ((fp == NULL) && ((fp = fopen(AUDIT_EVENT_FILE, "r")) == NULL))
-		return (NULL);
-
-	while (fgets(linestr, AU_LINE_MAX, fp) != NULL) {
-		/* Remove new lines. */
-		if ((nl = strrchr(linestr, '\n')) != NULL)
-			*nl = '\0';
-
-		if (eventfromstr(linestr, e) != NULL) {
-			if (event_number == e->ae_number)
-				return (e);
-		}
-	}
-
-	return (NULL);
-}
-
 struct au_event_ent *
 getauevnum_r(struct au_event_ent *e, au_event_t event_number)
 {
+	const struct au_db_ent *de;
+	const struct au_db *db;
 	struct au_event_ent *ep;
 
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_lock(&mutex);
-#endif
-	ep = getauevnum_r_locked(e, event_number);
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_unlock(&mutex);
-#endif
+	if ((db = au_db_enter(AU_DB_EVENT)) == NULL)
+		return (NULL);
+	ep = NULL;
+	if ((de = au_db_bynum(db, event_number)) != NULL)
+		ep = copyauevent(e, de);
+	au_db_exit(AU_DB_EVENT);
 	return (ep);
 }
 
@@ -334,22 +330,21 @@ getauevnum(au_event_t event_number)
 au_event_t *
 getauevnonam_r(au_event_t *ev, const char *event_name)
 {
-	static char event_ent_name[AU_EVENT_NAME_MAX];
-	static char event_ent_desc[AU_EVENT_DESC_MAX];
-	static struct au_event_ent e, *ep;
-
-	bzero(event_ent_name, sizeof(event_ent_name));
-	bzero(event_ent_desc, sizeof(event_ent_desc));
-	bzero(&e, sizeof(e));
-	e.ae_name = event_ent_name;
-	e.ae_desc = event_ent_desc;
+	const struct au_db_ent *de;
+	const struct au_db *db;
+	au_event_t *evp;
 
-	ep = getauevnam_r(&e, event_name);
-	if (ep == NULL)
+	if (event_name == NULL)
 		return (NULL);
-
-	*ev = e.ae_number;
-	return (ev);
+	if ((db = au_db_enter(AU_DB_EVENT)) == NULL)
+		return (NULL);
+	evp = NULL;
+	if ((de = au_db_byname(db, event_name)) != NULL) {
+		*ev = de->de_number;
+		evp = ev;
+	}
+	au_db_exit(AU_DB_EVENT);
+	return (evp);
 }
 
 au_event_t *
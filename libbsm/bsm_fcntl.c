@@ -237,11 +237,22 @@ static const bsm_fcntl_cmd_t bsm_fcntl_cmdtab[] = {
 static const int bsm_fcntl_cmd_count = sizeof(bsm_fcntl_cmdtab) /
 	    sizeof(bsm_fcntl_cmdtab[0]);
 
+/*
+ * bsm_mktables indexes the table by both constants; see bsm_domain.c.
+ */
+#ifndef BSM_MKTABLES
+#include "bsm_tables.h"
+
 static const bsm_fcntl_cmd_t *
 bsm_lookup_local_fcntl_cmd(int local_fcntl_cmd)
 {
 	int i;
 
+	if (local_fcntl_cmd >= 0 &&
+	    local_fcntl_cmd < BSM_FCNTL_CMDS_NLOCAL) {
+		i = bsm_fcntl_cmds_bylocal[local_fcntl_cmd];
+		return (i != 0 ? &bsm_fcntl_cmdtab[i - 1] : NULL);
+	}
 	for (i = 0; i < bsm_fcntl_cmd_count; i++) {
 		if (bsm_fcntl_cmdtab[i].bfc_local_fcntl_cmd ==
 		    local_fcntl_cmd)
@@ -266,6 +277,10 @@ bsm_lookup_bsm_fcntl_cmd(u_short bsm_fcntl_cmd)
 {
 	int i;
 
+	if (bsm_fcntl_cmd < BSM_FCNTL_CMDS_NBSM) {
+		i = bsm_fcntl_cmds_bybsm[bsm_fcntl_cmd];
+		return (i != 0 ? &bsm_fcntl_cmdtab[i - 1] : NULL);
+	}
 	for (i = 0; i < bsm_fcntl_cmd_count; i++) {
 		if (bsm_fcntl_cmdtab[i].bfc_bsm_fcntl_cmd ==
 		    bsm_fcntl_cmd)
@@ -285,3 +300,4 @@ au_bsm_to_fcntl_cmd(u_short bsm_fcntl_cmd, int *local_fcntl_cmdp)
 	*local_fcntl_cmdp = bfcp->bfc_local_fcntl_cmd;
 	return (0);
 }
+#endif /* !BSM_MKTABLES */
@@ -33,6 +33,9 @@
 #include <bsm/libbsm.h>
 
 #include <errno.h>
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+#include <pthread.h>
+#endif
 #include <stdio.h>
 #include <string.h>
 
@@ -40,6 +43,30 @@
 #include <compat/strlcpy.h>
 #endif
 
+#include "bsm_db.h"
+
+/*
+ * Flag strings are converted over and over with the same values, such as
+ * the flags and naflags of audit_control for each login, so recent results
+ * are remembered in a small direct-mapped cache.  Each result is tagged
+ * with the audit_class snapshot it was computed against and is not used
+ * once that snapshot has been replaced.
+ */
+#define	AU_FLAGS_NMEMO		64
+#define	AU_FLAGS_MEMOKEY	64
+
+struct au_flags_memo {
+	u_int		fm_gen;		/* Zero if unused. */
+	au_mask_t	fm_mask;
+	char		fm_key[AU_FLAGS_MEMOKEY];
+};
+
+static struct au_flags_memo	au_flags_memo[AU_FLAGS_NMEMO];
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+static pthread_mutex_t	mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static const char	*flagdelim = ",";
 
 /*
@@ -49,22 +76,41 @@ static const char	*flagdelim = ",";
 int
 getauditflagsbin(char *auditstr, au_mask_t *masks)
 {
-	char class_ent_name[AU_CLASS_NAME_MAX];
-	char class_ent_desc[AU_CLASS_DESC_MAX];
-	struct au_class_ent c;
+	char key[AU_FLAGS_MEMOKEY];
+	const struct au_db_ent *de;
+	struct au_flags_memo *fm;
+	const struct au_db *db;
 	char *tok;
 	char sel, sub;
 	char *last;
 
-	bzero(&c, sizeof(c));
-	bzero(class_ent_name, sizeof(class_ent_name));
-	bzero(class_ent_desc, sizeof(class_ent_desc));
-	c.ac_name = class_ent_name;
-	c.ac_desc = class_ent_desc;
-
 	masks->am_success = 0;
 	masks->am_failure = 0;
 
+	/*
+	 * Without an audit_class database every class name is unknown, but
+	 * an empty string is still valid.
+	 */
+	db = au_db_enter(AU_DB_CLASS);
+	fm = NULL;
+	if (db != NULL && strlcpy(key, auditstr, sizeof(key)) < sizeof(key)) {
+		fm = &au_flags_memo[au_db_hashstr(key) % AU_FLAGS_NMEMO];
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_lock(&mutex);
+#endif
+		if (fm->fm_gen == db->adb_gen && strcmp(fm->fm_key, key) == 0) {
+			*masks = fm->fm_mask;
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+			pthread_mutex_unlock(&mutex);
+#endif
+			au_db_exit(AU_DB_CLASS);
+			return (0);
+		}
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_unlock(&mutex);
+#endif
+	}
+
 	tok = strtok_r(auditstr, flagdelim, &last);
 	while (tok != NULL) {
 		/* Check for the events that should not be audited. */
@@ -84,12 +130,14 @@ getauditflagsbin(char *auditstr, au_mask_t *masks)
 		} else
 			sel = AU_PRS_BOTH;
 
-		if ((getauclassnam_r(&c, tok)) != NULL) {
+		if (db != NULL && (de = au_db_byname(db, tok)) != NULL) {
 			if (sub)
-				SUB_FROM_MASK(masks, c.ac_class, sel);
+				SUB_FROM_MASK(masks, de->de_number, sel);
 			else
-				ADD_TO_MASK(masks, c.ac_class, sel);
+				ADD_TO_MASK(masks, de->de_number, sel);
 		} else {
+			if (db != NULL)
+				au_db_exit(AU_DB_CLASS);
 			errno = EINVAL;
 			return (-1);
 		}
@@ -97,80 +145,120 @@ getauditflagsbin(char *auditstr, au_mask_t *masks)
 		/* Get the next class. */
 		tok = strtok_r(NULL, flagdelim, &last);
 	}
+
+	if (fm != NULL) {
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_lock(&mutex);
+#endif
+		fm->fm_gen = db->adb_gen;
+		fm->fm_mask = *masks;
+		strlcpy(fm->fm_key, key, sizeof(fm->fm_key));
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_unlock(&mutex);
+#endif
+	}
+	if (db != NULL)
+		au_db_exit(AU_DB_CLASS);
 	return (0);
 }
 
+/*
+ * Append the name or description of a class to a string being built by
+ * getauditflagschar(), if the class is selected by the masks.
+ */
+static char *
+au_flags_put(char *strptr, const struct au_db_ent *de, const au_mask_t *masks,
+    int verbose)
+{
+	au_class_t c;
+	u_char sel;
+
+	c = de->de_number;
+	sel = 0;
+	sel |= ((c & masks->am_success) == c) ? AU_PRS_SUCCESS : 0;
+	sel |= ((c & masks->am_failure) == c) ? AU_PRS_FAILURE : 0;
+	if (sel == 0)
+		return (strptr);
+
+	/*
+	 * No prefix should be attached if both success and failure are
+	 * selected.
+	 */
+	if ((sel & AU_PRS_BOTH) == 0) {
+		if ((sel & AU_PRS_SUCCESS) != 0)
+			*strptr++ = '+';
+		else if ((sel & AU_PRS_FAILURE) != 0)
+			*strptr++ = '-';
+	}
+	if (verbose) {
+		strlcpy(strptr, de->de_desc, AU_CLASS_DESC_MAX);
+		strptr += strlen(de->de_desc);
+	} else {
+		strlcpy(strptr, de->de_name, AU_CLASS_NAME_MAX);
+		strptr += strlen(de->de_name);
+	}
+	*strptr++ = ','; /* delimiter */
+	return (strptr);
+}
+
 /*
  * Convert the au_mask_t fields into a string value.  If verbose is non-zero
  * the long flag names are used else the short (2-character)flag names are
  * used.
  *
+ * Classes are listed in the order of the audit_class file, but only those
+ * indexed under a bit set in either mask are examined: a class whose lowest
+ * bit is clear in both cannot be selected.
+ *
  * XXXRW: If bits are specified that are not matched by any class, they are
  * omitted rather than rejected with EINVAL.
- *
- * XXXRW: This is not thread-safe as it relies on atomicity between
- * setauclass() and sequential calls to getauclassent().  This could be
- * fixed by iterating through the bitmask fields rather than iterating
- * through the classes.
  */
 int
 getauditflagschar(char *auditstr, au_mask_t *masks, int verbose)
 {
-	char class_ent_name[AU_CLASS_NAME_MAX];
-	char class_ent_desc[AU_CLASS_DESC_MAX];
-	struct au_class_ent c;
+	int32_t cand[AU_DB_NBITS];
+	const struct au_db *db;
 	char *strptr = auditstr;
-	u_char sel;
+	int b, i, j, k, n, t;
+	au_class_t all;
 
-	bzero(&c, sizeof(c));
-	bzero(class_ent_name, sizeof(class_ent_name));
-	bzero(class_ent_desc, sizeof(class_ent_desc));
-	c.ac_name = class_ent_name;
-	c.ac_desc = class_ent_desc;
+	if ((db = au_db_enter(AU_DB_CLASS)) == NULL)
+		return (0);
 
 	/*
-	 * Enumerate the class entries, check if each is selected in either
-	 * the success or failure masks.
+	 * Collect the candidate classes and sort them back into file order;
+	 * with more candidates than bits, some bit is shared by several
+	 * classes, and it is as cheap to walk every class.
 	 */
-	setauclass();
-	while ((getauclassent_r(&c)) != NULL) {
-		sel = 0;
-
-		/* Dont do anything for class = no. */
-		if (c.ac_class == 0)
-			continue;
-
-		sel |= ((c.ac_class & masks->am_success) == c.ac_class) ?
-		    AU_PRS_SUCCESS : 0;
-		sel |= ((c.ac_class & masks->am_failure) == c.ac_class) ?
-		    AU_PRS_FAILURE : 0;
-
-		/*
-		 * No prefix should be attached if both success and failure
-		 * are selected.
-		 */
-		if ((sel & AU_PRS_BOTH) == 0) {
-			if ((sel & AU_PRS_SUCCESS) != 0) {
-				*strptr = '+';
-				strptr = strptr + 1;
-			} else if ((sel & AU_PRS_FAILURE) != 0) {
-				*strptr = '-';
-				strptr = strptr + 1;
+	all = masks->am_success | masks->am_failure;
+	n = 0;
+	for (; all != 0; all &= all - 1) {
+		b = ffs(all) - 1;
+		for (k = db->adb_bitstart[b]; k < db->adb_bitstart[b + 1];
+		    k++) {
+			if (n == AU_DB_NBITS) {
+				n = -1;
+				break;
 			}
+			i = db->adb_bitent[k];
+			for (j = n++; j > 0 && cand[j - 1] > i; j--)
+				cand[j] = cand[j - 1];
+			cand[j] = i;
 		}
-
-		if (sel != 0) {
-			if (verbose) {
-				strlcpy(strptr, c.ac_desc, AU_CLASS_DESC_MAX);
-				strptr += strlen(c.ac_desc);
-			} else {
-				strlcpy(strptr, c.ac_name, AU_CLASS_NAME_MAX);
-				strptr += strlen(c.ac_name);
-			}
-			*strptr = ','; /* delimiter */
-			strptr = strptr + 1;
-		}
+		if (n == -1)
+			break;
+	}
+	if (n == -1) {
+		for (t = 0; t < db->adb_nenum; t++)
+			if (db->adb_ent[t].de_number != 0)
+				strptr = au_flags_put(strptr,
+				    &db->adb_ent[t], masks, verbose);
+	} else {
+		for (t = 0; t < n; t++)
+			strptr = au_flags_put(strptr, &db->adb_ent[cand[t]],
+			    masks, verbose);
 	}
+	au_db_exit(AU_DB_CLASS);
 
 	/* Overwrite the last delimiter with the string terminator. */
 	if (strptr != auditstr)
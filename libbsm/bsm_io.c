@@ -4474,6 +4474,186 @@ au_fetch_tok(tokenstr_t *tok, u_char *buf, int len)
 	}
 }
 
+/*
+ * Copy the subject fields shared by the variants of subject and process
+ * tokens into a record summary.
+ */
+#define	SUMMARY_SUBJECT(ars, s) do {					\
+	(ars)->ars_auid = (s).auid;					\
+	(ars)->ars_euid = (s).euid;					\
+	(ars)->ars_egid = (s).egid;					\
+	(ars)->ars_ruid = (s).ruid;					\
+	(ars)->ars_rgid = (s).rgid;					\
+	(ars)->ars_pid = (s).pid;					\
+	(ars)->ars_sid = (s).sid;					\
+	(ars)->ars_port = (s).tid.port;					\
+} while (0)
+
+#define	SUMMARY_TID(ars, s) do {					\
+	(ars)->ars_ttype = AU_IPv4;					\
+	(ars)->ars_taddr[0] = (s).tid.addr;				\
+} while (0)
+
+#define	SUMMARY_TIDADDR(ars, s) do {					\
+	(ars)->ars_ttype = (s).tid.type;				\
+	memcpy((ars)->ars_taddr, (s).tid.addr,				\
+	    sizeof((ars)->ars_taddr));					\
+} while (0)
+
+#define	AU_RECSUM_ALL							\
+	(AU_RECSUM_HEADER | AU_RECSUM_SUBJECT | AU_RECSUM_RETURN |	\
+	AU_RECSUM_PATH)
+
+static void
+au_rec_summary_subject(au_rec_summary_t *ars, tokenstr_t *tok)
+{
+
+	bzero(ars->ars_taddr, sizeof(ars->ars_taddr));
+	switch (tok->id) {
+	case AUT_SUBJECT32:
+		SUMMARY_SUBJECT(ars, tok->tt.subj32);
+		SUMMARY_TID(ars, tok->tt.subj32);
+		break;
+	case AUT_SUBJECT32_EX:
+		SUMMARY_SUBJECT(ars, tok->tt.subj32_ex);
+		SUMMARY_TIDADDR(ars, tok->tt.subj32_ex);
+		break;
+	case AUT_SUBJECT64:
+		SUMMARY_SUBJECT(ars, tok->tt.subj64);
+		SUMMARY_TID(ars, tok->tt.subj64);
+		break;
+	case AUT_SUBJECT64_EX:
+		SUMMARY_SUBJECT(ars, tok->tt.subj64_ex);
+		SUMMARY_TIDADDR(ars, tok->tt.subj64_ex);
+		break;
+	case AUT_PROCESS32:
+		SUMMARY_SUBJECT(ars, tok->tt.proc32);
+		SUMMARY_TID(ars, tok->tt.proc32);
+		break;
+	case AUT_PROCESS32_EX:
+		SUMMARY_SUBJECT(ars, tok->tt.proc32_ex);
+		SUMMARY_TIDADDR(ars, tok->tt.proc32_ex);
+		break;
+	case AUT_PROCESS64:
+		SUMMARY_SUBJECT(ars, tok->tt.proc64);
+		SUMMARY_TID(ars, tok->tt.proc64);
+		break;
+	default:
+		SUMMARY_SUBJECT(ars, tok->tt.proc64_ex);
+		SUMMARY_TIDADDR(ars, tok->tt.proc64_ex);
+		break;
+	}
+}
+
+/*
+ * Gather the fields common to most records in one pass over the record in
+ * buf, from whichever variants of the header, subject, process and return
+ * tokens it holds.  The subject is taken from the first subject token, or
+ * the first process token in its absence; the path from the first path
+ * token.  Once every kind of token has been found the rest of the record is
+ * not read.
+ */
+int
+au_rec_summary(u_char *buf, int len, au_rec_summary_t *ars)
+{
+	tokenstr_t tok;
+	int bytesread;
+
+	bzero(ars, sizeof(*ars));
+	for (bytesread = 0; bytesread < len &&
+	    (ars->ars_flags & AU_RECSUM_ALL) != AU_RECSUM_ALL;
+	    bytesread += tok.len) {
+		if (au_fetch_tok(&tok, buf + bytesread, len - bytesread) ==
+		    -1) {
+			errno = EINVAL;
+			return (-1);
+		}
+		switch (tok.id) {
+		case AUT_HEADER32:
+		case AUT_HEADER32_EX:
+		case AUT_HEADER64:
+		case AUT_HEADER64_EX:
+			if (ars->ars_flags & AU_RECSUM_HEADER)
+				break;
+			ars->ars_flags |= AU_RECSUM_HEADER;
+			switch (tok.id) {
+			case AUT_HEADER32:
+				ars->ars_event = tok.tt.hdr32.e_type;
+				ars->ars_emod = tok.tt.hdr32.e_mod;
+				ars->ars_sec = tok.tt.hdr32.s;
+				ars->ars_msec = tok.tt.hdr32.ms;
+				break;
+			case AUT_HEADER32_EX:
+				ars->ars_event = tok.tt.hdr32_ex.e_type;
+				ars->ars_emod = tok.tt.hdr32_ex.e_mod;
+				ars->ars_sec = tok.tt.hdr32_ex.s;
+				ars->ars_msec = tok.tt.hdr32_ex.ms;
+				break;
+			case AUT_HEADER64:
+				ars->ars_event = tok.tt.hdr64.e_type;
+				ars->ars_emod = tok.tt.hdr64.e_mod;
+				ars->ars_sec = tok.tt.hdr64.s;
+				ars->ars_msec = tok.tt.hdr64.ms;
+				break;
+			default:
+				ars->ars_event = tok.tt.hdr64_ex.e_type;
+				ars->ars_emod = tok.tt.hdr64_ex.e_mod;
+				ars->ars_sec = tok.tt.hdr64_ex.s;
+				ars->ars_msec = tok.tt.hdr64_ex.ms;
+				break;
+			}
+			break;
+
+		case AUT_SUBJECT32:
+		case AUT_SUBJECT32_EX:
+		case AUT_SUBJECT64:
+		case AUT_SUBJECT64_EX:
+			if (ars->ars_flags & AU_RECSUM_SUBJECT)
+				break;
+			ars->ars_flags &= ~AU_RECSUM_PROCESS;
+			ars->ars_flags |= AU_RECSUM_SUBJECT;
+			au_rec_summary_subject(ars, &tok);
+			break;
+
+		case AUT_PROCESS32:
+		case AUT_PROCESS32_EX:
+		case AUT_PROCESS64:
+		case AUT_PROCESS64_EX:
+			if (ars->ars_flags &
+			    (AU_RECSUM_SUBJECT | AU_RECSUM_PROCESS))
+				break;
+			ars->ars_flags |= AU_RECSUM_PROCESS;
+			au_rec_summary_subject(ars, &tok);
+			break;
+
+		case AUT_RETURN32:
+			if (ars->ars_flags & AU_RECSUM_RETURN)
+				break;
+			ars->ars_flags |= AU_RECSUM_RETURN;
+			ars->ars_status = tok.tt.ret32.status;
+			ars->ars_retval = tok.tt.ret32.ret;
+			break;
+
+		case AUT_RETURN64:
+			if (ars->ars_flags & AU_RECSUM_RETURN)
+				break;
+			ars->ars_flags |= AU_RECSUM_RETURN;
+			ars->ars_status = tok.tt.ret64.err;
+			ars->ars_retval = tok.tt.ret64.val;
+			break;
+
+		case AUT_PATH:
+			if (ars->ars_flags & AU_RECSUM_PATH)
+				break;
+			ars->ars_flags |= AU_RECSUM_PATH;
+			ars->ars_path = tok.tt.path.path;
+			ars->ars_pathlen = tok.tt.path.len;
+			break;
+		}
+	}
+	return (0);
+}
+
 void
 au_print_flags_tok(FILE *outfp, tokenstr_t *tok, char *del, int oflags)
 {
@@ -0,0 +1,148 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Generate the direct-mapped indexes used by bsm_domain.c, bsm_errno.c,
+ * bsm_fcntl.c and bsm_socket_type.c to translate between BSM and local
+ * constants.  Those files are included here with BSM_MKTABLES defined, so
+ * that only their tables are compiled, and the indexes are written to the
+ * standard output as bsm_tables.h.
+ *
+ * For each table and each direction, an index maps every value from zero
+ * up to the largest value in the table to one more than the position of the
+ * first entry holding it, or to zero if there is none.  Negative values,
+ * and values of AU_MKTABLES_MAX or more, are not indexed and are left to a
+ * linear search of the table.
+ *
+ * The local constants are those of the host this is compiled for, so it
+ * must be run on the host the library is built for.
+ */
+
+#define	BSM_MKTABLES
+
+#include "bsm_domain.c"
+#include "bsm_errno.c"
+#include "bsm_fcntl.c"
+#include "bsm_socket_type.c"
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define	AU_MKTABLES_MAX		4096
+
+/*
+ * The values of one field of a table, in table order.
+ */
+#define	AU_MKTABLES_KEYS(keys, tab, count, field) do {			\
+	int _i;								\
+									\
+	for (_i = 0; _i < (count); _i++)				\
+		(keys)[_i] = (tab)[_i].field;				\
+} while (0)
+
+static void
+mkindex(const char *name, const char *size, const int *keys, int nkeys)
+{
+	int i, n;
+	int *idx;
+
+	n = 0;
+	for (i = 0; i < nkeys; i++)
+		if (keys[i] >= n && keys[i] < AU_MKTABLES_MAX)
+			n = keys[i] + 1;
+	if ((idx = calloc(n + 1, sizeof(*idx))) == NULL)
+		err(1, "calloc");
+
+	/* Walk backwards so that the first of duplicate entries wins. */
+	for (i = nkeys - 1; i >= 0; i--)
+		if (keys[i] >= 0 && keys[i] < n)
+			idx[keys[i]] = i + 1;
+
+	/* An empty index still needs one element, which finds nothing. */
+	printf("\n#define\t%s\t%d\n", size, n);
+	printf("static const %s %s[%d] = {", nkeys < 255 ? "u_char" : "u_short",
+	    name, n > 0 ? n : 1);
+	for (i = 0; i < (n > 0 ? n : 1); i++)
+		printf("%s%d,", i % 12 == 0 ? "\n\t" : " ", idx[i]);
+	printf("\n};\n");
+	free(idx);
+}
+
+int
+main(void)
+{
+	static int keys[AU_MKTABLES_MAX];
+
+	if (bsm_domains_count > AU_MKTABLES_MAX ||
+	    bsm_errnos_count > AU_MKTABLES_MAX ||
+	    bsm_fcntl_cmd_count > AU_MKTABLES_MAX ||
+	    bsm_socket_types_count > AU_MKTABLES_MAX)
+		errx(1, "table too large");
+
+	printf("/*\n * Generated by bsm_mktables from the translation tables; "
+	    "do not edit.\n */\n");
+
+	AU_MKTABLES_KEYS(keys, bsm_domains, bsm_domains_count,
+	    bd_local_domain);
+	mkindex("bsm_domains_bylocal", "BSM_DOMAINS_NLOCAL", keys,
+	    bsm_domains_count);
+	AU_MKTABLES_KEYS(keys, bsm_domains, bsm_domains_count,
+	    bd_bsm_domain);
+	mkindex("bsm_domains_bybsm", "BSM_DOMAINS_NBSM", keys,
+	    bsm_domains_count);
+
+	AU_MKTABLES_KEYS(keys, bsm_errnos, bsm_errnos_count,
+	    be_local_errno);
+	mkindex("bsm_errnos_bylocal", "BSM_ERRNOS_NLOCAL", keys,
+	    bsm_errnos_count);
+	AU_MKTABLES_KEYS(keys, bsm_errnos, bsm_errnos_count,
+	    be_bsm_errno);
+	mkindex("bsm_errnos_bybsm", "BSM_ERRNOS_NBSM", keys,
+	    bsm_errnos_count);
+
+	AU_MKTABLES_KEYS(keys, bsm_fcntl_cmdtab, bsm_fcntl_cmd_count,
+	    bfc_local_fcntl_cmd);
+	mkindex("bsm_fcntl_cmds_bylocal", "BSM_FCNTL_CMDS_NLOCAL", keys,
+	    bsm_fcntl_cmd_count);
+	AU_MKTABLES_KEYS(keys, bsm_fcntl_cmdtab, bsm_fcntl_cmd_count,
+	    bfc_bsm_fcntl_cmd);
+	mkindex("bsm_fcntl_cmds_bybsm", "BSM_FCNTL_CMDS_NBSM", keys,
+	    bsm_fcntl_cmd_count);
+
+	AU_MKTABLES_KEYS(keys, bsm_socket_types, bsm_socket_types_count,
+	    bst_local_socket_type);
+	mkindex("bsm_socket_types_bylocal", "BSM_SOCKET_TYPES_NLOCAL", keys,
+	    bsm_socket_types_count);
+	AU_MKTABLES_KEYS(keys, bsm_socket_types, bsm_socket_types_count,
+	    bst_bsm_socket_type);
+	mkindex("bsm_socket_types_bybsm", "BSM_SOCKET_TYPES_NBSM", keys,
+	    bsm_socket_types_count);
+
+	if (fflush(stdout) != 0 || ferror(stdout))
+		err(1, "stdout");
+	return (0);
+}
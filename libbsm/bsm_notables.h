@@ -0,0 +1,55 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Empty indexes of the translation tables, used in place of those written
+ * by bsm_mktables when the library is cross-compiled and it cannot be run.
+ * Every value then falls outside its index and is looked up in the table.
+ */
+
+#define	BSM_DOMAINS_NLOCAL	0
+static const u_char bsm_domains_bylocal[1] = { 0 };
+
+#define	BSM_DOMAINS_NBSM	0
+static const u_char bsm_domains_bybsm[1] = { 0 };
+
+#define	BSM_ERRNOS_NLOCAL	0
+static const u_char bsm_errnos_bylocal[1] = { 0 };
+
+#define	BSM_ERRNOS_NBSM		0
+static const u_char bsm_errnos_bybsm[1] = { 0 };
+
+#define	BSM_FCNTL_CMDS_NLOCAL	0
+static const u_char bsm_fcntl_cmds_bylocal[1] = { 0 };
+
+#define	BSM_FCNTL_CMDS_NBSM	0
+static const u_char bsm_fcntl_cmds_bybsm[1] = { 0 };
+
+#define	BSM_SOCKET_TYPES_NLOCAL	0
+static const u_char bsm_socket_types_bylocal[1] = { 0 };
+
+#define	BSM_SOCKET_TYPES_NBSM	0
+static const u_char bsm_socket_types_bybsm[1] = { 0 };
@@ -0,0 +1,549 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Reload the audit configuration files in the background when they change.
+ *
+ * A thread watches the directory holding the files and, once changes have
+ * stopped arriving for AU_RELOAD_DELAY milliseconds, reads each changed file
+ * into a new snapshot and publishes it in place of the old one.  Readers go
+ * on using the old snapshot until the switch, and never wait for the file to
+ * be read.  Snapshots that have not been loaded are left to be loaded by
+ * their first reader.
+ *
+ * Directory changes are watched with inotify(7) on Linux and kqueue(2)
+ * elsewhere; without either, au_autoreload() fails with ENOSYS and the
+ * files are checked for changes by their readers as before.
+ */
+
+#include <sys/types.h>
+
+#include <config/config.h>
+
+#include <bsm/libbsm.h>
+
+#include <errno.h>
+
+#include "bsm_db.h"
+
+#if defined(HAVE_PTHREAD_MUTEX_LOCK) && defined(__linux__)
+#define	AU_RELOAD_INOTIFY
+#elif defined(HAVE_PTHREAD_MUTEX_LOCK) && defined(HAVE_KQUEUE)
+#define	AU_RELOAD_KQUEUE
+#endif
+
+#if defined(AU_RELOAD_INOTIFY) || defined(AU_RELOAD_KQUEUE)
+
+#ifdef AU_RELOAD_INOTIFY
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+#ifdef AU_RELOAD_KQUEUE
+#include <sys/event.h>
+#include <sys/stat.h>
+#endif
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef HAVE_CLOCK_GETTIME
+#include <compat/clock_gettime.h>
+#endif
+#ifndef HAVE_STRLCPY
+#include <compat/strlcpy.h>
+#endif
+
+#ifdef CLOCK_MONOTONIC
+#define	AU_RELOAD_CLOCK		CLOCK_MONOTONIC
+#else
+#define	AU_RELOAD_CLOCK		CLOCK_REALTIME
+#endif
+
+#define	AU_RELOAD_DELAY		100	/* Milliseconds. */
+
+/*
+ * The snapshots to replace when each file changes: audit_event and
+ * audit_user are read with the class names of audit_class, and the compiled
+ * database holds all three.
+ */
+#define	AU_RELOAD_EVENT		(1 << AU_DB_EVENT)
+#define	AU_RELOAD_CLASS		(1 << AU_DB_CLASS)
+#define	AU_RELOAD_USER		(1 << AU_DB_USER)
+#define	AU_RELOAD_CONTROL	(1 << AU_DB_MAX)
+#define	AU_RELOAD_DB		(AU_RELOAD_EVENT | AU_RELOAD_CLASS |	\
+				    AU_RELOAD_USER)
+#define	AU_RELOAD_ALL		(AU_RELOAD_DB | AU_RELOAD_CONTROL)
+
+struct au_reload_file {
+	const char	*arf_path;
+	int		 arf_mask;
+};
+
+static const struct au_reload_file au_reload_file[] = {
+	{ AUDIT_EVENT_FILE,	AU_RELOAD_EVENT },
+	{ AUDIT_CLASS_FILE,	AU_RELOAD_DB },
+	{ AUDIT_USER_FILE,	AU_RELOAD_USER },
+	{ AUDIT_CONTROL_FILE,	AU_RELOAD_CONTROL },
+	{ AUDIT_DB_FILE,	AU_RELOAD_DB },
+};
+#define	AU_RELOAD_NFILE							\
+	(int)(sizeof(au_reload_file) / sizeof(au_reload_file[0]))
+
+/*
+ * The thread and its descriptors; protected by au_reload_mutex.  The
+ * thread is stopped by writing to au_reload_pipe.
+ */
+static pthread_mutex_t	 au_reload_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t	 au_reload_once = PTHREAD_ONCE_INIT;
+static pthread_t	 au_reload_thr;
+static int		 au_reload_running;
+static int		 au_reload_fd = -1;
+static int		 au_reload_pipe[2] = { -1, -1 };
+
+#ifdef AU_RELOAD_KQUEUE
+/*
+ * kqueue watches a file by descriptor, so that a file replaced by rename
+ * keeps being watched under its old identity; the directory is watched too,
+ * and each file opened again whenever anything changes.
+ */
+static int		 au_reload_dirfd = -1;
+static int		 au_reload_filefd[AU_RELOAD_NFILE];
+static dev_t		 au_reload_dev[AU_RELOAD_NFILE];
+static ino_t		 au_reload_ino[AU_RELOAD_NFILE];
+#endif
+
+/*
+ * Return the directory the files are in; all of them are kept together.
+ */
+static int
+au_reload_dir(char *dir, size_t len)
+{
+	char *p;
+
+	if (strlcpy(dir, AUDIT_EVENT_FILE, len) >= len ||
+	    (p = strrchr(dir, '/')) == NULL)
+		return (-1);
+	if (p == dir)
+		p++;
+	*p = '\0';
+	return (0);
+}
+
+/*
+ * Return the mask of snapshots depending on the file named 'name' in the
+ * watched directory.
+ */
+static int
+au_reload_mask(const char *name)
+{
+	const char *p;
+	int i;
+
+	for (i = 0; i < AU_RELOAD_NFILE; i++) {
+		p = strrchr(au_reload_file[i].arf_path, '/');
+		p = p != NULL ? p + 1 : au_reload_file[i].arf_path;
+		if (strcmp(p, name) == 0)
+			return (au_reload_file[i].arf_mask);
+	}
+	return (0);
+}
+
+/*
+ * Replace the snapshots in 'mask', audit_class first, as the others are
+ * read with it.
+ */
+static void
+au_reload_apply(int mask)
+{
+
+	if (mask & AU_RELOAD_CLASS)
+		au_db_reload(AU_DB_CLASS);
+	if (mask & AU_RELOAD_EVENT)
+		au_db_reload(AU_DB_EVENT);
+	if (mask & AU_RELOAD_USER)
+		au_db_reload(AU_DB_USER);
+	if (mask & AU_RELOAD_CONTROL)
+		au_control_reload();
+}
+
+#ifdef AU_RELOAD_INOTIFY
+static int
+au_reload_open(void)
+{
+	char dir[PATH_MAX];
+
+	if (au_reload_dir(dir, sizeof(dir)) != 0) {
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+	if ((au_reload_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+		return (-1);
+	if (inotify_add_watch(au_reload_fd, dir, IN_CLOSE_WRITE |
+	    IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE |
+	    IN_ATTRIB) < 0)
+		return (-1);
+	return (0);
+}
+
+static void
+au_reload_close(void)
+{
+
+	if (au_reload_fd >= 0) {
+		close(au_reload_fd);
+		au_reload_fd = -1;
+	}
+}
+
+/*
+ * Read the pending events and return the mask of snapshots they affect.
+ */
+static int
+au_reload_read(void)
+{
+	char buf[4096]
+	    __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t len;
+	char *p;
+	int mask;
+
+	mask = 0;
+	while ((len = read(au_reload_fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *)p;
+			if (ev->mask & IN_Q_OVERFLOW)
+				mask |= AU_RELOAD_ALL;
+			else if (ev->len > 0)
+				mask |= au_reload_mask(ev->name);
+		}
+	}
+	return (mask);
+}
+
+/*
+ * Wait for events or for 'timeout' milliseconds, or forever if 'timeout' is
+ * negative.  Return the mask of snapshots affected, or -1 if the thread is
+ * to stop.
+ */
+static int
+au_reload_wait(int timeout)
+{
+	struct pollfd pfd[2];
+
+	pfd[0].fd = au_reload_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = au_reload_pipe[0];
+	pfd[1].events = POLLIN;
+	if (poll(pfd, 2, timeout) < 0)
+		return (errno == EINTR ? 0 : -1);
+	if (pfd[1].revents != 0)
+		return (-1);
+	if (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+		return (-1);
+	if (pfd[0].revents & POLLIN)
+		return (au_reload_read());
+	return (0);
+}
+
+#endif /* AU_RELOAD_INOTIFY */
+
+#ifdef AU_RELOAD_KQUEUE
+/*
+ * Watch each file as it now is, adding to 'mask' the snapshots depending on
+ * any file that has been created, replaced or removed since last watched.
+ */
+static void
+au_reload_rewatch(int *mask)
+{
+	struct kevent kev;
+	struct stat sb;
+	int fd, i;
+
+	for (i = 0; i < AU_RELOAD_NFILE; i++) {
+		fd = open(au_reload_file[i].arf_path, O_RDONLY | O_CLOEXEC);
+		if (fd >= 0 && fstat(fd, &sb) != 0) {
+			close(fd);
+			fd = -1;
+		}
+		if (fd >= 0 && au_reload_filefd[i] >= 0 &&
+		    sb.st_dev == au_reload_dev[i] &&
+		    sb.st_ino == au_reload_ino[i]) {
+			close(fd);
+			continue;
+		}
+		if (fd >= 0 || au_reload_filefd[i] >= 0)
+			*mask |= au_reload_file[i].arf_mask;
+		if (au_reload_filefd[i] >= 0)
+			close(au_reload_filefd[i]);
+		au_reload_filefd[i] = fd;
+		if (fd < 0)
+			continue;
+		au_reload_dev[i] = sb.st_dev;
+		au_reload_ino[i] = sb.st_ino;
+		EV_SET(&kev, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+		    NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE |
+		    NOTE_RENAME, 0, (void *)(intptr_t)i);
+		if (kevent(au_reload_fd, &kev, 1, NULL, 0, NULL) != 0) {
+			close(fd);
+			au_reload_filefd[i] = -1;
+		}
+	}
+}
+
+static int
+au_reload_open(void)
+{
+	char dir[PATH_MAX];
+	struct kevent kev[2];
+	int i, mask;
+
+	if (au_reload_dir(dir, sizeof(dir)) != 0) {
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+	for (i = 0; i < AU_RELOAD_NFILE; i++)
+		au_reload_filefd[i] = -1;
+	if ((au_reload_fd = kqueue()) < 0)
+		return (-1);
+	if ((au_reload_dirfd = open(dir, O_RDONLY | O_CLOEXEC)) < 0)
+		return (-1);
+	EV_SET(&kev[0], au_reload_dirfd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+	    NOTE_WRITE | NOTE_EXTEND, 0, (void *)(intptr_t)-1);
+	EV_SET(&kev[1], au_reload_pipe[0], EVFILT_READ, EV_ADD, 0, 0,
+	    (void *)(intptr_t)-2);
+	if (kevent(au_reload_fd, kev, 2, NULL, 0, NULL) != 0)
+		return (-1);
+	mask = 0;
+	au_reload_rewatch(&mask);
+	return (0);
+}
+
+static void
+au_reload_close(void)
+{
+	int i;
+
+	for (i = 0; i < AU_RELOAD_NFILE; i++) {
+		if (au_reload_filefd[i] >= 0)
+			close(au_reload_filefd[i]);
+		au_reload_filefd[i] = -1;
+	}
+	if (au_reload_dirfd >= 0) {
+		close(au_reload_dirfd);
+		au_reload_dirfd = -1;
+	}
+	if (au_reload_fd >= 0) {
+		close(au_reload_fd);
+		au_reload_fd = -1;
+	}
+}
+
+static int
+au_reload_wait(int timeout)
+{
+	struct kevent kev[8];
+	struct timespec ts;
+	int i, mask, n;
+	intptr_t id;
+
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+	n = kevent(au_reload_fd, NULL, 0, kev, 8, timeout < 0 ? NULL : &ts);
+	if (n < 0)
+		return (errno == EINTR ? 0 : -1);
+	mask = 0;
+	for (i = 0; i < n; i++) {
+		id = (intptr_t)kev[i].udata;
+		if (id == -2)
+			return (-1);
+		if (id >= 0)
+			mask |= au_reload_file[id].arf_mask;
+	}
+	/* Any change may have replaced a file; watch the new one instead. */
+	if (n > 0)
+		au_reload_rewatch(&mask);
+	return (mask);
+}
+#endif /* AU_RELOAD_KQUEUE */
+
+/*
+ * Gather changes until none have arrived for AU_RELOAD_DELAY milliseconds,
+ * or for ten times as long since the first, then apply them.
+ */
+static void *
+au_reload_thread(void *arg)
+{
+	struct timespec first, last, now;
+	int mask, pending, timeout;
+	long elapsed, quiet;
+
+	pending = 0;
+	first.tv_sec = first.tv_nsec = 0;
+	last = first;
+	for (;;) {
+		timeout = -1;
+		if (pending != 0) {
+			if (clock_gettime(AU_RELOAD_CLOCK, &now) < 0)
+				now = last;
+			quiet = (now.tv_sec - last.tv_sec) * 1000 +
+			    (now.tv_nsec - last.tv_nsec) / 1000000;
+			elapsed = (now.tv_sec - first.tv_sec) * 1000 +
+			    (now.tv_nsec - first.tv_nsec) / 1000000;
+			if (quiet >= AU_RELOAD_DELAY ||
+			    elapsed >= 10 * AU_RELOAD_DELAY) {
+				au_reload_apply(pending);
+				pending = 0;
+			} else
+				timeout = AU_RELOAD_DELAY - quiet;
+		}
+		if ((mask = au_reload_wait(timeout)) < 0)
+			break;
+		if (mask == 0)
+			continue;
+		if (clock_gettime(AU_RELOAD_CLOCK, &last) < 0)
+			last.tv_sec = last.tv_nsec = 0;
+		if (pending == 0)
+			first = last;
+		pending |= mask;
+	}
+	return (NULL);
+}
+
+/*
+ * Stop the thread and close its descriptors.  Must be called with
+ * au_reload_mutex held.
+ */
+static void
+au_reload_stop_locked(void)
+{
+	char c;
+
+	if (au_reload_running) {
+		c = 0;
+		(void)write(au_reload_pipe[1], &c, 1);
+		pthread_join(au_reload_thr, NULL);
+		au_reload_running = 0;
+	}
+	au_reload_close();
+	if (au_reload_pipe[0] >= 0) {
+		close(au_reload_pipe[0]);
+		close(au_reload_pipe[1]);
+		au_reload_pipe[0] = au_reload_pipe[1] = -1;
+	}
+}
+
+/*
+ * The thread does not survive fork(), so the child starts without it and
+ * may enable it again.
+ */
+static void
+au_reload_child(void)
+{
+
+	au_reload_running = 0;
+	au_reload_close();
+	if (au_reload_pipe[0] >= 0) {
+		close(au_reload_pipe[0]);
+		close(au_reload_pipe[1]);
+		au_reload_pipe[0] = au_reload_pipe[1] = -1;
+	}
+	pthread_mutex_init(&au_reload_mutex, NULL);
+}
+
+static void
+au_reload_atfork(void)
+{
+
+	(void)pthread_atfork(NULL, NULL, au_reload_child);
+}
+
+static int
+au_reload_start_locked(void)
+{
+	sigset_t all, old;
+	int error;
+
+	if (pipe(au_reload_pipe) != 0)
+		return (-1);
+	if (fcntl(au_reload_pipe[0], F_SETFD, FD_CLOEXEC) != 0 ||
+	    fcntl(au_reload_pipe[1], F_SETFD, FD_CLOEXEC) != 0 ||
+	    au_reload_open() != 0) {
+		error = errno;
+		au_reload_stop_locked();
+		errno = error;
+		return (-1);
+	}
+
+	/* Signals are left to the threads of the application. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	error = pthread_create(&au_reload_thr, NULL, au_reload_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (error != 0) {
+		au_reload_stop_locked();
+		errno = error;
+		return (-1);
+	}
+	au_reload_running = 1;
+	return (0);
+}
+
+int
+au_autoreload(int enable)
+{
+	int ret;
+
+	(void)pthread_once(&au_reload_once, au_reload_atfork);
+	pthread_mutex_lock(&au_reload_mutex);
+	ret = 0;
+	if (enable && !au_reload_running)
+		ret = au_reload_start_locked();
+	else if (!enable)
+		au_reload_stop_locked();
+	pthread_mutex_unlock(&au_reload_mutex);
+	return (ret);
+}
+
+#else /* !AU_RELOAD_INOTIFY && !AU_RELOAD_KQUEUE */
+
+int
+au_autoreload(int enable)
+{
+
+	if (!enable)
+		return (0);
+	errno = ENOSYS;
+	return (-1);
+}
+
+#endif /* !AU_RELOAD_INOTIFY && !AU_RELOAD_KQUEUE */
@@ -52,11 +52,20 @@ static const struct bsm_socket_type bsm_socket_types[] = {
 static const int bsm_socket_types_count = sizeof(bsm_socket_types) /
 	    sizeof(bsm_socket_types[0]);
 
+/* Indexes generated by bsm_mktables; see bsm_domain.c. */
+#ifndef BSM_MKTABLES
+#include "bsm_tables.h"
+
 static const struct bsm_socket_type *
 bsm_lookup_local_socket_type(int local_socket_type)
 {
 	int i;
 
+	if (local_socket_type >= 0 &&
+	    local_socket_type < BSM_SOCKET_TYPES_NLOCAL) {
+		i = bsm_socket_types_bylocal[local_socket_type];
+		return (i != 0 ? &bsm_socket_types[i - 1] : NULL);
+	}
 	for (i = 0; i < bsm_socket_types_count; i++) {
 		if (bsm_socket_types[i].bst_local_socket_type ==
 		    local_socket_type)
@@ -81,6 +90,10 @@ bsm_lookup_bsm_socket_type(u_short bsm_socket_type)
 {
 	int i;
 
+	if (bsm_socket_type < BSM_SOCKET_TYPES_NBSM) {
+		i = bsm_socket_types_bybsm[bsm_socket_type];
+		return (i != 0 ? &bsm_socket_types[i - 1] : NULL);
+	}
 	for (i = 0; i < bsm_socket_types_count; i++) {
 		if (bsm_socket_types[i].bst_bsm_socket_type ==
 		    bsm_socket_type)
@@ -100,3 +113,4 @@ au_bsm_to_socket_type(u_short bsm_socket_type, int *local_socket_typep)
 	*local_socket_typep = bstp->bst_local_socket_type;
 	return (0);
 }
+#endif /* !BSM_MKTABLES */
@@ -0,0 +1,565 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Stub implementation of the audit system calls for platforms whose kernels
+ * do not support BSM audit, such as Linux.  Kernel audit state is emulated
+ * per-process, which is sufficient to build, exercise, and benchmark the
+ * record-submission paths in libbsm without a native audit implementation.
+ * It is built only into libbsm_stub.la, which the tests link against and
+ * which is never installed: it enforces no privilege and drops records.
+ *
+ * The stub behaves like a kernel in which audit has been compiled in but not
+ * yet enabled: the audit condition starts out as AUC_NOAUDIT, and records
+ * passed to audit(2) are only accepted once auditon(A_SETCOND) has set it to
+ * AUC_AUDITING.  Accepted records are appended to the trail configured with
+ * auditctl(2), if any, and are otherwise discarded; either way they are
+ * counted in the statistics returned by auditon(A_GETSTAT).
+ */
+
+#include <sys/types.h>
+
+#include <config/config.h>
+
+#include <bsm/libbsm.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+#include <pthread.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define	STUB_NEVENTS	(1 << (sizeof(au_event_t) * 8))
+
+struct stub_evname {
+	char	en_name[EVNAMEMAP_NAME_SIZE];
+};
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+static pthread_mutex_t	mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int			 stub_cond = AUC_NOAUDIT;
+static int			 stub_policy = AUDIT_CNT;
+static int			 stub_trailfd = -1;
+static au_mask_t		 stub_kmask;
+static au_qctrl_t		 stub_qctrl = { AQ_HIWATER, AQ_LOWATER,
+				    AQ_BUFSZ, 20, AU_FS_MINFREE };
+static au_stat_t		 stub_stat;
+static au_fstat_t		 stub_fstat;
+static auditinfo_addr_t		 stub_kaudit = { .ai_termid.at_type =
+				    AU_IPv4 };
+static auditinfo_addr_t		 stub_proc = { .ai_auid = AU_DEFAUDITID,
+				    .ai_termid.at_type = AU_IPv4 };
+static au_class_t		*stub_evclass;
+static struct stub_evname	*stub_evname;
+
+static void
+stub_lock(void)
+{
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_lock(&mutex);
+#endif
+}
+
+static void
+stub_unlock(void)
+{
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
+/*
+ * Event-to-class and event-to-name maps are allocated on first update, as
+ * most consumers never touch them.  Called with the stub lock held.
+ */
+static int
+stub_evmaps_alloc(void)
+{
+
+	if (stub_evclass == NULL) {
+		stub_evclass = calloc(STUB_NEVENTS, sizeof(*stub_evclass));
+		if (stub_evclass == NULL)
+			return (-1);
+	}
+	if (stub_evname == NULL) {
+		stub_evname = calloc(STUB_NEVENTS, sizeof(*stub_evname));
+		if (stub_evname == NULL)
+			return (-1);
+	}
+	return (0);
+}
+
+int
+audit(const void *record, int length)
+{
+	ssize_t len;
+	int error;
+
+	if (record == NULL || length <= 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+	stub_lock();
+	if (length > stub_qctrl.aq_bufsz) {
+		stub_unlock();
+		errno = EINVAL;
+		return (-1);
+	}
+	stub_stat.as_generated++;
+	stub_stat.as_audit++;
+	if (stub_cond != AUC_AUDITING || stub_trailfd == -1) {
+		stub_stat.as_dropped++;
+		stub_unlock();
+		return (0);
+	}
+	stub_stat.as_enqueue++;
+	len = write(stub_trailfd, record, length);
+	if (len != length) {
+		error = (len < 0) ? errno : EIO;
+		stub_stat.as_dropped++;
+		stub_unlock();
+		errno = error;
+		return (-1);
+	}
+	stub_stat.as_written++;
+	stub_stat.as_totalsize += length;
+	stub_fstat.af_currsz += length;
+	stub_unlock();
+	return (0);
+}
+
+int
+auditctl(const char *path)
+{
+	int fd;
+
+	fd = -1;
+	if (path != NULL) {
+		fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0600);
+		if (fd == -1)
+			return (-1);
+	}
+	stub_lock();
+	if (stub_trailfd != -1)
+		(void)close(stub_trailfd);
+	stub_trailfd = fd;
+	stub_fstat.af_currsz = 0;
+	stub_stat.as_auditctl++;
+	stub_unlock();
+	return (0);
+}
+
+int
+auditon(int cmd, void *data, int length)
+{
+	au_evclass_map_t *evc;
+	au_evname_map_t *evn;
+	auditpinfo_addr_t *apia;
+	auditpinfo_t *api;
+	int error;
+
+	if (data == NULL) {
+		errno = EINVAL;
+		return (-1);
+	}
+	error = 0;
+	stub_lock();
+	switch (cmd) {
+	case A_GETCOND:
+		if (length != sizeof(int)) {
+			error = EINVAL;
+			break;
+		}
+		*(int *)data = stub_cond;
+		break;
+
+	case A_SETCOND:
+		if (length != sizeof(int)) {
+			error = EINVAL;
+			break;
+		}
+		stub_cond = *(int *)data;
+		break;
+
+	case A_GETPOLICY:
+		if (length != sizeof(int)) {
+			error = EINVAL;
+			break;
+		}
+		*(int *)data = stub_policy;
+		break;
+
+	case A_SETPOLICY:
+		if (length != sizeof(int)) {
+			error = EINVAL;
+			break;
+		}
+		stub_policy = *(int *)data;
+		break;
+
+	case A_GETKMASK:
+		if (length != sizeof(stub_kmask)) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(data, &stub_kmask, sizeof(stub_kmask));
+		break;
+
+	case A_SETKMASK:
+		if (length != sizeof(stub_kmask)) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(&stub_kmask, data, sizeof(stub_kmask));
+		break;
+
+	case A_GETQCTRL:
+		if (length != sizeof(stub_qctrl)) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(data, &stub_qctrl, sizeof(stub_qctrl));
+		break;
+
+	case A_SETQCTRL:
+		if (length != sizeof(stub_qctrl)) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(&stub_qctrl, data, sizeof(stub_qctrl));
+		break;
+
+	case A_GETSTAT:
+		if (length != sizeof(stub_stat)) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(data, &stub_stat, sizeof(stub_stat));
+		break;
+
+	case A_SETSTAT:
+		if (length != sizeof(stub_stat)) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(&stub_stat, data, sizeof(stub_stat));
+		break;
+
+	case A_GETFSIZE:
+		if (length != sizeof(stub_fstat)) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(data, &stub_fstat, sizeof(stub_fstat));
+		break;
+
+	case A_SETFSIZE:
+		if (length != sizeof(stub_fstat)) {
+			error = EINVAL;
+			break;
+		}
+		stub_fstat.af_filesz = ((au_fstat_t *)data)->af_filesz;
+		break;
+
+	case A_GETKAUDIT:
+		if (length != sizeof(stub_kaudit)) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(data, &stub_kaudit, sizeof(stub_kaudit));
+		break;
+
+	case A_SETKAUDIT:
+		if (length != sizeof(stub_kaudit)) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(&stub_kaudit, data, sizeof(stub_kaudit));
+		break;
+
+	case A_GETCLASS:
+		if (length != sizeof(*evc)) {
+			error = EINVAL;
+			break;
+		}
+		evc = data;
+		evc->ec_class = (stub_evclass != NULL) ?
+		    stub_evclass[evc->ec_number] : 0;
+		break;
+
+	case A_SETCLASS:
+		if (length != sizeof(*evc)) {
+			error = EINVAL;
+			break;
+		}
+		if (stub_evmaps_alloc() != 0) {
+			error = ENOMEM;
+			break;
+		}
+		evc = data;
+		stub_evclass[evc->ec_number] = evc->ec_class;
+		break;
+
+	case A_GETEVENT:
+		if (length != sizeof(*evn)) {
+			error = EINVAL;
+			break;
+		}
+		evn = data;
+		if (stub_evname == NULL ||
+		    stub_evname[evn->en_number].en_name[0] == '\0') {
+			error = ENOENT;
+			break;
+		}
+		memcpy(evn->en_name, stub_evname[evn->en_number].en_name,
+		    sizeof(evn->en_name));
+		break;
+
+	case A_SETEVENT:
+		if (length != sizeof(*evn)) {
+			error = EINVAL;
+			break;
+		}
+		if (stub_evmaps_alloc() != 0) {
+			error = ENOMEM;
+			break;
+		}
+		evn = data;
+		memcpy(stub_evname[evn->en_number].en_name, evn->en_name,
+		    sizeof(evn->en_name));
+		stub_evname[evn->en_number].en_name[EVNAMEMAP_NAME_SIZE - 1] =
+		    '\0';
+		break;
+
+	case A_GETPINFO:
+		if (length != sizeof(*api)) {
+			error = EINVAL;
+			break;
+		}
+		api = data;
+		if (api->ap_pid != getpid()) {
+			error = ESRCH;
+			break;
+		}
+		if (stub_proc.ai_termid.at_type != AU_IPv4) {
+			error = EINVAL;
+			break;
+		}
+		api->ap_auid = stub_proc.ai_auid;
+		api->ap_mask = stub_proc.ai_mask;
+		api->ap_termid.port = stub_proc.ai_termid.at_port;
+		api->ap_termid.machine = stub_proc.ai_termid.at_addr[0];
+		api->ap_asid = stub_proc.ai_asid;
+		break;
+
+	case A_GETPINFO_ADDR:
+		if (length != sizeof(*apia)) {
+			error = EINVAL;
+			break;
+		}
+		apia = data;
+		if (apia->ap_pid != getpid()) {
+			error = ESRCH;
+			break;
+		}
+		apia->ap_auid = stub_proc.ai_auid;
+		apia->ap_mask = stub_proc.ai_mask;
+		apia->ap_termid = stub_proc.ai_termid;
+		apia->ap_asid = stub_proc.ai_asid;
+		apia->ap_flags = stub_proc.ai_flags;
+		break;
+
+	case A_SETPMASK:
+		if (length != sizeof(*api)) {
+			error = EINVAL;
+			break;
+		}
+		api = data;
+		if (api->ap_pid != getpid()) {
+			error = ESRCH;
+			break;
+		}
+		stub_proc.ai_mask = api->ap_mask;
+		break;
+
+	case A_GETSINFO_ADDR:
+		if (length != sizeof(stub_proc)) {
+			error = EINVAL;
+			break;
+		}
+		if (((auditinfo_addr_t *)data)->ai_asid != stub_proc.ai_asid) {
+			error = EINVAL;
+			break;
+		}
+		memcpy(data, &stub_proc, sizeof(stub_proc));
+		break;
+
+	case A_SENDTRIGGER:
+		if (length != sizeof(int)) {
+			error = EINVAL;
+			break;
+		}
+		/* There is no trigger device to deliver to; drop it. */
+		break;
+
+	default:
+		error = EINVAL;
+		break;
+	}
+	stub_unlock();
+	if (error != 0) {
+		errno = error;
+		return (-1);
+	}
+	return (0);
+}
+
+int
+getauid(au_id_t *auid)
+{
+
+	if (auid == NULL) {
+		errno = EFAULT;
+		return (-1);
+	}
+	stub_lock();
+	*auid = stub_proc.ai_auid;
+	stub_unlock();
+	return (0);
+}
+
+int
+setauid(const au_id_t *auid)
+{
+
+	if (auid == NULL) {
+		errno = EFAULT;
+		return (-1);
+	}
+	stub_lock();
+	stub_proc.ai_auid = *auid;
+	stub_unlock();
+	au_me_invalidate();
+	return (0);
+}
+
+int
+getaudit(struct auditinfo *ai)
+{
+	int error;
+
+	if (ai == NULL) {
+		errno = EFAULT;
+		return (-1);
+	}
+	error = 0;
+	stub_lock();
+	if (stub_proc.ai_termid.at_type != AU_IPv4)
+		error = E2BIG;
+	else {
+		ai->ai_auid = stub_proc.ai_auid;
+		ai->ai_mask = stub_proc.ai_mask;
+		ai->ai_termid.port = stub_proc.ai_termid.at_port;
+		ai->ai_termid.machine = stub_proc.ai_termid.at_addr[0];
+		ai->ai_asid = stub_proc.ai_asid;
+	}
+	stub_unlock();
+	if (error != 0) {
+		errno = error;
+		return (-1);
+	}
+	return (0);
+}
+
+int
+setaudit(const struct auditinfo *ai)
+{
+
+	if (ai == NULL) {
+		errno = EFAULT;
+		return (-1);
+	}
+	stub_lock();
+	memset(&stub_proc, 0, sizeof(stub_proc));
+	stub_proc.ai_auid = ai->ai_auid;
+	stub_proc.ai_mask = ai->ai_mask;
+	stub_proc.ai_termid.at_port = ai->ai_termid.port;
+	stub_proc.ai_termid.at_type = AU_IPv4;
+	stub_proc.ai_termid.at_addr[0] = ai->ai_termid.machine;
+	stub_proc.ai_asid = ai->ai_asid;
+	stub_unlock();
+	au_me_invalidate();
+	return (0);
+}
+
+int
+getaudit_addr(struct auditinfo_addr *aia, int length)
+{
+
+	if (aia == NULL) {
+		errno = EFAULT;
+		return (-1);
+	}
+	if (length != sizeof(*aia)) {
+		errno = EOVERFLOW;
+		return (-1);
+	}
+	stub_lock();
+	memcpy(aia, &stub_proc, sizeof(*aia));
+	stub_unlock();
+	return (0);
+}
+
+int
+setaudit_addr(const struct auditinfo_addr *aia, int length)
+{
+
+	if (aia == NULL) {
+		errno = EFAULT;
+		return (-1);
+	}
+	if (length != sizeof(*aia)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if (aia->ai_termid.at_type != AU_IPv4 &&
+	    aia->ai_termid.at_type != AU_IPv6) {
+		errno = EINVAL;
+		return (-1);
+	}
+	stub_lock();
+	memcpy(&stub_proc, aia, sizeof(stub_proc));
+	stub_unlock();
+	au_me_invalidate();
+	return (0);
+}
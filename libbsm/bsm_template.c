@@ -0,0 +1,378 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Record templates for events whose records always carry the same sequence
+ * of tokens.  The layout of the record is worked out once when the template
+ * is created; each instance is then encoded straight into a single buffer,
+ * after one bounds check, without building and queueing individual tokens
+ * as au_open()/au_write()/au_close() do.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <config/config.h>
+
+#ifdef USE_ENDIAN_H
+#include <endian.h>
+#endif
+#ifdef USE_SYS_ENDIAN_H
+#include <sys/endian.h>
+#endif
+#ifdef USE_MACHINE_ENDIAN_H
+#include <machine/endian.h>
+#endif
+#ifdef USE_COMPAT_ENDIAN_H
+#include <compat/endian.h>
+#endif
+#ifdef USE_COMPAT_ENDIAN_ENC_H
+#include <compat/endian_enc.h>
+#endif
+
+#ifdef HAVE_FULL_QUEUE_H
+#include <sys/queue.h>
+#else /* !HAVE_FULL_QUEUE_H */
+#include <compat/queue.h>
+#endif /* !HAVE_FULL_QUEUE_H */
+
+#include <netinet/in.h>
+
+#include <bsm/audit_internal.h>
+#include <bsm/libbsm.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct au_template {
+	au_event_t		 at_event;
+	au_emod_t		 at_emod;
+	size_t			 at_hdrsize;	/* Header token size. */
+	auditinfo_addr_t	 at_kaudit;	/* Host address for header. */
+	size_t			 at_fixedsize;	/* Record size less strings. */
+	int			 at_nslots;
+	int			 at_nvar;	/* Slots holding a string. */
+	u_char			 at_types[AU_TEMPLATE_MAXSLOTS];
+	u_char			 at_var[AU_TEMPLATE_MAXSLOTS];
+};
+
+/*
+ * Return the size of a token of the given type, excluding any string, or 0
+ * if the type cannot be used in a template.  *varp is set if the token
+ * carries a string.
+ */
+static size_t
+au_template_tokfixed(u_char type, int *varp)
+{
+
+	*varp = 0;
+	switch (type) {
+	case AUT_SUBJECT32:
+	case AUT_PROCESS32:
+		return (sizeof(u_char) + 9 * sizeof(u_int32_t));
+
+	case AUT_RETURN32:
+		return (2 * sizeof(u_char) + sizeof(u_int32_t));
+
+	case AUT_RETURN64:
+		return (2 * sizeof(u_char) + sizeof(u_int64_t));
+
+	case AUT_EXIT:
+		return (sizeof(u_char) + 2 * sizeof(u_int32_t));
+
+	case AUT_IPORT:
+		return (sizeof(u_char) + sizeof(u_int16_t));
+
+	case AUT_TEXT:
+	case AUT_PATH:
+	case AUT_ZONENAME:
+		*varp = 1;
+		return (sizeof(u_char) + sizeof(u_int16_t) + 1);
+
+	case AUT_ARG32:
+		*varp = 1;
+		return (2 * sizeof(u_char) + sizeof(u_int32_t) +
+		    sizeof(u_int16_t) + 1);
+
+	case AUT_ARG64:
+		*varp = 1;
+		return (2 * sizeof(u_char) + sizeof(u_int64_t) +
+		    sizeof(u_int16_t) + 1);
+
+	default:
+		return (0);
+	}
+}
+
+au_template_t *
+au_template_create(au_event_t event, au_emod_t emod, const u_char *types,
+    int ntypes)
+{
+	au_template_t *tmpl;
+#ifdef HAVE_AUDIT_SYSCALLS
+	struct in6_addr *aptr;
+#endif
+	size_t fixed;
+	int i, var;
+
+	if (types == NULL || ntypes < 0 || ntypes > AU_TEMPLATE_MAXSLOTS) {
+		errno = EINVAL;
+		return (NULL);
+	}
+	tmpl = calloc(1, sizeof(*tmpl));
+	if (tmpl == NULL)
+		return (NULL);
+	tmpl->at_event = event;
+	tmpl->at_emod = emod;
+
+	/*
+	 * Choose the header form once, as au_close() would for each record.
+	 */
+	tmpl->at_hdrsize = AUDIT_HEADER_SIZE;
+	tmpl->at_kaudit.ai_termid.at_type = AU_IPv4;
+	tmpl->at_kaudit.ai_termid.at_addr[0] = INADDR_ANY;
+#ifdef HAVE_AUDIT_SYSCALLS
+	if (audit_get_kaudit(&tmpl->at_kaudit,
+	    sizeof(tmpl->at_kaudit)) == 0) {
+		switch (tmpl->at_kaudit.ai_termid.at_type) {
+		case AU_IPv4:
+			if (tmpl->at_kaudit.ai_termid.at_addr[0] !=
+			    INADDR_ANY)
+				tmpl->at_hdrsize =
+				    AUDIT_HEADER_EX_SIZE(&tmpl->at_kaudit);
+			break;
+		case AU_IPv6:
+			aptr = (struct in6_addr *)
+			    &tmpl->at_kaudit.ai_termid.at_addr[0];
+			if (!IN6_IS_ADDR_UNSPECIFIED(aptr))
+				tmpl->at_hdrsize =
+				    AUDIT_HEADER_EX_SIZE(&tmpl->at_kaudit);
+			break;
+		}
+	}
+#endif /* HAVE_AUDIT_SYSCALLS */
+
+	tmpl->at_fixedsize = tmpl->at_hdrsize + AUDIT_TRAILER_SIZE;
+	for (i = 0; i < ntypes; i++) {
+		fixed = au_template_tokfixed(types[i], &var);
+		if (fixed == 0) {
+			free(tmpl);
+			errno = EINVAL;
+			return (NULL);
+		}
+		tmpl->at_types[i] = types[i];
+		if (var)
+			tmpl->at_var[tmpl->at_nvar++] = i;
+		tmpl->at_fixedsize += fixed;
+	}
+	tmpl->at_nslots = ntypes;
+	if (tmpl->at_fixedsize > MAX_AUDIT_RECORD_SIZE) {
+		free(tmpl);
+		errno = EINVAL;
+		return (NULL);
+	}
+	return (tmpl);
+}
+
+void
+au_template_free(au_template_t *tmpl)
+{
+
+	free(tmpl);
+}
+
+/*
+ * Return the size of the record an instance will produce, or 0 if it would
+ * be too large.  Only the string-bearing slots need to be examined.
+ */
+static size_t
+au_template_size(const au_template_t *tmpl, const au_tmpl_val_t *vals)
+{
+	const au_tmpl_val_t *tv;
+	size_t len, reclen;
+	int i;
+
+	reclen = tmpl->at_fixedsize;
+	for (i = 0; i < tmpl->at_nvar; i++) {
+		tv = &vals[tmpl->at_var[i]];
+		switch (tmpl->at_types[tmpl->at_var[i]]) {
+		case AUT_ARG32:
+		case AUT_ARG64:
+			len = strlen(tv->tv_arg.text);
+			break;
+
+		default:
+			len = strlen(tv->tv_str);
+			break;
+		}
+		if (len >= UINT16_MAX)
+			return (0);
+		reclen += len;
+	}
+	if (reclen > MAX_AUDIT_RECORD_SIZE)
+		return (0);
+	return (reclen);
+}
+
+static void
+au_template_encode(const au_template_t *tmpl, const au_tmpl_val_t *vals,
+    u_char *dptr, size_t reclen)
+{
+	const au_tmpl_val_t *tv;
+	struct timeval tm;
+	u_int16_t textlen;
+	int i;
+
+	(void)gettimeofday(&tm, NULL);
+	if (tmpl->at_hdrsize > AUDIT_HEADER_SIZE) {
+		ADD_U_CHAR(dptr, AUT_HEADER32_EX);
+		ADD_U_INT32(dptr, reclen);
+		ADD_U_CHAR(dptr, AUDIT_HEADER_VERSION_OPENBSM);
+		ADD_U_INT16(dptr, tmpl->at_event);
+		ADD_U_INT16(dptr, tmpl->at_emod);
+		ADD_U_INT32(dptr, tmpl->at_kaudit.ai_termid.at_type);
+		ADD_MEM(dptr, &tmpl->at_kaudit.ai_termid.at_addr[0],
+		    tmpl->at_kaudit.ai_termid.at_type);
+	} else {
+		ADD_U_CHAR(dptr, AUT_HEADER32);
+		ADD_U_INT32(dptr, reclen);
+		ADD_U_CHAR(dptr, AUDIT_HEADER_VERSION_OPENBSM);
+		ADD_U_INT16(dptr, tmpl->at_event);
+		ADD_U_INT16(dptr, tmpl->at_emod);
+	}
+	ADD_U_INT32(dptr, tm.tv_sec);
+	ADD_U_INT32(dptr, tm.tv_usec / 1000);
+
+	for (i = 0; i < tmpl->at_nslots; i++) {
+		tv = &vals[i];
+		ADD_U_CHAR(dptr, tmpl->at_types[i]);
+		switch (tmpl->at_types[i]) {
+		case AUT_SUBJECT32:
+		case AUT_PROCESS32:
+			ADD_U_INT32(dptr, tv->tv_subj.auid);
+			ADD_U_INT32(dptr, tv->tv_subj.euid);
+			ADD_U_INT32(dptr, tv->tv_subj.egid);
+			ADD_U_INT32(dptr, tv->tv_subj.ruid);
+			ADD_U_INT32(dptr, tv->tv_subj.rgid);
+			ADD_U_INT32(dptr, tv->tv_subj.pid);
+			ADD_U_INT32(dptr, tv->tv_subj.sid);
+			ADD_U_INT32(dptr, tv->tv_subj.tid.port);
+			ADD_MEM(dptr, &tv->tv_subj.tid.machine,
+			    sizeof(u_int32_t));
+			break;
+
+		case AUT_RETURN32:
+			ADD_U_CHAR(dptr, tv->tv_ret.status);
+			ADD_U_INT32(dptr, tv->tv_ret.ret);
+			break;
+
+		case AUT_RETURN64:
+			ADD_U_CHAR(dptr, tv->tv_ret.status);
+			ADD_U_INT64(dptr, tv->tv_ret.ret);
+			break;
+
+		case AUT_EXIT:
+			ADD_U_INT32(dptr, tv->tv_exit.retval);
+			ADD_U_INT32(dptr, tv->tv_exit.err);
+			break;
+
+		case AUT_IPORT:
+			ADD_U_INT16(dptr, tv->tv_iport);
+			break;
+
+		case AUT_ARG32:
+		case AUT_ARG64:
+			ADD_U_CHAR(dptr, tv->tv_arg.no);
+			if (tmpl->at_types[i] == AUT_ARG32)
+				ADD_U_INT32(dptr, tv->tv_arg.val);
+			else
+				ADD_U_INT64(dptr, tv->tv_arg.val);
+			textlen = strlen(tv->tv_arg.text) + 1;
+			ADD_U_INT16(dptr, textlen);
+			ADD_STRING(dptr, tv->tv_arg.text, textlen);
+			break;
+
+		default:
+			textlen = strlen(tv->tv_str) + 1;
+			ADD_U_INT16(dptr, textlen);
+			ADD_STRING(dptr, tv->tv_str, textlen);
+			break;
+		}
+	}
+
+	ADD_U_CHAR(dptr, AUT_TRAILER);
+	ADD_U_INT16(dptr, AUT_TRAILER_MAGIC);
+	ADD_U_INT32(dptr, reclen);
+}
+
+/*
+ * Encode an instance of the template into a caller-supplied buffer of size
+ * *buflen; the record size is returned via the same argument.
+ */
+int
+au_template_close_buffer(const au_template_t *tmpl,
+    const au_tmpl_val_t *vals, u_char *buffer, size_t *buflen)
+{
+	size_t reclen;
+
+	reclen = au_template_size(tmpl, vals);
+	if (reclen == 0 || reclen > *buflen) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	au_template_encode(tmpl, vals, buffer, reclen);
+	*buflen = reclen;
+	return (0);
+}
+
+#ifdef HAVE_AUDIT_SYSCALLS
+/*
+ * Encode an instance of the template and commit it to the audit trail.
+ */
+int
+au_template_close(const au_template_t *tmpl, const au_tmpl_val_t *vals)
+{
+	u_char *buffer;
+	size_t reclen;
+	int error, retval;
+
+	reclen = au_template_size(tmpl, vals);
+	if (reclen == 0) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	buffer = malloc(reclen);
+	if (buffer == NULL)
+		return (-1);
+	au_template_encode(tmpl, vals, buffer, reclen);
+	retval = audit(buffer, reclen);
+	error = errno;
+	free(buffer);
+	errno = error;
+	return (retval);
+}
+#endif /* HAVE_AUDIT_SYSCALLS */
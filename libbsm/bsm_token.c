@@ -65,6 +65,7 @@
 
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 
 #include <sys/ipc.h>
@@ -75,6 +76,9 @@
 
 #include <assert.h>
 #include <errno.h>
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+#include <pthread.h>
+#endif
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -1429,88 +1433,221 @@ au_to_me(void)
 	return (au_to_subject32_ex(aia.ai_auid, geteuid(), getegid(), getuid(),
 		getgid(), getpid(), aia.ai_asid, &aia.ai_termid));
 }
+
+/*
+ * Cached encoding of the subject token returned by au_to_me(), for callers
+ * that put the calling process on every record.  The cache is filled on
+ * first use and reused until au_me_invalidate() is called, which a process
+ * must do after changing its credentials or audit state; libbsm does so
+ * itself in a forked child.  Largest subject is a subject32_ex token with an
+ * IPv6 terminal address.
+ */
+#define	AU_ME_SUBJECT_MAX	(sizeof(u_char) + 13 * sizeof(u_int32_t))
+
+static u_char		 au_me_subject[AU_ME_SUBJECT_MAX];
+static size_t		 au_me_len;
+static u_int		 au_me_gen;	/* Generation of cached subject. */
+static u_int		 au_me_curgen = 1;
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+static pthread_mutex_t	 au_me_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t	 au_me_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Hold the cache lock across fork(2), so that the child never inherits it
+ * locked by a thread that does not exist there.
+ */
+static void
+au_me_prefork(void)
+{
+
+	pthread_mutex_lock(&au_me_mutex);
+}
+
+static void
+au_me_postfork_parent(void)
+{
+
+	pthread_mutex_unlock(&au_me_mutex);
+}
+
+static void
+au_me_postfork_child(void)
+{
+
+	au_me_invalidate();
+	pthread_mutex_unlock(&au_me_mutex);
+}
+
+static void
+au_me_atfork(void)
+{
+
+	(void)pthread_atfork(au_me_prefork, au_me_postfork_parent,
+	    au_me_postfork_child);
+}
+#endif
+
+void
+au_me_invalidate(void)
+{
+
+	__atomic_add_fetch(&au_me_curgen, 1, __ATOMIC_SEQ_CST);
+}
+
+token_t *
+au_to_me_cached(void)
+{
+	token_t *t;
+	u_char *dptr = NULL;
+	u_int gen;
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	(void)pthread_once(&au_me_once, au_me_atfork);
+	pthread_mutex_lock(&au_me_mutex);
+#endif
+	gen = __atomic_load_n(&au_me_curgen, __ATOMIC_SEQ_CST);
+	if (au_me_gen != gen) {
+		t = au_to_me();
+		if (t == NULL || t->len > AU_ME_SUBJECT_MAX) {
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+			pthread_mutex_unlock(&au_me_mutex);
+#endif
+			return (t);
+		}
+		memcpy(au_me_subject, t->t_data, t->len);
+		au_me_len = t->len;
+		au_me_gen = gen;
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_unlock(&au_me_mutex);
+#endif
+		return (t);
+	}
+	GET_TOKEN_AREA(t, dptr, au_me_len);
+	if (t != NULL)
+		memcpy(dptr, au_me_subject, au_me_len);
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&au_me_mutex);
+#endif
+	return (t);
+}
 #endif
 
 /*
  * token ID				1 byte
  * count				4 bytes
  * text					count null-terminated strings
+ *
+ * Strings are measured once and copied once; the token is sized exactly
+ * before any string is copied.
  */
-token_t *
-au_to_exec_args(char **argv)
+static token_t *
+au_to_exec_strings(u_char type, char **strs)
 {
 	token_t *t;
 	u_char *dptr = NULL;
-	const char *nextarg;
-	int i, count = 0;
 	size_t totlen = 0;
+	int i, count = 0;
 
-	nextarg = *argv;
-
-	while (nextarg != NULL) {
-		int nextlen;
-
-		nextlen = strlen(nextarg);
-		totlen += nextlen + 1;
+	while (strs[count] != NULL) {
+		totlen += strlen(strs[count]) + 1;
 		count++;
-		nextarg = *(argv + count);
 	}
 
 	GET_TOKEN_AREA(t, dptr, sizeof(u_char) + sizeof(u_int32_t) + totlen);
 	if (t == NULL)
 		return (NULL);
 
-	ADD_U_CHAR(dptr, AUT_EXEC_ARGS);
+	ADD_U_CHAR(dptr, type);
 	ADD_U_INT32(dptr, count);
 
-	for (i = 0; i < count; i++) {
-		nextarg = *(argv + i);
-		ADD_MEM(dptr, nextarg, strlen(nextarg) + 1);
-	}
+	for (i = 0; i < count; i++)
+		dptr = (u_char *)stpcpy((char *)dptr, strs[i]) + 1;
 
 	return (t);
 }
 
-/*
- * token ID				1 byte
- * count				4 bytes
- * text					count null-terminated strings
- */
+token_t *
+au_to_exec_args(char **argv)
+{
+
+	return (au_to_exec_strings(AUT_EXEC_ARGS, argv));
+}
+
 token_t *
 au_to_exec_env(char **envp)
 {
-	token_t *t;
-	u_char *dptr = NULL;
-	int i, count = 0;
-	size_t totlen = 0;
-	const char *nextenv;
 
-	nextenv = *envp;
+	return (au_to_exec_strings(AUT_EXEC_ENV, envp));
+}
 
-	while (nextenv != NULL) {
-		int nextlen;
+/*
+ * As above, but from strings whose lengths the caller has already measured;
+ * iov_len excludes the terminating NUL, which is supplied here.  The token
+ * is limited to maxsize bytes: strings that do not fit are dropped from the
+ * end of the vector, with the first of them truncated to the remaining
+ * space, and the count reflects what was actually recorded.
+ */
+static token_t *
+au_to_exec_strings_iov(u_char type, const struct iovec *iov, int iovcnt,
+    size_t maxsize)
+{
+	token_t *t;
+	u_char *dptr = NULL;
+	size_t avail, partial, totlen;
+	int count, i;
 
-		nextlen = strlen(nextenv);
-		totlen += nextlen + 1;
-		count++;
-		nextenv = *(envp + count);
+	if (iovcnt < 0 || maxsize < sizeof(u_char) + sizeof(u_int32_t)) {
+		errno = EINVAL;
+		return (NULL);
+	}
+	avail = maxsize - (sizeof(u_char) + sizeof(u_int32_t));
+	totlen = 0;
+	partial = 0;
+	for (count = 0; count < iovcnt; count++) {
+		if (iov[count].iov_len + 1 > avail - totlen) {
+			/* Keep a prefix of this string if any of it fits. */
+			if (avail - totlen >= 2)
+				partial = avail - totlen;
+			break;
+		}
+		totlen += iov[count].iov_len + 1;
 	}
 
-	GET_TOKEN_AREA(t, dptr, sizeof(u_char) + sizeof(u_int32_t) + totlen);
+	GET_TOKEN_AREA(t, dptr, sizeof(u_char) + sizeof(u_int32_t) + totlen +
+	    partial);
 	if (t == NULL)
 		return (NULL);
 
-	ADD_U_CHAR(dptr, AUT_EXEC_ENV);
-	ADD_U_INT32(dptr, count);
+	ADD_U_CHAR(dptr, type);
+	ADD_U_INT32(dptr, count + (partial != 0));
 
 	for (i = 0; i < count; i++) {
-		nextenv = *(envp + i);
-		ADD_MEM(dptr, nextenv, strlen(nextenv) + 1);
+		ADD_MEM(dptr, iov[i].iov_base, iov[i].iov_len);
+		ADD_U_CHAR(dptr, '\0');
+	}
+	if (partial != 0) {
+		ADD_MEM(dptr, iov[count].iov_base, partial - 1);
+		ADD_U_CHAR(dptr, '\0');
 	}
 
 	return (t);
 }
 
+token_t *
+au_to_exec_args_iov(const struct iovec *iov, int iovcnt, size_t maxsize)
+{
+
+	return (au_to_exec_strings_iov(AUT_EXEC_ARGS, iov, iovcnt, maxsize));
+}
+
+token_t *
+au_to_exec_env_iov(const struct iovec *iov, int iovcnt, size_t maxsize)
+{
+
+	return (au_to_exec_strings_iov(AUT_EXEC_ENV, iov, iovcnt, maxsize));
+}
+
 /*
  * token ID                1 byte
  * zonename length         2 bytes
@@ -0,0 +1,483 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Sets of audit trails read as one stream of records, in the order of the
+ * times in their headers.
+ *
+ * Each trail is expected to be in time order itself, as written by auditd(8),
+ * so only the next record of each trail need be held: the trails are kept
+ * in a binary heap keyed on the time of that record, and each read takes the
+ * record at the top of the heap and reads the next one from its trail.  Ties
+ * go to the trail added first, so that trails of one host added in order of
+ * their names keep their order.
+ *
+ * No more than ts_maxopen trails are open at once.  When another must be
+ * read, the one least recently read is closed, and it is opened again where
+ * it was left when its turn comes.  Trails that cover separate periods, such
+ * as the rotations of one host, are then each opened about once; only trails
+ * that overlap in time, and are more than can be open, are opened again.
+ * With AU_TRAILSET_PREOPEN no trail is ever closed, so a trail that would
+ * be one more than ts_maxopen cannot be added.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <config/config.h>
+
+#ifdef HAVE_FULL_QUEUE_H
+#include <sys/queue.h>
+#else /* !HAVE_FULL_QUEUE_H */
+#include <compat/queue.h>
+#endif /* !HAVE_FULL_QUEUE_H */
+
+#include <bsm/libbsm.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Descriptors left for other uses when every trail is kept open. */
+#define	AU_TRAILSET_RESERVE	16
+
+struct au_trail {
+	char			*tr_path;
+	FILE			*tr_fp;		/* NULL while closed. */
+	off_t			 tr_off;	/* Offset of the next record. */
+	u_char			*tr_buf;	/* Next record. */
+	int			 tr_len;
+	u_int64_t		 tr_sec;	/* Time of the next record. */
+	u_int64_t		 tr_msec;
+	int			 tr_index;	/* Order of addition. */
+	TAILQ_ENTRY(au_trail)	 tr_lru;	/* Open trails, oldest first. */
+};
+
+struct au_trailset {
+	int			 ts_flags;
+	int			 ts_maxopen;
+	int			 ts_nopen;
+	TAILQ_HEAD(, au_trail)	 ts_lru;
+	struct au_trail		**ts_heap;	/* Trails with records left. */
+	int			 ts_nheap;
+	int			 ts_size;
+	int			 ts_ntrails;	/* Ever added. */
+	int			 ts_started;	/* Heap in order. */
+	int			 ts_error;	/* First error reading a trail. */
+};
+
+/*
+ * Names given by auditd(8) to trail files: the time the trail was started,
+ * then a '.' and the time it was closed or a word saying why it was not.
+ * Other entries in a trail directory, such as the "current" link to the
+ * trail being written, are not trails to be read.
+ */
+static int
+au_trailset_istrail(const char *name)
+{
+	int i;
+
+	for (i = 0; i < 14; i++)
+		if (!isdigit((u_char)name[i]))
+			return (0);
+	return (name[i] == '.');
+}
+
+static int
+au_trailset_namecmp(const void *a, const void *b)
+{
+
+	return (strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+static void
+au_trailset_error(au_trailset_t *ts, int error)
+{
+
+	if (ts->ts_error == 0)
+		ts->ts_error = error;
+}
+
+/*
+ * Make sure a trail is open, closing the trail least recently read if as
+ * many as allowed already are.
+ */
+static int
+au_trailset_use(au_trailset_t *ts, struct au_trail *tr)
+{
+	struct au_trail *old;
+
+	if (tr->tr_fp != NULL) {
+		TAILQ_REMOVE(&ts->ts_lru, tr, tr_lru);
+		TAILQ_INSERT_TAIL(&ts->ts_lru, tr, tr_lru);
+		return (0);
+	}
+	if (ts->ts_nopen >= ts->ts_maxopen &&
+	    (ts->ts_flags & AU_TRAILSET_PREOPEN)) {
+		errno = EMFILE;
+		return (-1);
+	}
+	if (ts->ts_nopen >= ts->ts_maxopen &&
+	    (old = TAILQ_FIRST(&ts->ts_lru)) != NULL) {
+		TAILQ_REMOVE(&ts->ts_lru, old, tr_lru);
+		fclose(old->tr_fp);
+		old->tr_fp = NULL;
+		ts->ts_nopen--;
+	}
+	if ((tr->tr_fp = fopen(tr->tr_path, "r")) == NULL)
+		return (-1);
+	if (tr->tr_off != 0 && fseeko(tr->tr_fp, tr->tr_off, SEEK_SET) != 0) {
+		fclose(tr->tr_fp);
+		tr->tr_fp = NULL;
+		return (-1);
+	}
+	TAILQ_INSERT_TAIL(&ts->ts_lru, tr, tr_lru);
+	ts->ts_nopen++;
+	return (0);
+}
+
+static void
+au_trailset_free(au_trailset_t *ts, struct au_trail *tr)
+{
+
+	if (tr->tr_fp != NULL) {
+		TAILQ_REMOVE(&ts->ts_lru, tr, tr_lru);
+		fclose(tr->tr_fp);
+		ts->ts_nopen--;
+	}
+	free(tr->tr_buf);
+	free(tr->tr_path);
+	free(tr);
+}
+
+/*
+ * Read the next record of a trail and note its time.  Return 0 at the end
+ * of the trail, which is also where an error leaves it.
+ */
+static int
+au_trailset_next(au_trailset_t *ts, struct au_trail *tr)
+{
+	tokenstr_t tok;
+
+	if (au_trailset_use(ts, tr) != 0) {
+		au_trailset_error(ts, errno);
+		return (0);
+	}
+	tr->tr_len = au_read_rec(tr->tr_fp, &tr->tr_buf);
+	if (tr->tr_len == -1) {
+		tr->tr_buf = NULL;
+		if (!feof(tr->tr_fp) || ftello(tr->tr_fp) != tr->tr_off)
+			au_trailset_error(ts, errno);
+		return (0);
+	}
+	tr->tr_off = ftello(tr->tr_fp);
+
+	/*
+	 * A record whose time cannot be found keeps the time of the one
+	 * before it, and so its place in the trail.
+	 */
+	if (au_fetch_tok(&tok, tr->tr_buf, tr->tr_len) == 0) {
+		switch (tok.id) {
+		case AUT_HEADER32:
+			tr->tr_sec = tok.tt.hdr32.s;
+			tr->tr_msec = tok.tt.hdr32.ms;
+			break;
+
+		case AUT_HEADER32_EX:
+			tr->tr_sec = tok.tt.hdr32_ex.s;
+			tr->tr_msec = tok.tt.hdr32_ex.ms;
+			break;
+
+		case AUT_HEADER64:
+			tr->tr_sec = tok.tt.hdr64.s;
+			tr->tr_msec = tok.tt.hdr64.ms;
+			break;
+
+		case AUT_HEADER64_EX:
+			tr->tr_sec = tok.tt.hdr64_ex.s;
+			tr->tr_msec = tok.tt.hdr64_ex.ms;
+			break;
+
+		case AUT_OTHER_FILE32:
+			tr->tr_sec = tok.tt.file.s;
+			tr->tr_msec = tok.tt.file.ms;
+			break;
+		}
+	}
+	return (1);
+}
+
+static int
+au_trailset_before(const struct au_trail *a, const struct au_trail *b)
+{
+
+	if (a->tr_sec != b->tr_sec)
+		return (a->tr_sec < b->tr_sec);
+	if (a->tr_msec != b->tr_msec)
+		return (a->tr_msec < b->tr_msec);
+	return (a->tr_index < b->tr_index);
+}
+
+static void
+au_trailset_siftdown(au_trailset_t *ts, int i)
+{
+	struct au_trail **heap, *tr;
+	int child;
+
+	heap = ts->ts_heap;
+	tr = heap[i];
+	while ((child = 2 * i + 1) < ts->ts_nheap) {
+		if (child + 1 < ts->ts_nheap &&
+		    au_trailset_before(heap[child + 1], heap[child]))
+			child++;
+		if (!au_trailset_before(heap[child], tr))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = tr;
+}
+
+static void
+au_trailset_siftup(au_trailset_t *ts, int i)
+{
+	struct au_trail **heap, *tr;
+	int parent;
+
+	heap = ts->ts_heap;
+	tr = heap[i];
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!au_trailset_before(tr, heap[parent]))
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = tr;
+}
+
+/*
+ * Read the first record of the trail at the end of the heap, and put the
+ * trail in its place, or drop it if it has no records.
+ */
+static void
+au_trailset_prime(au_trailset_t *ts)
+{
+	struct au_trail *tr;
+
+	tr = ts->ts_heap[ts->ts_nheap - 1];
+	if (au_trailset_next(ts, tr))
+		au_trailset_siftup(ts, ts->ts_nheap - 1);
+	else {
+		ts->ts_nheap--;
+		au_trailset_free(ts, tr);
+	}
+}
+
+static int
+au_trailset_addfile(au_trailset_t *ts, const char *path)
+{
+	struct au_trail **heap, *tr;
+	int size;
+
+	if (ts->ts_nheap == ts->ts_size) {
+		size = ts->ts_size == 0 ? 16 : ts->ts_size * 2;
+		heap = realloc(ts->ts_heap, size * sizeof(*heap));
+		if (heap == NULL)
+			return (-1);
+		ts->ts_heap = heap;
+		ts->ts_size = size;
+	}
+	if ((tr = calloc(1, sizeof(*tr))) == NULL)
+		return (-1);
+	if ((tr->tr_path = strdup(path)) == NULL) {
+		free(tr);
+		return (-1);
+	}
+	tr->tr_index = ts->ts_ntrails;
+
+	/*
+	 * Open the trail now, so that one that cannot be read is reported
+	 * here; unless it is to be kept open, it is the first to be closed
+	 * when another must be opened.
+	 */
+	if (au_trailset_use(ts, tr) != 0) {
+		au_trailset_free(ts, tr);
+		return (-1);
+	}
+	if (!(ts->ts_flags & AU_TRAILSET_PREOPEN)) {
+		TAILQ_REMOVE(&ts->ts_lru, tr, tr_lru);
+		TAILQ_INSERT_HEAD(&ts->ts_lru, tr, tr_lru);
+	}
+	ts->ts_heap[ts->ts_nheap++] = tr;
+	ts->ts_ntrails++;
+	if (ts->ts_started)
+		au_trailset_prime(ts);
+	return (0);
+}
+
+static int
+au_trailset_adddir(au_trailset_t *ts, const char *path)
+{
+	char file[MAXPATHLEN];
+	char **names, **p;
+	struct dirent *dp;
+	int error, n, size;
+	DIR *dirp;
+
+	if ((dirp = opendir(path)) == NULL)
+		return (-1);
+	names = NULL;
+	n = size = 0;
+	error = 0;
+	while ((dp = readdir(dirp)) != NULL) {
+		if (!au_trailset_istrail(dp->d_name))
+			continue;
+		if (n == size) {
+			size = size == 0 ? 64 : size * 2;
+			p = realloc(names, size * sizeof(*names));
+			if (p == NULL) {
+				error = errno;
+				break;
+			}
+			names = p;
+		}
+		if ((names[n] = strdup(dp->d_name)) == NULL) {
+			error = errno;
+			break;
+		}
+		n++;
+	}
+	closedir(dirp);
+
+	/* The names sort in the order the trails were started. */
+	if (error == 0)
+		qsort(names, n, sizeof(*names), au_trailset_namecmp);
+	for (p = names; p < names + n; p++) {
+		if (error == 0) {
+			snprintf(file, sizeof(file), "%s/%s", path, *p);
+			if (au_trailset_addfile(ts, file) != 0)
+				error = errno;
+		}
+		free(*p);
+	}
+	free(names);
+	if (error != 0) {
+		errno = error;
+		return (-1);
+	}
+	return (0);
+}
+
+au_trailset_t *
+au_trailset_open(int flags, int maxopen)
+{
+	au_trailset_t *ts;
+	long openmax;
+
+	if ((ts = calloc(1, sizeof(*ts))) == NULL)
+		return (NULL);
+	ts->ts_flags = flags;
+	TAILQ_INIT(&ts->ts_lru);
+
+	/*
+	 * By default, leave half the descriptors of the process for other
+	 * uses, or, when every trail is kept open, AU_TRAILSET_RESERVE.
+	 */
+	if (maxopen <= 0) {
+		openmax = sysconf(_SC_OPEN_MAX);
+		if (openmax <= 0 || openmax > INT_MAX)
+			maxopen = 64;
+		else if (flags & AU_TRAILSET_PREOPEN)
+			maxopen = openmax - AU_TRAILSET_RESERVE;
+		else
+			maxopen = openmax / 2;
+	}
+	ts->ts_maxopen = maxopen < 1 ? 1 : maxopen;
+	return (ts);
+}
+
+int
+au_trailset_add(au_trailset_t *ts, const char *path)
+{
+	struct stat sb;
+
+	if (stat(path, &sb) != 0)
+		return (-1);
+	if (S_ISDIR(sb.st_mode))
+		return (au_trailset_adddir(ts, path));
+	return (au_trailset_addfile(ts, path));
+}
+
+int
+au_trailset_read(au_trailset_t *ts, u_char **buf)
+{
+	struct au_trail *tr;
+	int i, len, n;
+
+	if (!ts->ts_started) {
+		n = ts->ts_nheap;
+		ts->ts_nheap = 0;
+		for (i = 0; i < n; i++) {
+			ts->ts_heap[ts->ts_nheap++] = ts->ts_heap[i];
+			au_trailset_prime(ts);
+		}
+		ts->ts_started = 1;
+	}
+	if (ts->ts_nheap == 0) {
+		errno = ts->ts_error;
+		return (-1);
+	}
+
+	tr = ts->ts_heap[0];
+	*buf = tr->tr_buf;
+	len = tr->tr_len;
+	tr->tr_buf = NULL;
+	if (!au_trailset_next(ts, tr)) {
+		au_trailset_free(ts, tr);
+		ts->ts_heap[0] = ts->ts_heap[--ts->ts_nheap];
+	}
+	if (ts->ts_nheap > 0)
+		au_trailset_siftdown(ts, 0);
+	return (len);
+}
+
+void
+au_trailset_close(au_trailset_t *ts)
+{
+	int i;
+
+	for (i = 0; i < ts->ts_nheap; i++)
+		au_trailset_free(ts, ts->ts_heap[i]);
+	free(ts->ts_heap);
+	free(ts);
+}
@@ -43,12 +43,14 @@
 #include <compat/strlcpy.h>
 #endif
 
+#include "bsm_db.h"
+
 /*
- * Parse the contents of the audit_user file into au_user_ent structures.
+ * Parse the contents of the audit_user file into a snapshot (see bsm_db.h)
+ * on first use, from which au_user_ent structures are returned.
  */
 
-static FILE		*fp = NULL;
-static char		 linestr[AU_LINE_MAX];
+static int		 cursor = 0;
 static const char	*user_delim = ":";
 
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
@@ -85,16 +87,59 @@ userfromstr(char *str, struct au_user_ent *u)
 }
 
 /*
- * Rewind to beginning of the file
+ * Load the audit_user file into a snapshot, up to the first line that
+ * cannot be parsed.
  */
-static void
-setauuser_locked(void)
+int
+au_db_load_user(struct au_db *db)
 {
+	char linestr[AU_LINE_MAX];
+	char user_ent_name[AU_USER_NAME_MAX];
+	struct au_user_ent u;
+	struct au_db_ent de;
+	FILE *fp;
+	char *nl;
 
-	if (fp != NULL)
-		fseek(fp, 0, SEEK_SET);
+	if ((fp = fopen(AUDIT_USER_FILE, "r")) == NULL)
+		return (-1);
+	u.au_name = user_ent_name;
+	bzero(&de, sizeof(de));
+	while (fgets(linestr, AU_LINE_MAX, fp) != NULL) {
+		/* Remove new lines. */
+		if ((nl = strrchr(linestr, '\n')) != NULL)
+			*nl = '\0';
+
+		/* Skip comments. */
+		if (linestr[0] == '#')
+			continue;
+
+		if (userfromstr(linestr, &u) == NULL)
+			break;
+		de.de_name = u.au_name;
+		de.de_always = u.au_always;
+		de.de_never = u.au_never;
+		if (au_db_add(db, &de) != 0) {
+			fclose(fp);
+			return (-1);
+		}
+	}
+	fclose(fp);
+	return (0);
+}
+
+static struct au_user_ent *
+copyauuser(struct au_user_ent *u, const struct au_db_ent *de)
+{
+
+	strlcpy(u->au_name, de->de_name, AU_USER_NAME_MAX);
+	u->au_always = de->de_always;
+	u->au_never = de->de_never;
+	return (u);
 }
 
+/*
+ * Rewind to beginning of the file
+ */
 void
 setauuser(void)
 {
@@ -102,14 +147,14 @@ setauuser(void)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	setauuser_locked();
+	cursor = 0;
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
 }
 
 /*
- * Close the file descriptor
+ * Finish with the file; it will be read again on next use.
  */
 void
 endauuser(void)
@@ -118,59 +163,34 @@ endauuser(void)
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	if (fp != NULL) {
-		fclose(fp);
-		fp = NULL;
-	}
+	cursor = 0;
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
+	au_db_invalidate(AU_DB_USER);
 }
 
 /*
  * Enumerate the au_user_ent structures from the file
  */
-static struct au_user_ent *
-getauuserent_r_locked(struct au_user_ent *u)
-{
-	char *nl;
-
-	if ((fp == NULL) && ((fp = fopen(AUDIT_USER_FILE, "r")) == NULL))
-		return (NULL);
-
-	while (1) {
-		if (fgets(linestr, AU_LINE_MAX, fp) == NULL)
-			return (NULL);
-
-		/* Remove new lines. */
-		if ((nl = strrchr(linestr, '\n')) != NULL)
-			*nl = '\0';
-
-		/* Skip comments. */
-		if (linestr[0] == '#')
-			continue;
-
-		/* Get the next structure. */
-		if (userfromstr(linestr, u) == NULL)
-			return (NULL);
-		break;
-	}
-
-	return (u);
-}
-
 struct au_user_ent *
 getauuserent_r(struct au_user_ent *u)
 {
+	const struct au_db *db;
 	struct au_user_ent *up;
 
+	if ((db = au_db_enter(AU_DB_USER)) == NULL)
+		return (NULL);
+	up = NULL;
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_lock(&mutex);
 #endif
-	up = getauuserent_r_locked(u);
+	if (cursor < db->adb_nenum)
+		up = copyauuser(u, &db->adb_ent[cursor++]);
 #ifdef HAVE_PTHREAD_MUTEX_LOCK
 	pthread_mutex_unlock(&mutex);
 #endif
+	au_db_exit(AU_DB_USER);
 	return (up);
 }
 
@@ -193,30 +213,19 @@ getauuserent(void)
 struct au_user_ent *
 getauusernam_r(struct au_user_ent *u, const char *name)
 {
+	const struct au_db_ent *de;
+	const struct au_db *db;
 	struct au_user_ent *up;
 
 	if (name == NULL)
 		return (NULL);
-
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_lock(&mutex);
-#endif
-
-	setauuser_locked();
-	while ((up = getauuserent_r_locked(u)) != NULL) {
-		if (strcmp(name, u->au_name) == 0) {
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-			pthread_mutex_unlock(&mutex);
-#endif
-			return (up);
-		}
-	}
-
-#ifdef HAVE_PTHREAD_MUTEX_LOCK
-	pthread_mutex_unlock(&mutex);
-#endif
-	return (NULL);
-
+	if ((db = au_db_enter(AU_DB_USER)) == NULL)
+		return (NULL);
+	up = NULL;
+	if ((de = au_db_byname(db, name)) != NULL)
+		up = copyauuser(u, de);
+	au_db_exit(AU_DB_USER);
+	return (up);
 }
 
 struct au_user_ent *
@@ -39,18 +39,53 @@
 
 #include <sys/param.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
-#ifdef __APPLE__
-#include <sys/queue.h>		/* Our bsm/audit.h doesn't include queue.h. */
+#include <config/config.h>
+
+#ifdef USE_ENDIAN_H
+#include <endian.h>
+#endif
+#ifdef USE_SYS_ENDIAN_H
+#include <sys/endian.h>
+#endif
+#ifdef USE_MACHINE_ENDIAN_H
+#include <machine/endian.h>
 #endif
+#ifdef USE_COMPAT_ENDIAN_H
+#include <compat/endian.h>
+#endif
+#ifdef USE_COMPAT_ENDIAN_ENC_H
+#include <compat/endian_enc.h>
+#endif
+
+#ifdef HAVE_FULL_QUEUE_H
+#include <sys/queue.h>
+#else /* !HAVE_FULL_QUEUE_H */
+#include <compat/queue.h>
+#endif /* !HAVE_FULL_QUEUE_H */
 
+#ifndef HAVE_CLOCK_GETTIME
+#include <compat/clock_gettime.h>
+#endif
+
+#ifndef __linux__
 #include <sys/sysctl.h>
+#endif
 
+#include <netinet/in.h>
+
+#include <bsm/audit_internal.h>
 #include <bsm/libbsm.h>
 
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+#include <pthread.h>
+#endif
 #include <unistd.h>
 #include <syslog.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
@@ -58,6 +93,291 @@
 int audit_set_terminal_port(dev_t *p);
 int audit_set_terminal_host(uint32_t *m);
 
+/*
+ * Optional per-event token-bucket limits on audit_submit() and
+ * audit_submit_prepared().  Each permitted record costs 1/rate seconds of
+ * credit, which accrues with elapsed time up to burst records' worth.
+ * Records arriving with no credit are either sampled (one in every
+ * arl_sample is let through) or suppressed and counted; the count is
+ * reported in a summary record once AUDIT_RATELIMIT_INTERVAL seconds have
+ * passed since the first suppression, by the next submission for any event
+ * or call to audit_submit_suppressed(), so that it is not lost if the event
+ * stops.  audit_ratelimit_due holds the earliest time a summary is due.
+ */
+#define	AUDIT_RATELIMIT_INTERVAL	10
+#define	AUDIT_RATELIMIT_NSEC		1000000000ULL
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#define	AUDIT_RATELIMIT_CLOCK		CLOCK_MONOTONIC
+#else
+#define	AUDIT_RATELIMIT_CLOCK		CLOCK_REALTIME
+#endif
+
+struct au_ratelimit {
+	short			 arl_event;
+	u_int			 arl_sample;
+	u_int64_t		 arl_cost;	/* Credit per record (ns). */
+	u_int64_t		 arl_depth;	/* Maximum credit (ns). */
+	u_int64_t		 arl_credit;	/* Current credit (ns). */
+	u_int64_t		 arl_last;	/* Time credit last accrued. */
+	u_int64_t		 arl_excess;	/* Records over the limit. */
+	u_int64_t		 arl_pending;	/* Suppressed, not reported. */
+	u_int64_t		 arl_suppressed; /* Suppressed in total. */
+	u_int64_t		 arl_report;	/* When the summary is due. */
+	LIST_ENTRY(au_ratelimit) arl_list;
+};
+
+static LIST_HEAD(, au_ratelimit)	audit_ratelimit_q =
+    LIST_HEAD_INITIALIZER(audit_ratelimit_q);
+static int				audit_ratelimit_count;
+static u_int64_t			audit_ratelimit_due = UINT64_MAX;
+
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+static pthread_mutex_t	audit_ratelimit_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static u_int64_t
+audit_ratelimit_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(AUDIT_RATELIMIT_CLOCK, &ts) < 0)
+		return (0);
+	return ((u_int64_t)ts.tv_sec * AUDIT_RATELIMIT_NSEC + ts.tv_nsec);
+}
+
+static struct au_ratelimit *
+audit_ratelimit_lookup(short au_event)
+{
+	struct au_ratelimit *arl;
+
+	LIST_FOREACH(arl, &audit_ratelimit_q, arl_list) {
+		if (arl->arl_event == au_event)
+			return (arl);
+	}
+	return (NULL);
+}
+
+/*
+ * Commit a record stating how many records for au_event were suppressed.
+ */
+static void
+audit_ratelimit_report(short au_event, u_int64_t suppressed)
+{
+	token_t *token;
+	int afd;
+
+	afd = au_open();
+	if (afd < 0)
+		return;
+	if ((token = au_to_me()) == NULL || au_write(afd, token) < 0)
+		goto fail;
+	if ((token = au_to_text("audit_submit: records suppressed by rate "
+	    "limit")) == NULL || au_write(afd, token) < 0)
+		goto fail;
+	if ((token = au_to_arg64(1, "suppressed", suppressed)) == NULL ||
+	    au_write(afd, token) < 0)
+		goto fail;
+	if ((token = au_to_return32(0, 0)) == NULL ||
+	    au_write(afd, token) < 0)
+		goto fail;
+	if (au_close(afd, AU_TO_WRITE, au_event) < 0)
+		syslog(LOG_AUTH | LOG_ERR, "audit: record not committed");
+	return;
+fail:
+	syslog(LOG_AUTH | LOG_ERR, "audit: unable to build summary record");
+	(void) au_close(afd, AU_TO_NO_WRITE, au_event);
+}
+
+/*
+ * Commit every summary due by now, one at a time so that no record is
+ * written with the lock held, and note when the next one is due.
+ */
+static void
+audit_ratelimit_flush(u_int64_t now)
+{
+	struct au_ratelimit *arl;
+	u_int64_t due, report;
+	short au_event;
+
+	for (;;) {
+		au_event = 0;
+		report = 0;
+		due = UINT64_MAX;
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_lock(&audit_ratelimit_mutex);
+#endif
+		LIST_FOREACH(arl, &audit_ratelimit_q, arl_list) {
+			if (arl->arl_pending == 0)
+				continue;
+			if (report == 0 && now >= arl->arl_report) {
+				au_event = arl->arl_event;
+				report = arl->arl_pending;
+				arl->arl_pending = 0;
+			} else if (arl->arl_report < due)
+				due = arl->arl_report;
+		}
+		if (report == 0)
+			__atomic_store_n(&audit_ratelimit_due, due,
+			    __ATOMIC_RELAXED);
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_unlock(&audit_ratelimit_mutex);
+#endif
+		if (report == 0)
+			return;
+		audit_ratelimit_report(au_event, report);
+	}
+}
+
+/*
+ * Set, change or, with a rate of zero, remove the limit on records for
+ * au_event.  Counts of suppressed records survive a change of limit, and
+ * any not yet reported are reported when the limit is removed.  A record
+ * must cost at least a nanosecond of credit, which bounds the rate.
+ */
+int
+audit_submit_ratelimit(short au_event, u_int rate, u_int burst, u_int sample)
+{
+	struct au_ratelimit *arl;
+	u_int64_t report;
+
+	if ((rate != 0 && burst == 0) || rate > AUDIT_RATELIMIT_NSEC) {
+		errno = EINVAL;
+		return (-1);
+	}
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_lock(&audit_ratelimit_mutex);
+#endif
+	arl = audit_ratelimit_lookup(au_event);
+	if (rate == 0) {
+		report = 0;
+		if (arl != NULL) {
+			report = arl->arl_pending;
+			LIST_REMOVE(arl, arl_list);
+			__atomic_sub_fetch(&audit_ratelimit_count, 1,
+			    __ATOMIC_SEQ_CST);
+			free(arl);
+		}
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_unlock(&audit_ratelimit_mutex);
+#endif
+		if (report != 0)
+			audit_ratelimit_report(au_event, report);
+		return (0);
+	}
+	if (arl == NULL) {
+		arl = calloc(1, sizeof(*arl));
+		if (arl == NULL) {
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+			pthread_mutex_unlock(&audit_ratelimit_mutex);
+#endif
+			return (-1);
+		}
+		arl->arl_event = au_event;
+		LIST_INSERT_HEAD(&audit_ratelimit_q, arl, arl_list);
+		__atomic_add_fetch(&audit_ratelimit_count, 1,
+		    __ATOMIC_SEQ_CST);
+	}
+	arl->arl_sample = sample;
+	arl->arl_cost = AUDIT_RATELIMIT_NSEC / rate;
+	arl->arl_depth = arl->arl_cost * burst;
+	arl->arl_credit = arl->arl_depth;
+	arl->arl_last = audit_ratelimit_now();
+	arl->arl_excess = 0;
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&audit_ratelimit_mutex);
+#endif
+	return (0);
+}
+
+/*
+ * Return the number of records for au_event suppressed since its limit was
+ * first set, first committing any summaries that are due if auditing is on.
+ */
+int
+audit_submit_suppressed(short au_event, u_int64_t *suppressedp)
+{
+	struct au_ratelimit *arl;
+	u_int64_t now;
+	int acond;
+
+	now = audit_ratelimit_now();
+	if (now >= __atomic_load_n(&audit_ratelimit_due, __ATOMIC_RELAXED) &&
+	    audit_get_cond(&acond) == 0 && acond != AUC_NOAUDIT)
+		audit_ratelimit_flush(now);
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_lock(&audit_ratelimit_mutex);
+#endif
+	arl = audit_ratelimit_lookup(au_event);
+	if (arl != NULL)
+		*suppressedp = arl->arl_suppressed;
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&audit_ratelimit_mutex);
+#endif
+	if (arl == NULL) {
+		errno = ENOENT;
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Decide whether a record for au_event may be submitted, first committing
+ * any summaries of suppressed records that are due, for this or any other
+ * event.
+ */
+static int
+audit_ratelimit_admit(short au_event)
+{
+	struct au_ratelimit *arl;
+	u_int64_t now;
+	int admit;
+
+	if (__atomic_load_n(&audit_ratelimit_count, __ATOMIC_RELAXED) == 0)
+		return (1);
+	now = audit_ratelimit_now();
+	if (now >= __atomic_load_n(&audit_ratelimit_due, __ATOMIC_RELAXED))
+		audit_ratelimit_flush(now);
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_lock(&audit_ratelimit_mutex);
+#endif
+	arl = audit_ratelimit_lookup(au_event);
+	if (arl == NULL) {
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+		pthread_mutex_unlock(&audit_ratelimit_mutex);
+#endif
+		return (1);
+	}
+	if (now > arl->arl_last) {
+		arl->arl_credit += now - arl->arl_last;
+		if (arl->arl_credit > arl->arl_depth)
+			arl->arl_credit = arl->arl_depth;
+		arl->arl_last = now;
+	}
+	if (arl->arl_credit >= arl->arl_cost) {
+		arl->arl_credit -= arl->arl_cost;
+		admit = 1;
+	} else if (arl->arl_sample != 0 &&
+	    ++arl->arl_excess % arl->arl_sample == 0)
+		admit = 1;
+	else {
+		if (arl->arl_pending++ == 0) {
+			arl->arl_report = now +
+			    AUDIT_RATELIMIT_INTERVAL * AUDIT_RATELIMIT_NSEC;
+			if (arl->arl_report < __atomic_load_n(
+			    &audit_ratelimit_due, __ATOMIC_RELAXED))
+				__atomic_store_n(&audit_ratelimit_due,
+				    arl->arl_report, __ATOMIC_RELAXED);
+		}
+		arl->arl_suppressed++;
+		admit = 0;
+	}
+#ifdef HAVE_PTHREAD_MUTEX_LOCK
+	pthread_mutex_unlock(&audit_ratelimit_mutex);
+#endif
+	return (admit);
+}
+
 /*
  * General purpose audit submission mechanism for userspace.
  */
@@ -90,6 +410,8 @@ audit_submit(short au_event, au_id_t auid, char status,
 	}
 	if (acond == AUC_NOAUDIT)
 		return (0);
+	if (!audit_ratelimit_admit(au_event))
+		return (0);
 	afd = au_open();
 	if (afd < 0) {
 		error = errno;
@@ -207,6 +529,254 @@ audit_submit(short au_event, au_id_t auid, char status,
 	return (0);
 }
 
+/*
+ * Largest subject token we pre-encode: a subject32_ex token carrying an IPv6
+ * terminal address.
+ */
+#define	AUDIT_PREPARED_SUBJECT_MAX	(sizeof(u_char) + 13 * sizeof(u_int32_t))
+
+/*
+ * Offsets of the effective user and group IDs within an encoded subject32
+ * or subject32_ex token.
+ */
+#define	AUDIT_PREPARED_EUID_OFF		(sizeof(u_char) + sizeof(u_int32_t))
+#define	AUDIT_PREPARED_EGID_OFF		(sizeof(u_char) + 2 * sizeof(u_int32_t))
+
+/*
+ * Per-process state for audit_submit_prepared().  Everything in the subject
+ * token other than the effective credentials is fixed for the lifetime of a
+ * typical service, so it is encoded once and copied into each record; the
+ * effective IDs are patched in the copy when they differ.  The header form is
+ * also chosen once, so that a submission only asks for the audit condition.
+ * The structure is not changed after audit_prepare_subject(), so threads may
+ * share it.
+ */
+struct au_prepared_subject {
+	size_t			 aps_hdrsize;	/* Header token size. */
+	auditinfo_addr_t	 aps_kaudit;	/* Host address for header. */
+	uid_t			 aps_euid;	/* Encoded effective uid. */
+	gid_t			 aps_egid;	/* Encoded effective gid. */
+	size_t			 aps_sublen;	/* Encoded subject length. */
+	u_char			 aps_subject[AUDIT_PREPARED_SUBJECT_MAX];
+};
+
+/*
+ * Collect the audit state of the current process and encode the subject
+ * token used by audit_submit_prepared().  The result remains valid until the
+ * process changes its audit session with setaudit(2) or its real credentials,
+ * after which it should be freed and prepared again.
+ */
+au_prepared_subject_t *
+audit_prepare_subject(au_id_t auid)
+{
+	au_prepared_subject_t *aps;
+	struct in6_addr *aptr;
+	struct auditinfo ai;
+	struct auditinfo_addr aia;
+	au_tid_t atid;
+	token_t *token;
+	pid_t pid;
+	int error;
+
+	aps = calloc(1, sizeof(*aps));
+	if (aps == NULL)
+		return (NULL);
+
+	/*
+	 * Choose the header form the same way au_close(3) would, once.
+	 */
+	aps->aps_hdrsize = AUDIT_HEADER_SIZE;
+	aps->aps_kaudit.ai_termid.at_type = AU_IPv4;
+	aps->aps_kaudit.ai_termid.at_addr[0] = INADDR_ANY;
+	if (audit_get_kaudit(&aps->aps_kaudit,
+	    sizeof(aps->aps_kaudit)) == 0) {
+		switch (aps->aps_kaudit.ai_termid.at_type) {
+		case AU_IPv4:
+			if (aps->aps_kaudit.ai_termid.at_addr[0] !=
+			    INADDR_ANY)
+				aps->aps_hdrsize =
+				    AUDIT_HEADER_EX_SIZE(&aps->aps_kaudit);
+			break;
+		case AU_IPv6:
+			aptr = (struct in6_addr *)
+			    &aps->aps_kaudit.ai_termid.at_addr[0];
+			if (!IN6_IS_ADDR_UNSPECIFIED(aptr))
+				aps->aps_hdrsize =
+				    AUDIT_HEADER_EX_SIZE(&aps->aps_kaudit);
+			break;
+		}
+	}
+
+	/*
+	 * As with audit_submit(), prefer getaudit_addr(2) and fall back on
+	 * getaudit(2).
+	 */
+	error = getaudit_addr(&aia, sizeof(aia));
+	if (error < 0 && errno == ENOSYS) {
+		if (getaudit(&ai) < 0) {
+			error = errno;
+			syslog(LOG_AUTH | LOG_ERR, "audit: getaudit failed: %s",
+			    strerror(errno));
+			free(aps);
+			errno = error;
+			return (NULL);
+		}
+		aia.ai_termid.at_type = AU_IPv4;
+		aia.ai_termid.at_addr[0] = ai.ai_termid.machine;
+		aia.ai_termid.at_port = ai.ai_termid.port;
+	} else if (error < 0) {
+		error = errno;
+		syslog(LOG_AUTH | LOG_ERR, "audit: getaudit_addr failed: %s",
+		    strerror(errno));
+		free(aps);
+		errno = error;
+		return (NULL);
+	}
+	pid = getpid();
+	aps->aps_euid = geteuid();
+	aps->aps_egid = getegid();
+	if (aia.ai_termid.at_type != AU_IPv6) {
+		atid.port = aia.ai_termid.at_port;
+		atid.machine = aia.ai_termid.at_addr[0];
+		token = au_to_subject32(auid, aps->aps_euid, aps->aps_egid,
+		    getuid(), getgid(), pid, pid, &atid);
+	} else
+		token = au_to_subject_ex(auid, aps->aps_euid, aps->aps_egid,
+		    getuid(), getgid(), pid, pid, &aia.ai_termid);
+	if (token == NULL) {
+		syslog(LOG_AUTH | LOG_ERR,
+		    "audit: unable to build subject token");
+		free(aps);
+		errno = EPERM;
+		return (NULL);
+	}
+	aps->aps_sublen = token->len;
+	memcpy(aps->aps_subject, token->t_data, token->len);
+	au_free_token(token);
+	return (aps);
+}
+
+void
+audit_free_prepared_subject(au_prepared_subject_t *aps)
+{
+
+	free(aps);
+}
+
+/*
+ * Equivalent to audit_submit(), but using a subject prepared by
+ * audit_prepare_subject().  The record is encoded directly into a local
+ * buffer and handed to audit(2) without going through au_open(3).
+ */
+int
+audit_submit_prepared(const au_prepared_subject_t *aps, short au_event,
+    char status, int reterr, const char *fmt, ...)
+{
+	u_char record[MAX_AUDIT_HEADER_SIZE + AUDIT_PREPARED_SUBJECT_MAX +
+	    sizeof(u_char) + sizeof(u_int16_t) + MAX_AUDITSTRING_LEN +
+	    2 * sizeof(u_char) + sizeof(u_int32_t) + AUDIT_TRAILER_SIZE];
+	char text[MAX_AUDITSTRING_LEN];
+	struct timeval tm;
+	u_int16_t textlen;
+	u_int32_t reclen;
+	u_char *dptr, *subject;
+	va_list ap;
+	uid_t euid;
+	gid_t egid;
+	int acond, error;
+
+	if (aps == NULL) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	/*
+	 * The audit condition may change at any time, so it is checked on
+	 * each submission, exactly as audit_submit() does.
+	 */
+	if (audit_get_cond(&acond) != 0) {
+		if (errno == ENOSYS)
+			return (0);
+		error = errno;
+		syslog(LOG_AUTH | LOG_ERR, "audit: auditon failed: %s",
+		    strerror(errno));
+		errno = error;
+		return (-1);
+	}
+	if (acond == AUC_NOAUDIT)
+		return (0);
+	if (!audit_ratelimit_admit(au_event))
+		return (0);
+
+	textlen = 0;
+	if (fmt != NULL) {
+		va_start(ap, fmt);
+		(void) vsnprintf(text, MAX_AUDITSTRING_LEN, fmt, ap);
+		va_end(ap);
+		textlen = strlen(text) + 1;
+	}
+	reclen = aps->aps_hdrsize + aps->aps_sublen + 2 * sizeof(u_char) +
+	    sizeof(u_int32_t) + AUDIT_TRAILER_SIZE;
+	if (textlen != 0)
+		reclen += sizeof(u_char) + sizeof(u_int16_t) + textlen;
+
+	if (gettimeofday(&tm, NULL) < 0) {
+		error = errno;
+		syslog(LOG_AUTH | LOG_ERR, "audit: gettimeofday failed: %s",
+		    strerror(errno));
+		errno = error;
+		return (-1);
+	}
+	dptr = record;
+	if (aps->aps_hdrsize > AUDIT_HEADER_SIZE) {
+		ADD_U_CHAR(dptr, AUT_HEADER32_EX);
+		ADD_U_INT32(dptr, reclen);
+		ADD_U_CHAR(dptr, AUDIT_HEADER_VERSION_OPENBSM);
+		ADD_U_INT16(dptr, au_event);
+		ADD_U_INT16(dptr, 0);
+		ADD_U_INT32(dptr, aps->aps_kaudit.ai_termid.at_type);
+		ADD_MEM(dptr, &aps->aps_kaudit.ai_termid.at_addr[0],
+		    aps->aps_kaudit.ai_termid.at_type);
+	} else {
+		ADD_U_CHAR(dptr, AUT_HEADER32);
+		ADD_U_INT32(dptr, reclen);
+		ADD_U_CHAR(dptr, AUDIT_HEADER_VERSION_OPENBSM);
+		ADD_U_INT16(dptr, au_event);
+		ADD_U_INT16(dptr, 0);
+	}
+	ADD_U_INT32(dptr, tm.tv_sec);
+	ADD_U_INT32(dptr, tm.tv_usec / 1000);
+	subject = dptr;
+	ADD_MEM(dptr, aps->aps_subject, aps->aps_sublen);
+	euid = geteuid();
+	if (euid != aps->aps_euid)
+		be32enc(subject + AUDIT_PREPARED_EUID_OFF, euid);
+	egid = getegid();
+	if (egid != aps->aps_egid)
+		be32enc(subject + AUDIT_PREPARED_EGID_OFF, egid);
+	if (textlen != 0) {
+		ADD_U_CHAR(dptr, AUT_TEXT);
+		ADD_U_INT16(dptr, textlen);
+		ADD_STRING(dptr, text, textlen);
+	}
+	ADD_U_CHAR(dptr, AUT_RETURN32);
+	ADD_U_CHAR(dptr, au_errno_to_bsm(status));
+	ADD_U_INT32(dptr, reterr);
+	ADD_U_CHAR(dptr, AUT_TRAILER);
+	ADD_U_INT16(dptr, AUT_TRAILER_MAGIC);
+	ADD_U_INT32(dptr, reclen);
+
+	if (audit(record, reclen) != 0) {
+		if (errno == ENOSYS)
+			return (0);
+		error = errno;
+		syslog(LOG_AUTH | LOG_ERR, "audit: record not committed");
+		errno = error;
+		return (-1);
+	}
+	return (0);
+}
+
 int
 audit_set_terminal_port(dev_t *p)
 {
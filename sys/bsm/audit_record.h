@@ -195,6 +195,7 @@ struct sockaddr;
 struct sockaddr_in;
 struct sockaddr_in6;
 struct sockaddr_un;
+struct iovec;
 #if defined(_KERNEL) || defined(KERNEL)
 struct vnode_au_info;
 #endif
@@ -211,6 +212,10 @@ int	 au_write(int d, token_t *m);
 int	 au_close(int d, int keep, short event);
 int	 au_close_buffer(int d, short event, u_char *buffer, size_t *buflen);
 int	 au_close_token(token_t *tok, u_char *buffer, size_t *buflen);
+#if !defined(KERNEL) && !defined(_KERNEL)
+int	 au_write_exec_args(int d, char **argv, size_t reserve);
+int	 au_write_exec_env(int d, char **envp, size_t reserve);
+#endif
 
 token_t	*au_to_file(const char *file, struct timeval tm);
 
@@ -229,6 +234,8 @@ token_t	*au_to_header32_ex(int rec_size, au_event_t e_type, au_emod_t e_mod);
 #endif
 
 token_t	*au_to_me(void);
+token_t	*au_to_me_cached(void);
+void	 au_me_invalidate(void);
 token_t	*au_to_arg(char n, const char *text, uint32_t v);
 token_t	*au_to_arg32(char n, const char *text, uint32_t v);
 token_t	*au_to_arg64(char n, const char *text, uint64_t v);
@@ -297,6 +304,10 @@ token_t	*au_to_exec_env(char *envs, int envc);
 token_t	*au_to_exec_args(char **argv);
 token_t	*au_to_exec_env(char **envp);
 #endif
+token_t	*au_to_exec_args_iov(const struct iovec *iov, int iovcnt,
+	    size_t maxsize);
+token_t	*au_to_exec_env_iov(const struct iovec *iov, int iovcnt,
+	    size_t maxsize);
 token_t	*au_to_text(const char *text);
 token_t	*au_to_kevent(struct kevent *kev);
 token_t	*au_to_trailer(int rec_size);
@@ -0,0 +1,236 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Check that auditd_set_evcmap() pushes each event-to-class and
+ * event-to-name mapping once, pushes again only those that change or failed,
+ * and clears the class of an event removed from audit_event(5).  The libauditd
+ * source is compiled here, its back end replaced by one that records the
+ * mappings set and fails those it is told to.
+ */
+
+#include "libauditd/auditd_evcmap.c"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#define	MOCK_MAX	16
+
+struct mock {
+	au_evclass_map_t	m_evc[MOCK_MAX];
+	au_evname_map_t		m_evn[MOCK_MAX];
+	int			m_nevc;
+	int			m_nevn;
+	int			m_ncalls;
+	au_event_t		m_fail;		/* Its class is not set. */
+};
+
+static int	failures;
+
+static void
+mock_class(void *arg, const au_evclass_map_t *evc, int *error, int n)
+{
+	struct mock *m = arg;
+	int i;
+
+	m->m_ncalls++;
+	for (i = 0; i < n; i++) {
+		error[i] = evc[i].ec_number == m->m_fail ? EPERM : 0;
+		if (m->m_nevc < MOCK_MAX)
+			m->m_evc[m->m_nevc++] = evc[i];
+	}
+}
+
+static void
+mock_event(void *arg, const au_evname_map_t *evn, int *error, int n)
+{
+	struct mock *m = arg;
+	int i;
+
+	m->m_ncalls++;
+	for (i = 0; i < n; i++) {
+		error[i] = 0;
+		if (m->m_nevn < MOCK_MAX)
+			m->m_evn[m->m_nevn++] = evn[i];
+	}
+}
+
+static struct auditd_evcmap_ent *
+ents(int n, ...)
+{
+	struct auditd_evcmap_ent *ent;
+	const char *name;
+	va_list ap;
+	int i;
+
+	ent = calloc(n + 1, sizeof(*ent));
+	va_start(ap, n);
+	for (i = 0; i < n; i++) {
+		ent[i].ee_number = va_arg(ap, int);
+		ent[i].ee_class = va_arg(ap, int);
+		name = va_arg(ap, const char *);
+		if (strlcpy(ent[i].ee_name, name, sizeof(ent[i].ee_name)) >=
+		    sizeof(ent[i].ee_name))
+			ent[i].ee_flags = EE_NAME_LONG;
+	}
+	va_end(ap);
+	return (ent);
+}
+
+/*
+ * Synchronize and compare the mappings the back end was asked to set with
+ * those expected: the classes as number and class pairs, then the names as
+ * numbers.
+ */
+static void
+check(const char *what, struct auditd_evcmap *em, struct mock *m,
+    struct auditd_evcmap_ent *ent, int nent, int ctr, int nevc,
+    const int *evc, int nevn, const int *evn)
+{
+	const struct auditd_evcmap_backend eb = {
+		.eb_set_class = mock_class,
+		.eb_set_event = mock_event,
+		.eb_arg = m,
+	};
+	int i, ok, rc;
+
+	m->m_nevc = m->m_nevn = m->m_ncalls = 0;
+	rc = auditd_evcmap_sync(em, &eb, ent, nent);
+	ok = rc == ctr && m->m_nevc == nevc && m->m_nevn == nevn;
+	for (i = 0; ok && i < nevc; i++)
+		ok = m->m_evc[i].ec_number == (au_event_t)evc[2 * i] &&
+		    m->m_evc[i].ec_class == (au_class_t)evc[2 * i + 1];
+	for (i = 0; ok && i < nevn; i++)
+		ok = m->m_evn[i].en_number == (au_event_t)evn[i];
+	if (nevc == 0 && nevn == 0 && m->m_ncalls != 0)
+		ok = 0;
+	if (!ok) {
+		failures++;
+		fprintf(stderr, "%s: returned %d, %d classes and %d names "
+		    "set\n", what, rc, m->m_nevc, m->m_nevn);
+	}
+}
+
+static void
+check_sync(void)
+{
+	static const char longname[] = "AUE_THIS_NAME_IS_FAR_TOO_LONG_FOR_"
+	    "THE_IN_KERNEL_EVENT_TO_NAME_MAPPING_AND_IS_NOT_SET";
+	struct auditd_evcmap em = { NULL, 0 };
+	struct mock m = { .m_fail = 0 };
+
+	/* Everything is pushed once, the last of duplicate numbers winning. */
+	check("initial", &em, &m, ents(4, 1, 0x1, "AUE_A", 2, 0x2, "AUE_B",
+	    3, 0x4, "AUE_C", 1, 0x8, "AUE_A2"), 4, 3,
+	    3, (const int []){ 1, 0x8, 2, 0x2, 3, 0x4 },
+	    3, (const int []){ 1, 2, 3 });
+
+	/* An unchanged file pushes nothing. */
+	check("unchanged", &em, &m, ents(3, 1, 0x8, "AUE_A2", 2, 0x2, "AUE_B",
+	    3, 0x4, "AUE_C"), 3, 3, 0, NULL, 0, NULL);
+
+	/* Changed, added and removed events. */
+	check("changed", &em, &m, ents(3, 1, 0x10, "AUE_A2", 3, 0x4, "AUE_C3",
+	    4, 0x1, "AUE_D"), 3, 3,
+	    3, (const int []){ 1, 0x10, 2, 0, 4, 0x1 },
+	    2, (const int []){ 3, 4 });
+
+	/* A class that could not be set is tried again. */
+	m.m_fail = 5;
+	check("failed", &em, &m, ents(4, 1, 0x10, "AUE_A2", 3, 0x4, "AUE_C3",
+	    4, 0x1, "AUE_D", 5, 0x2, "AUE_E"), 4, 3,
+	    1, (const int []){ 5, 0x2 }, 1, (const int []){ 5 });
+	m.m_fail = 0;
+	check("retried", &em, &m, ents(4, 1, 0x10, "AUE_A2", 3, 0x4, "AUE_C3",
+	    4, 0x1, "AUE_D", 5, 0x2, "AUE_E"), 4, 4,
+	    1, (const int []){ 5, 0x2 }, 0, NULL);
+
+	/* A class that could not be cleared is tried again. */
+	m.m_fail = 4;
+	check("remove failed", &em, &m, ents(3, 1, 0x10, "AUE_A2",
+	    3, 0x4, "AUE_C3", 5, 0x2, "AUE_E"), 3, 3,
+	    1, (const int []){ 4, 0 }, 0, NULL);
+	m.m_fail = 0;
+	check("remove retried", &em, &m, ents(3, 1, 0x10, "AUE_A2",
+	    3, 0x4, "AUE_C3", 5, 0x2, "AUE_E"), 3, 3,
+	    1, (const int []){ 4, 0 }, 0, NULL);
+	check("removed", &em, &m, ents(3, 1, 0x10, "AUE_A2",
+	    3, 0x4, "AUE_C3", 5, 0x2, "AUE_E"), 3, 3, 0, NULL, 0, NULL);
+
+	/* A name too long for the kernel is never set. */
+	check("long name", &em, &m, ents(1, 6, 0x1, longname), 1, 1,
+	    4, (const int []){ 1, 0, 3, 0, 5, 0, 6, 0x1 }, 0, NULL);
+	check("long name again", &em, &m, ents(1, 6, 0x1, longname), 1, 1,
+	    0, NULL, 0, NULL);
+
+	auditd_evcmap_free(&em);
+}
+
+#ifndef HAVE_AUDIT_SYSCALLS
+/*
+ * Without audit system calls, this test links against libbsm's stub, which
+ * keeps the mappings itself, so the kernel back end can be checked against it.
+ */
+static void
+check_kernel(void)
+{
+	struct auditd_evcmap em = { NULL, 0 };
+	au_evclass_map_t evc;
+	int rc;
+
+	rc = auditd_evcmap_sync(&em, &auditd_evcmap_kernel,
+	    ents(2, 7, 0x20, "AUE_G", 8, 0x40, "AUE_H"), 2);
+	rc += auditd_evcmap_sync(&em, &auditd_evcmap_kernel,
+	    ents(1, 8, 0x80, "AUE_H"), 1);
+	evc.ec_number = 7;
+	if (audit_get_class(&evc, sizeof(evc)) != 0 || evc.ec_class != 0) {
+		failures++;
+		fprintf(stderr, "kernel: class of removed event not cleared\n");
+	}
+	evc.ec_number = 8;
+	if (audit_get_class(&evc, sizeof(evc)) != 0 || evc.ec_class != 0x80 ||
+	    rc != 3) {
+		failures++;
+		fprintf(stderr, "kernel: class of event not set\n");
+	}
+	auditd_evcmap_free(&em);
+}
+#endif
+
+int
+main(void)
+{
+
+	check_sync();
+#ifndef HAVE_AUDIT_SYSCALLS
+	check_kernel();
+#endif
+	if (failures != 0) {
+		fprintf(stderr, "evcmap: %d failures\n", failures);
+		return (1);
+	}
+	return (0);
+}
@@ -38,6 +38,24 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 
+#include <config/config.h>
+
+#ifdef USE_ENDIAN_H
+#include <endian.h>
+#endif
+#ifdef USE_SYS_ENDIAN_H
+#include <sys/endian.h>
+#endif
+#ifdef USE_MACHINE_ENDIAN_H
+#include <machine/endian.h>
+#endif
+#ifdef USE_COMPAT_ENDIAN_H
+#include <compat/endian.h>
+#endif
+#ifdef USE_COMPAT_ENDIAN_ENC_H
+#include <compat/endian_enc.h>
+#endif
+
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
@@ -940,12 +958,16 @@ generate_socketex_token(const char *directory, const char *token_filename)
 
 	bzero(&socketex_laddr, sizeof(socketex_laddr));
 	socketex_laddr.sin_family = AF_INET;
+#ifdef HAVE_SOCKADDR_STORAGE_SS_LEN
 	socketex_laddr.sin_len = sizeof(socketex_laddr);
+#endif
 	socketex_laddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 
 	bzero(&socketex_raddr, sizeof(socketex_raddr));
 	socketex_raddr.sin_family = AF_INET;
+#ifdef HAVE_SOCKADDR_STORAGE_SS_LEN
 	socketex_raddr.sin_len = sizeof(socketex_raddr);
+#endif
 	socketex_raddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 
 	socketex_token = au_to_socket_ex(au_domain_to_bsm(socketex_domain),
@@ -964,12 +986,16 @@ generate_socketex_record(const char *directory, const char *record_filename)
 
 	bzero(&socketex_laddr, sizeof(socketex_laddr));
 	socketex_laddr.sin_family = AF_INET;
+#ifdef HAVE_SOCKADDR_STORAGE_SS_LEN
 	socketex_laddr.sin_len = sizeof(socketex_laddr);
+#endif
 	socketex_laddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 
 	bzero(&socketex_raddr, sizeof(socketex_raddr));
 	socketex_raddr.sin_family = AF_INET;
+#ifdef HAVE_SOCKADDR_STORAGE_SS_LEN
 	socketex_raddr.sin_len = sizeof(socketex_raddr);
+#endif
 	socketex_raddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 
 	socketex_token = au_to_socket_ex(au_domain_to_bsm(socketex_domain),
@@ -0,0 +1,213 @@
+/*-
+ * Copyright (c) 2026 The TrustedBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Check that the indexed translations between BSM and local constants give
+ * exactly the results of searching the translation tables in order, for
+ * every value in and around their ranges.  The tables are taken from the
+ * libbsm sources, compiled here without their lookup functions.
+ */
+
+#define	BSM_MKTABLES
+
+#include "libbsm/bsm_domain.c"
+#include "libbsm/bsm_errno.c"
+#include "libbsm/bsm_fcntl.c"
+#include "libbsm/bsm_socket_type.c"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Local values checked: negative values, which include the markers of
+ * missing local mappings, and positive ones beyond the largest constant of
+ * any host, such as the Darwin file system specific fcntl commands.
+ */
+#define	LOCAL_MIN	(-1024)
+#define	LOCAL_MAX	(0x10000 + 1024)
+
+static int	failures;
+
+static void
+fail(const char *what, int value, int got, int expected)
+{
+
+	if (failures++ < 20)
+		fprintf(stderr, "%s(%d): got %d, expected %d\n", what, value,
+		    got, expected);
+}
+
+/*
+ * The position of the first entry of a table whose field holds a value, or
+ * -1 if there is none.
+ */
+#define	SEARCH(i, tab, count, field, value) do {			\
+	for ((i) = 0; (i) < (count); (i)++)				\
+		if ((tab)[(i)].field == (value))			\
+			break;						\
+	if ((i) == (count))						\
+		(i) = -1;						\
+} while (0)
+
+static void
+check_domain(void)
+{
+	int error, expected, i, local, v;
+
+	for (v = LOCAL_MIN; v <= LOCAL_MAX; v++) {
+		SEARCH(i, bsm_domains, bsm_domains_count, bd_local_domain, v);
+		expected = i >= 0 ? bsm_domains[i].bd_bsm_domain :
+		    BSM_PF_UNKNOWN;
+		if (au_domain_to_bsm(v) != expected)
+			fail("au_domain_to_bsm", v, au_domain_to_bsm(v),
+			    expected);
+	}
+	for (v = 0; v <= USHRT_MAX; v++) {
+		SEARCH(i, bsm_domains, bsm_domains_count, bd_bsm_domain, v);
+		local = -1;
+		error = au_bsm_to_domain(v, &local);
+		expected = (i < 0 || bsm_domains[i].bd_local_domain) ? -1 : 0;
+		if (error != expected)
+			fail("au_bsm_to_domain", v, error, expected);
+		else if (error == 0 && local != bsm_domains[i].bd_local_domain)
+			fail("au_bsm_to_domain local", v, local,
+			    bsm_domains[i].bd_local_domain);
+	}
+}
+
+static void
+check_errno(void)
+{
+	int error, expected, i, local, v;
+	const char *str;
+
+	for (v = LOCAL_MIN; v <= LOCAL_MAX; v++) {
+		SEARCH(i, bsm_errnos, bsm_errnos_count, be_local_errno, v);
+		expected = i >= 0 ? bsm_errnos[i].be_bsm_errno :
+		    BSM_ERRNO_UNKNOWN;
+		if (au_errno_to_bsm(v) != expected)
+			fail("au_errno_to_bsm", v, au_errno_to_bsm(v),
+			    expected);
+	}
+	for (v = 0; v <= UCHAR_MAX; v++) {
+		SEARCH(i, bsm_errnos, bsm_errnos_count, be_bsm_errno, v);
+		local = -1;
+		error = au_bsm_to_errno(v, &local);
+		expected = (i < 0 ||
+		    bsm_errnos[i].be_local_errno == ERRNO_NO_LOCAL_MAPPING) ?
+		    -1 : 0;
+		if (error != expected)
+			fail("au_bsm_to_errno", v, error, expected);
+		else if (error == 0 && local != bsm_errnos[i].be_local_errno)
+			fail("au_bsm_to_errno local", v, local,
+			    bsm_errnos[i].be_local_errno);
+		if (i < 0)
+			str = "Unrecognized BSM error";
+		else if (bsm_errnos[i].be_local_errno !=
+		    ERRNO_NO_LOCAL_MAPPING)
+			str = strerror(bsm_errnos[i].be_local_errno);
+		else
+			str = bsm_errnos[i].be_strerror;
+		if (strcmp(au_strerror(v), str) != 0)
+			fail("au_strerror", v, 0, 0);
+	}
+}
+
+static void
+check_fcntl_cmd(void)
+{
+	int error, expected, i, local, v;
+
+	for (v = LOCAL_MIN; v <= LOCAL_MAX; v++) {
+		SEARCH(i, bsm_fcntl_cmdtab, bsm_fcntl_cmd_count,
+		    bfc_local_fcntl_cmd, v);
+		expected = i >= 0 ? bsm_fcntl_cmdtab[i].bfc_bsm_fcntl_cmd :
+		    BSM_F_UNKNOWN;
+		if (au_fcntl_cmd_to_bsm(v) != expected)
+			fail("au_fcntl_cmd_to_bsm", v, au_fcntl_cmd_to_bsm(v),
+			    expected);
+	}
+	for (v = 0; v <= USHRT_MAX; v++) {
+		SEARCH(i, bsm_fcntl_cmdtab, bsm_fcntl_cmd_count,
+		    bfc_bsm_fcntl_cmd, v);
+		local = -1;
+		error = au_bsm_to_fcntl_cmd(v, &local);
+		expected = (i < 0 || bsm_fcntl_cmdtab[i].bfc_local_fcntl_cmd) ?
+		    -1 : 0;
+		if (error != expected)
+			fail("au_bsm_to_fcntl_cmd", v, error, expected);
+		else if (error == 0 &&
+		    local != bsm_fcntl_cmdtab[i].bfc_local_fcntl_cmd)
+			fail("au_bsm_to_fcntl_cmd local", v, local,
+			    bsm_fcntl_cmdtab[i].bfc_local_fcntl_cmd);
+	}
+}
+
+static void
+check_socket_type(void)
+{
+	int error, expected, i, local, v;
+
+	for (v = LOCAL_MIN; v <= LOCAL_MAX; v++) {
+		SEARCH(i, bsm_socket_types, bsm_socket_types_count,
+		    bst_local_socket_type, v);
+		expected = i >= 0 ? bsm_socket_types[i].bst_bsm_socket_type :
+		    BSM_SOCK_UNKNOWN;
+		if (au_socket_type_to_bsm(v) != expected)
+			fail("au_socket_type_to_bsm", v,
+			    au_socket_type_to_bsm(v), expected);
+	}
+	for (v = 0; v <= USHRT_MAX; v++) {
+		SEARCH(i, bsm_socket_types, bsm_socket_types_count,
+		    bst_bsm_socket_type, v);
+		local = -1;
+		error = au_bsm_to_socket_type(v, &local);
+		expected = (i < 0 ||
+		    bsm_socket_types[i].bst_local_socket_type) ? -1 : 0;
+		if (error != expected)
+			fail("au_bsm_to_socket_type", v, error, expected);
+		else if (error == 0 &&
+		    local != bsm_socket_types[i].bst_local_socket_type)
+			fail("au_bsm_to_socket_type local", v, local,
+			    bsm_socket_types[i].bst_local_socket_type);
+	}
+}
+
+int
+main(void)
+{
+
+	check_domain();
+	check_errno();
+	check_fcntl_cmd();
+	check_socket_type();
+	if (failures != 0) {
+		fprintf(stderr, "tables: %d failures\n", failures);
+		return (1);
+	}
+	return (0);
+}